@@ -63,9 +63,23 @@ module nic_switch #
     input wire [31:0]                   forward_threshold_1,
     input wire [31:0]                   forward_threshold_2,
     input wire [31:0]                   forward_port_1,
-    input wire [31:0]                   unused2
+    input wire [31:0]                   unused2             // Size class config, see below
 );
 
+/*******************************************************************************/
+/********************************* Size Class **********************************/
+/*******************************************************************************/
+// unused2[15:0]  : IPv4 total length (bytes) from which a packet is large, 0 = size class off
+// unused2[31:16] : forward threshold of the large packets, in 64B units, usually below forward_threshold_1
+// Large packets to forward_port_1 leave tier 0 as soon as t0 reaches their threshold, the small
+// ones keep waiting for forward_threshold_1. Off, the switch behaves as before.
+wire [15:0] size_class_len = unused2[15:0];
+wire [31:0] size_class_threshold_1 = {10'b0, unused2[31:16], 6'b0};
+wire size_class_enable = (size_class_len != 16'b0);
+
+// Set on the first 64B of a large packet that goes to tier 1 early, then held for its other beats
+wire rx0_large_spill;
+
 /*******************************************************************************/
 /*************************** Active Buffer Estimator ***************************/
 /*******************************************************************************/
@@ -143,7 +157,7 @@ always @(*) begin
     
     // Add 64 to the appropriate estimator when valid.
     if (rx0_axis_tvalid) begin
-        if (ingress_tier)
+        if (ingress_tier || rx0_large_spill)
             t1_next = t1_next + 32'd64;
         else
             t0_next = t0_next + 32'd64;
@@ -291,6 +305,27 @@ always @* begin
     end
 end
 
+/*******************************************************************************/
+/************************* RX0 - size class of the pkt *************************/
+/*******************************************************************************/
+// IPv4 total length is bytes 16-17 of the frame, dst port bytes 36-37, both in the first 64B
+wire [15:0] rx0_ip_total_len = {rx0_axis_tdata[135:128], rx0_axis_tdata[143:136]};
+wire rx0_to_forward_port = (rx0_axis_tdata[303:296] == forward_port_1[7:0] && rx0_axis_tdata[295:288] == forward_port_1[15:8]);
+wire rx0_first_large_spill = size_class_enable && rx0_axis_tfirst_reg && rx0_to_forward_port &&
+                             rx0_ip_total_len >= size_class_len &&
+                             active_buffer_size_estimator_t0 >= size_class_threshold_1;
+reg rx0_large_spill_reg;
+
+always @(posedge rx0_clk) begin
+    if (rx0_rst) begin
+        rx0_large_spill_reg <= 1'b0;
+    end else if (rx0_axis_tvalid && rx0_axis_tfirst_reg) begin
+        rx0_large_spill_reg <= rx0_first_large_spill;
+    end
+end
+
+assign rx0_large_spill = rx0_axis_tfirst_reg ? rx0_first_large_spill : rx0_large_spill_reg;
+
 /*******************************************************************************/
 /*********************** Change ports and add timestamp ************************/
 /*******************************************************************************/
@@ -335,7 +370,7 @@ assign rx1_change_axis_tuser = rx1_change_axis_tuser_reg;
 
 always @(posedge rx0_clk) begin
     //Change Port on first 64B RX
-    if ( ingress_tier == 1'b1 && (rx0_axis_tfirst_reg == 1'b1 && rx0_axis_tdata[303:296] == forward_port_1[7:0] && rx0_axis_tdata[295:288] == forward_port_1[15:8])) begin
+    if ( (ingress_tier == 1'b1 || rx0_first_large_spill) && (rx0_axis_tfirst_reg == 1'b1 && rx0_axis_tdata[303:296] == forward_port_1[7:0] && rx0_axis_tdata[295:288] == forward_port_1[15:8])) begin
         if (rx0_axis_tdata[335:328] >= 8'h2) begin
             rx0_change_axis_tdata_reg <= {rx0_axis_tdata[511:336], rx0_axis_tdata[335:328] - 8'h2 /*UDP CheckSum*/, rx0_axis_tdata[327:304], rx0_axis_tdata[303:296] + 8'h2 /*dst_port*/, rx0_axis_tdata[295:208], rx0_axis_tdata[207:200] - 8'h2 /*IP CheckSum*/ , rx0_axis_tdata[199:0]};
         end else begin
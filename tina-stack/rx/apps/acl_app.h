@@ -0,0 +1,392 @@
+#ifndef ACL_APP_H
+#define ACL_APP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <assert.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <rte_eal.h>
+#include <rte_ethdev.h>
+#include <rte_ip.h>
+#include <rte_udp.h>
+#include <rte_acl.h>
+
+#include "base_app.h"
+#include "fast_rand.h"
+#include "simd_dispatch.h"
+#include "workload_gen.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Stateless 5-tuple firewall on rte_acl. The rule set is compiled once into a shared, read-only
+ * trie (the LLC working set), every burst is classified with a single rte_acl_classify() call.
+ *
+ * Rule file, one rule per line, first match wins, '#' starts a comment:
+ *   <src a.b.c.d>/<len> <dst a.b.c.d>/<len> <sport lo>:<hi> <dport lo>:<hi> <proto|tcp|udp|any> <accept|drop|count>
+ * "random:<n>" generates n rules from the workload seed instead, for footprint sweeps.
+ * A packet that matches nothing gets the default action (accept unless told otherwise).
+ *
+ * count accepts the packet and bumps the rule's counter. run_burst frees the dropped mbufs and
+ * moves the accepted and counted ones to the front, so a chain's later stages only see those.
+ */
+class AclApp: public BaseApp {
+
+public:
+    enum Action {
+        ACCEPT = 0,
+        DROP = 1,
+        COUNT = 2,
+
+        _ActionCount
+    };
+
+private:
+    static constexpr size_t MAX_COUNTERS_PRINTED = 16;
+
+    enum {
+        PROTO_FIELD = 0,
+        SRC_FIELD = 1,
+        DST_FIELD = 2,
+        SPORT_FIELD = 3,
+        DPORT_FIELD = 4,
+
+        NUM_FIELDS
+    };
+
+    RTE_ACL_RULE_DEF(_acl_rule, NUM_FIELDS);
+
+    struct _rule_meta {
+        Action action;
+        uint64_t line_no;           // 0 for generated rules
+    };
+
+    static rte_acl_ctx* ctx;
+    static std::vector<_rule_meta> rules;
+    static Action default_action;
+    static std::string alg_name;
+    static std::vector<AclApp*> instances;
+
+    std::vector<uint64_t> rule_hits;        // Per rule, this lcore only
+    uint64_t verdicts[_ActionCount] = {0};
+    uint64_t num_default = 0;
+    uint64_t num_pkts = 0;
+    uint64_t classify_cycles = 0;
+
+    //*** Offsets from the start of the IPv4 header, the first field is 1 byte and the others go by 4B input words */
+    static void field_defs(rte_acl_config* config)
+    {
+        const rte_acl_field_def defs[NUM_FIELDS] = {
+            {RTE_ACL_FIELD_TYPE_BITMASK, sizeof(uint8_t),  PROTO_FIELD, 0, offsetof(rte_ipv4_hdr, next_proto_id)},
+            {RTE_ACL_FIELD_TYPE_MASK,    sizeof(uint32_t), SRC_FIELD,   1, offsetof(rte_ipv4_hdr, src_addr)},
+            {RTE_ACL_FIELD_TYPE_MASK,    sizeof(uint32_t), DST_FIELD,   2, offsetof(rte_ipv4_hdr, dst_addr)},
+            {RTE_ACL_FIELD_TYPE_RANGE,   sizeof(uint16_t), SPORT_FIELD, 3, sizeof(rte_ipv4_hdr) + offsetof(rte_udp_hdr, src_port)},
+            {RTE_ACL_FIELD_TYPE_RANGE,   sizeof(uint16_t), DPORT_FIELD, 3, sizeof(rte_ipv4_hdr) + offsetof(rte_udp_hdr, dst_port)},
+        };
+        config->num_categories = 1;
+        config->num_fields = NUM_FIELDS;
+        memcpy(config->defs, defs, sizeof(defs));
+    }
+
+    static bool parse_action(const std::string& str, Action* action)
+    {
+        if (str == "accept")        *action = ACCEPT;
+        else if (str == "drop")     *action = DROP;
+        else if (str == "count")    *action = COUNT;
+        else return false;
+        return true;
+    }
+
+    static const char* action_str(Action action)
+    {
+        switch (action) {
+            case ACCEPT:    return "accept";
+            case DROP:      return "drop";
+            case COUNT:     return "count";
+            default:        return "unknown";
+        }
+    }
+
+    static bool parse_prefix(const char* str, uint32_t* ip, uint32_t* len)
+    {
+        unsigned a, b, c, d;
+        if (sscanf(str, "%u.%u.%u.%u/%u", &a, &b, &c, &d, len) != 5)
+            return false;
+        if (a > 255 || b > 255 || c > 255 || d > 255 || *len > 32)
+            return false;
+        *ip = RTE_IPV4(a, b, c, d);
+        return true;
+    }
+
+    static bool parse_range(const char* str, uint16_t* lo, uint16_t* hi)
+    {
+        unsigned l, h;
+        if (sscanf(str, "%u:%u", &l, &h) != 2 || l > h || h > UINT16_MAX)
+            return false;
+        *lo = l;
+        *hi = h;
+        return true;
+    }
+
+    static bool parse_rule(const std::string& line, _acl_rule* r, Action* action)
+    {
+        char src[32], dst[32], sport[16], dport[16], proto[8], act[8];
+        if (sscanf(line.c_str(), "%31s %31s %15s %15s %7s %7s", src, dst, sport, dport, proto, act) != 6)
+            return false;
+
+        uint32_t ip, len;
+        uint16_t lo, hi;
+        if (!parse_prefix(src, &ip, &len))
+            return false;
+        r->field[SRC_FIELD].value.u32 = ip;
+        r->field[SRC_FIELD].mask_range.u32 = len;
+        if (!parse_prefix(dst, &ip, &len))
+            return false;
+        r->field[DST_FIELD].value.u32 = ip;
+        r->field[DST_FIELD].mask_range.u32 = len;
+        if (!parse_range(sport, &lo, &hi))
+            return false;
+        r->field[SPORT_FIELD].value.u16 = lo;
+        r->field[SPORT_FIELD].mask_range.u16 = hi;
+        if (!parse_range(dport, &lo, &hi))
+            return false;
+        r->field[DPORT_FIELD].value.u16 = lo;
+        r->field[DPORT_FIELD].mask_range.u16 = hi;
+
+        if (strcmp(proto, "any") == 0) {
+            r->field[PROTO_FIELD].value.u8 = 0;
+            r->field[PROTO_FIELD].mask_range.u8 = 0;
+        } else {
+            unsigned p;
+            if (strcmp(proto, "tcp") == 0)          p = IPPROTO_TCP;
+            else if (strcmp(proto, "udp") == 0)     p = IPPROTO_UDP;
+            else if (sscanf(proto, "%u", &p) != 1 || p > UINT8_MAX)
+                return false;
+            r->field[PROTO_FIELD].value.u8 = p;
+            r->field[PROTO_FIELD].mask_range.u8 = UINT8_MAX;
+        }
+        return parse_action(act, action);
+    }
+
+    // Random prefixes and port ranges: a quarter of the rules count, a quarter accept, half drop
+    static void random_rule(FastRand& rng, _acl_rule* r, Action* action)
+    {
+        uint32_t src_len = 8 + rng.next_below(25);
+        uint32_t dst_len = 16 + rng.next_below(17);
+        r->field[SRC_FIELD].value.u32 = (uint32_t)rng.next() & ~0U << (32 - src_len);
+        r->field[SRC_FIELD].mask_range.u32 = src_len;
+        r->field[DST_FIELD].value.u32 = (uint32_t)rng.next() & ~0U << (32 - dst_len);
+        r->field[DST_FIELD].mask_range.u32 = dst_len;
+        r->field[SPORT_FIELD].value.u16 = 0;
+        r->field[SPORT_FIELD].mask_range.u16 = UINT16_MAX;
+        uint16_t lo = rng.next_below(UINT16_MAX - 1024);
+        r->field[DPORT_FIELD].value.u16 = lo;
+        r->field[DPORT_FIELD].mask_range.u16 = lo + rng.next_below(1024);
+        r->field[PROTO_FIELD].value.u8 = (rng.next() & 1) ? IPPROTO_UDP : 0;
+        r->field[PROTO_FIELD].mask_range.u8 = r->field[PROTO_FIELD].value.u8 ? UINT8_MAX : 0;
+        uint64_t pick = rng.next_below(4);
+        *action = (pick == 0) ? COUNT : (pick == 1) ? ACCEPT : DROP;
+    }
+
+    // Highest vector classifier allowed by the -v cap that this build and CPU accept
+    static void select_classify_alg()
+    {
+        static const struct { SimdLevel level; rte_acl_classify_alg alg; const char* name; } algs[] = {
+            {SIMD_AVX512, RTE_ACL_CLASSIFY_AVX512X32, "AVX-512 x32"},
+            {SIMD_AVX512, RTE_ACL_CLASSIFY_AVX512X16, "AVX-512 x16"},
+            {SIMD_AVX2,   RTE_ACL_CLASSIFY_AVX2,      "AVX2"},
+            {SIMD_SCALAR, RTE_ACL_CLASSIFY_SSE,       "SSE"},
+            {SIMD_SCALAR, RTE_ACL_CLASSIFY_SCALAR,    "scalar"},
+        };
+        SimdLevel level = detect_simd_level();
+        for (const auto& a : algs) {
+            if (a.level > level)
+                continue;
+            if (rte_acl_set_ctx_classify(ctx, a.alg) == 0) {
+                alg_name = a.name;
+                return;
+            }
+        }
+        alg_name = "default";
+    }
+
+public:
+
+    // Compile the rules into the shared context on the port's socket, rte_exit on any error
+    static void init(const std::string& rule_spec, const std::string& default_action_str, uint16_t port_id)
+    {
+        if (!default_action_str.empty() && !parse_action(default_action_str, &default_action))
+            rte_exit(EXIT_FAILURE, "ACL: invalid default action %s, should be accept, drop or count\n", default_action_str.c_str());
+
+        std::vector<_acl_rule> acl_rules;
+        uint64_t num_random = 0;
+        if (rule_spec.compare(0, 7, "random:") == 0) {
+            num_random = strtoul(rule_spec.c_str() + 7, nullptr, 10);
+            if (num_random == 0)
+                rte_exit(EXIT_FAILURE, "ACL: random:<n> needs a positive rule count\n");
+            FastRand rng(workload_config.seed ^ 0x61636C);
+            for (uint64_t i = 0; i < num_random; i++) {
+                _acl_rule r;
+                memset(&r, 0, sizeof(r));
+                Action action;
+                random_rule(rng, &r, &action);
+                acl_rules.push_back(r);
+                rules.push_back({action, 0});
+            }
+        } else {
+            std::ifstream in(rule_spec);
+            if (!in)
+                rte_exit(EXIT_FAILURE, "ACL: cannot open rule file %s\n", rule_spec.c_str());
+            std::string line;
+            uint64_t line_no = 0;
+            while (std::getline(in, line)) {
+                line_no++;
+                line = line.substr(0, line.find('#'));
+                if (line.find_first_not_of(" \t\r") == std::string::npos)
+                    continue;
+                _acl_rule r;
+                memset(&r, 0, sizeof(r));
+                Action action;
+                if (!parse_rule(line, &r, &action))
+                    rte_exit(EXIT_FAILURE, "ACL: %s:%lu, should be <src>/<len> <dst>/<len> <sport lo>:<hi> <dport lo>:<hi> "
+                                           "<proto|tcp|udp|any> <accept|drop|count>\n", rule_spec.c_str(), line_no);
+                acl_rules.push_back(r);
+                rules.push_back({action, line_no});
+            }
+        }
+        if (acl_rules.empty() || acl_rules.size() >= RTE_ACL_MAX_PRIORITY)
+            rte_exit(EXIT_FAILURE, "ACL: %lu rules in %s, should be 1 to %u\n", acl_rules.size(), rule_spec.c_str(), RTE_ACL_MAX_PRIORITY - 1);
+
+        //First rule wins: highest priority first, userdata is the rule index + 1 (0 means no match)
+        for (size_t i = 0; i < acl_rules.size(); i++) {
+            acl_rules[i].data.category_mask = 1;
+            acl_rules[i].data.priority = RTE_ACL_MAX_PRIORITY - i;
+            acl_rules[i].data.userdata = i + 1;
+        }
+
+        struct rte_acl_param param;
+        param.name = "ACL_APP";
+        param.socket_id = rte_eth_dev_socket_id(port_id);
+        param.rule_size = RTE_ACL_RULE_SZ(NUM_FIELDS);
+        param.max_rule_num = acl_rules.size();
+        ctx = rte_acl_create(&param);
+        if (ctx == nullptr)
+            rte_exit(EXIT_FAILURE, "ACL: cannot create the context, Errno: %s\n", rte_strerror(rte_errno));
+        if (rte_acl_add_rules(ctx, (const rte_acl_rule*)acl_rules.data(), acl_rules.size()) != 0)
+            rte_exit(EXIT_FAILURE, "ACL: cannot add %lu rules\n", acl_rules.size());
+
+        struct rte_acl_config config;
+        memset(&config, 0, sizeof(config));
+        field_defs(&config);
+        uint64_t start = rte_get_tsc_cycles();
+        int ret = rte_acl_build(ctx, &config);
+        if (ret != 0)
+            rte_exit(EXIT_FAILURE, "ACL: cannot build the trie for %lu rules: %s\n", acl_rules.size(), strerror(-ret));
+        select_classify_alg();
+
+        printf("ACL: %lu rules (%s), built in %.1f ms, classifier %s, default %s\n",
+            acl_rules.size(), num_random ? "random" : rule_spec.c_str(),
+            (rte_get_tsc_cycles() - start) * 1000.0 / rte_get_tsc_hz(), alg_name.c_str(), action_str(default_action));
+    }
+
+    AclApp(): rule_hits(rules.size(), 0) {
+        instances.push_back(this);
+    }
+    ~AclApp() {}
+
+    void run(char* pkt_ptr, size_t len) override {
+        const uint8_t* data = (const uint8_t*)pkt_ptr + sizeof(rte_ether_hdr);
+        uint32_t result;
+        rte_acl_classify(ctx, &data, &result, 1, 1);
+        apply(result);
+    }
+
+    uint64_t run_burst(rte_mbuf** pkts, uint64_t nb_pkts) override
+    {
+        const uint8_t* data[MAX_BURST];
+        uint32_t results[MAX_BURST];
+        assert(nb_pkts <= MAX_BURST);
+
+        for (uint64_t i = 0; i < nb_pkts; i++)
+            data[i] = rte_pktmbuf_mtod_offset(pkts[i], const uint8_t*, sizeof(rte_ether_hdr));
+
+        uint64_t start = rte_get_tsc_cycles();
+        rte_acl_classify(ctx, data, results, nb_pkts, 1);
+        classify_cycles += rte_get_tsc_cycles() - start;
+
+        uint64_t nb_left = 0;
+        for (uint64_t i = 0; i < nb_pkts; i++) {
+            if (apply(results[i]) == DROP)
+                rte_pktmbuf_free(pkts[i]);
+            else
+                pkts[nb_left++] = pkts[i];
+        }
+        return nb_left;
+    }
+
+    std::string print_stats() override {
+        uint64_t pkts = 0, cycles = 0, defaults = 0;
+        uint64_t totals[_ActionCount] = {0};
+        std::vector<uint64_t> hits(rules.size(), 0);
+        for (AclApp* app : instances) {
+            pkts += app->num_pkts;
+            cycles += app->classify_cycles;
+            defaults += app->num_default;
+            for (int a = 0; a < _ActionCount; a++)
+                totals[a] += app->verdicts[a];
+            for (size_t r = 0; r < rules.size(); r++)
+                hits[r] += app->rule_hits[r];
+        }
+
+        std::ostringstream out;
+        out << "============ ACL APP STATS ============\n"
+            << "Rules: " << rules.size() << " -- Classifier: " << alg_name
+            << " -- Default: " << action_str(default_action) << " -- Lcores: " << instances.size() << "\n"
+            << "Packets: " << pkts
+            << " -- Accepted: " << totals[ACCEPT]
+            << " -- Dropped: " << totals[DROP]
+            << " -- Counted: " << totals[COUNT]
+            << " -- No Match: " << defaults << "\n"
+            << "Classify Cycles/Packet: " << (pkts ? cycles / pkts : 0) << "\n";
+
+        size_t printed = 0;
+        for (size_t r = 0; r < rules.size() && printed < MAX_COUNTERS_PRINTED; r++) {
+            if (rules[r].action != COUNT || hits[r] == 0)
+                continue;
+            out << "  count rule " << r;
+            if (rules[r].line_no)
+                out << " (line " << rules[r].line_no << ")";
+            out << ": " << hits[r] << "\n";
+            printed++;
+        }
+        return out.str();
+    }
+
+private:
+
+    inline Action apply(uint32_t result) {
+        num_pkts++;
+        if (result == 0) {
+            num_default++;
+            verdicts[default_action]++;
+            return default_action;
+        }
+        uint32_t rule = result - 1;
+        rule_hits[rule]++;
+        verdicts[rules[rule].action]++;
+        return rules[rule].action;
+    }
+};
+
+
+} // namespace dpdk_apps
+#endif /* ACL_APP_H */
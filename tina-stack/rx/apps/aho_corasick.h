@@ -0,0 +1,110 @@
+#ifndef AHO_CORASICK_H
+#define AHO_CORASICK_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <queue>
+
+#include "numa_mem.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Aho-Corasick automaton compiled to a dense DFA: one 256-entry row per trie state, failure
+ * transitions already folded in, so the scan is one table load per byte. The outputs of each state
+ * include those of its failure chain, flattened into one id array.
+ * The rows come from numa_vector and follow the app memory policy like the other app state.
+ */
+class AhoCorasick {
+
+private:
+    numa_vector<uint32_t> delta;            // state * 256 + byte
+    std::vector<uint32_t> out_begin;        // state -> [out_begin[s], out_begin[s + 1]) in out_ids
+    std::vector<uint32_t> out_ids;
+    uint32_t num_states = 0;
+
+public:
+
+    void build(const std::vector<std::string>& patterns)
+    {
+        //*** Trie, 0 is the root, missing edges are UINT32_MAX until the BFS fills them */
+        std::vector<uint32_t> trie(256, UINT32_MAX);
+        std::vector<std::vector<uint32_t>> outputs(1);
+        for (uint32_t id = 0; id < patterns.size(); id++) {
+            uint32_t s = 0;
+            for (unsigned char c : patterns[id]) {
+                if (trie[s * 256 + c] == UINT32_MAX) {
+                    trie[s * 256 + c] = outputs.size();
+                    trie.resize(trie.size() + 256, UINT32_MAX);
+                    outputs.emplace_back();
+                }
+                s = trie[s * 256 + c];
+            }
+            outputs[s].push_back(id);
+        }
+        num_states = outputs.size();
+
+        //*** BFS: a missing edge goes where the failure state goes, outputs inherit the failure state's */
+        std::vector<uint32_t> fail(num_states, 0);
+        std::queue<uint32_t> bfs;
+        for (int c = 0; c < 256; c++) {
+            uint32_t& next = trie[c];
+            if (next == UINT32_MAX) {
+                next = 0;
+            } else {
+                fail[next] = 0;
+                bfs.push(next);
+            }
+        }
+        while (!bfs.empty()) {
+            uint32_t s = bfs.front();
+            bfs.pop();
+            const std::vector<uint32_t>& inherited = outputs[fail[s]];
+            outputs[s].insert(outputs[s].end(), inherited.begin(), inherited.end());
+            for (int c = 0; c < 256; c++) {
+                uint32_t& next = trie[s * 256 + c];
+                if (next == UINT32_MAX) {
+                    next = trie[fail[s] * 256 + c];
+                } else {
+                    fail[next] = trie[fail[s] * 256 + c];
+                    bfs.push(next);
+                }
+            }
+        }
+
+        delta.assign(trie.begin(), trie.end());
+        out_begin.assign(1, 0);
+        out_ids.clear();
+        for (uint32_t s = 0; s < num_states; s++) {
+            out_ids.insert(out_ids.end(), outputs[s].begin(), outputs[s].end());
+            out_begin.push_back(out_ids.size());
+        }
+    }
+
+    uint32_t states() const { return num_states; }
+    size_t memory() const { return delta.size() * sizeof(uint32_t) + out_ids.size() * sizeof(uint32_t); }
+    const void* table() const { return delta.data(); }
+
+    // Call on_match(pattern id) for every match in data[from, len), return the number of matches
+    template <class F>
+    inline uint32_t scan(const uint8_t* data, uint32_t from, uint32_t len, F on_match) const
+    {
+        const uint32_t* d = delta.data();
+        uint32_t s = 0;
+        uint32_t num_matches = 0;
+        for (uint32_t i = from; i < len; i++) {
+            s = d[s * 256 + data[i]];
+            uint32_t begin = out_begin[s], end = out_begin[s + 1];
+            for (uint32_t o = begin; o < end; o++)
+                on_match(out_ids[o]);
+            num_matches += end - begin;
+        }
+        return num_matches;
+    }
+};
+
+} // namespace dpdk_apps
+
+#endif /* AHO_CORASICK_H */
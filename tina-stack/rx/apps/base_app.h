@@ -1,6 +1,7 @@
 #ifndef BASE_APP_H
 #define BASE_APP_H
 #include <string>
+#include <rte_mbuf.h>
 
 
 namespace dpdk_apps {
@@ -19,15 +20,36 @@ protected:
 
 public:
 
+    // Largest burst the RX loops hand over to run_burst(), BURST_SIZE * 4 in main.h
+    static constexpr uint64_t MAX_BURST = 128;
+
     BaseApp() {}
     ~BaseApp() {}
     virtual void run(char* pkt_ptr, size_t len) = 0;
+
+    // Called once per RX burst, override it when the app can amortize work across the burst.
+    // Returns how many mbufs are left in pkts[0, ret) for the caller to free, an app that transmits
+    // packets keeps the ones it did not send at the front and returns their count.
+    virtual uint64_t run_burst(rte_mbuf** pkts, uint64_t nb_pkts) {
+        for (uint64_t i = 0; i < nb_pkts; i++)
+            run(rte_pktmbuf_mtod(pkts[i], char*), pkts[i]->pkt_len);
+        return nb_pkts;
+    }
+
     virtual std::string print_stats() {
         return "Nothing To Be Printed";
     };
 
+    // Printed by the monitor every interval, empty string to print nothing
+    virtual std::string print_interval_stats() {
+        return "";
+    };
+
+    // Main lcore, once every worker lcore has returned and before the stats: reap what is still in flight
+    virtual void stop() {}
+
 };
 } // namespace dpdk_apps
 
 
-#endif /* BASE_APP_H */
\ No newline at end of file
+#endif /* BASE_APP_H */
@@ -21,72 +21,217 @@
 #include <unistd.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <time.h>
 #include <pthread.h>
 #include <math.h>
 #include <stdint.h>
 #include <assert.h>
 #include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <memory>
+#include <random>
+
+#include <rte_eal.h>
+#include <rte_cycles.h>
+#include <rte_prefetch.h>
 
 #include "base_app.h"
+#include "bm25_index.h"
+#include "bm25_kernels.h"
+#include "page_migrator.h"
 
 namespace dpdk_apps{
-    
+
+/**
+ * Every tuple in the packet is one query, its words are the query terms.
+ * tuple.freq is the number of valid words (<= 0 means all WORD_LEN words).
+ * The top-k doc ids are written back into the tuple in place, tuple.freq becomes the result count.
+ *
+ * All queries of an RX burst are handled as one batch: dictionary lookups (and posting prefetches)
+ * for the whole batch first, then scoring with the SIMD kernel picked at startup.
+ *
+ * One instance per lcore: the first loads the index, the others share it (and the document norms)
+ * read-only and only own their batch scratch and counters.
+ */
 class BM25App: public BaseApp {
 
 private:
-    
-    static constexpr int DATA_RANGE = 1024 * 4;
 
-    struct _matchinfo {
-        int term_count;
-        float total_docs;
-        float avg_length;
-        float doc_length;
-        float term_frequency;
-        float docs_with_term;
-    } __attribute__((packed));
+    static constexpr float K1 = 1.2;
+    static constexpr float B = 0.75;
+    static constexpr int TOP_K = 10;
+    static_assert(TOP_K <= WORD_LEN, "Results are written back into the query tuple");
+
+    static constexpr size_t BURST_QUERIES_HINT = 32 * 64;      // Full burst of 1500B packets, grows if needed
+
+    static constexpr int SELF_BENCH_QUERIES = 256;
+    static constexpr int SELF_BENCH_WORDS = 4;
+    static constexpr int SELF_BENCH_ROUNDS = 3;
+
+    struct _hit {
+        float score;
+        uint32_t doc_id;
+    };
+
+    struct _query {
+        _tuple* tuple;
+        int num_terms;
+        const bm25_term_entry* terms[WORD_LEN];
+    };
 
+    static std::vector<BM25App*> instances;
 
+    //*** Shared read-only by every lcore's instance */
+    std::shared_ptr<BM25Index> index;
+    std::string index_name;
 
-    std::vector<_matchinfo> states;
-    size_t total_match;
+    SimdLevel simd_level;
+    bm25_kernel_fn score_kernel;
+
+    //*** K1 * (1 - B + B * |d| / avgdl) per document, next to the index */
+    std::shared_ptr<float> doc_norm_mem;
+    float* doc_norm = nullptr;
+
+    //*** Posting heat for the page migrator, nullptr when it is off */
+    HeatRegion* index_heat = nullptr;
+
+    //*** Per batch scratch of this lcore, sized once so the RX path doesn't allocate */
+    numa_vector<float> accumulators;        // One per document, all zero between queries
+    std::vector<_query> batch;
+    _hit top_hits[TOP_K];
+
+    uint64_t num_queries = 0;
+    uint64_t num_batches = 0;
+    uint64_t num_terms_found = 0;
+    uint64_t num_terms_missing = 0;
+    uint64_t num_postings_scored = 0;
+    uint64_t num_results = 0;
+
+    double scalar_ns_per_query = 0;
+    double simd_ns_per_query = 0;
+    uint64_t self_bench_mismatches = 0;
 
 public:
-    BM25App(size_t footprint_size = 1024 * 16): 
-        states(footprint_size),
-        total_match(footprint_size)
+    /**
+     * index_spec:  path of an on-disk index, or a number to build a synthetic index of that many postings
+     * numa_node:   node the index is bound to, NUMA_NODE_ANY to leave it to the page cache
+     */
+    BM25App(const std::string& index_spec = "16384", int numa_node = NUMA_NODE_ANY):
+        index(new BM25Index())
     {
-        assert(states.size() == total_match);
-        printf("size of each state: %lu\n", sizeof(_matchinfo));
-        int tmp = rand() % DATA_RANGE;
-        for (auto& state : states) {
-            state.term_count = tmp;
-            state.total_docs = 0.0 + tmp;
-            state.avg_length = 0.0 + tmp;
-            state.doc_length = 0.0 + tmp;
-            state.term_frequency = 0.0 + tmp;
-            state.docs_with_term = 0.0 + tmp;
+        char* endptr = nullptr;
+        uint64_t footprint = strtoull(index_spec.c_str(), &endptr, 10);
+        bool ok;
+
+        if (!index_spec.empty() && *endptr == '\0') {
+            //*** Synthetic index lives in an anonymous memfd, loaded through the very same mmap path */
+            int fd = memfd_create("bm25_index", 0);
+            if (fd < 0)
+                rte_exit(EXIT_FAILURE, "BM25: memfd_create failed: %s\n", strerror(errno));
+            ok = BM25Index::build_synthetic(fd, footprint) && index->load(fd, "synthetic", numa_node);
+            close(fd);
+            index_name = "synthetic(" + index_spec + ")";
+        } else {
+            ok = index->load(index_spec, numa_node);
+            index_name = index_spec;
         }
+        if (!ok)
+            rte_exit(EXIT_FAILURE, "BM25: cannot load index %s\n", index_spec.c_str());
+
+        const bm25_index_header& h = index->get_header();
+        size_t doc_norm_size = h.num_docs * sizeof(float);
+        doc_norm = (float*)alloc_on_node(doc_norm_size, numa_node);
+        if (doc_norm == nullptr)
+            rte_exit(EXIT_FAILURE, "BM25: cannot allocate document norms\n");
+        doc_norm_mem.reset(doc_norm, [doc_norm_size](float* p) { free_on_node(p, doc_norm_size); });
+        float inv_avg_length = 1.0f / h.avg_doc_length;
+        for (uint32_t d = 0; d < h.num_docs; d++)
+            doc_norm[d] = K1 * (1 - B + B * index->doc_length(d) * inv_avg_length);
+
+        accumulators.assign(h.num_docs, 0.0f);
+        batch.reserve(BURST_QUERIES_HINT);
+        index_heat = page_migrator.register_region("BM25 index", index->mapped_base(), index->mapped_size());
+
+        printf("BM25 index %s: %u terms, %u docs, %lu postings, avg doc length %.2f, %lu MB mapped, NUMA node %d\n",
+            index_name.c_str(), h.num_terms, h.num_docs, h.num_postings, h.avg_doc_length,
+            index->mapped_size() >> 20, numa_node);
+
+        simd_level = detect_simd_level();
+        self_bench();
+        score_kernel = bm25_select_kernel(simd_level);
+        printf("BM25 kernel: %s, %.1f ns/query (scalar %.1f ns/query, %.2fx), %lu result mismatches\n",
+            simd_level_str(simd_level), simd_ns_per_query, scalar_ns_per_query,
+            simd_ns_per_query > 0 ? scalar_ns_per_query / simd_ns_per_query : 0.0, self_bench_mismatches);
+        instances.push_back(this);
+    }
+
+    // Another lcore's instance over the index first loaded, with scratch of its own
+    explicit BM25App(const BM25App& first):
+        index(first.index), index_name(first.index_name),
+        simd_level(first.simd_level), score_kernel(first.score_kernel),
+        doc_norm_mem(first.doc_norm_mem), doc_norm(first.doc_norm), index_heat(first.index_heat),
+        scalar_ns_per_query(first.scalar_ns_per_query), simd_ns_per_query(first.simd_ns_per_query),
+        self_bench_mismatches(first.self_bench_mismatches)
+    {
+        accumulators.assign(index->get_header().num_docs, 0.0f);
+        batch.reserve(BURST_QUERIES_HINT);
+        instances.push_back(this);
     }
 
+    ~BM25App() {}
+
 
-    void run(char* pkt_ptr, size_t len) override 
+    void run(char* pkt_ptr, size_t len) override
     {
-        size_t num_tuples_in_pkt = len/tuple_size;
-        for (int i = 0; i < num_tuples_in_pkt; i++) {
+        batch.clear();
+        add_queries(pkt_ptr, len);
+        run_batch();
+    }
 
-            uint8_t pkt_dummy_data = pkt_ptr[i * tuple_size];
+    uint64_t run_burst(rte_mbuf** pkts, uint64_t nb_pkts) override
+    {
+        batch.clear();
+        for (uint64_t i = 0; i < nb_pkts; i++)
+            add_queries(rte_pktmbuf_mtod(pkts[i], char*), pkts[i]->pkt_len);
+        run_batch();
+        return nb_pkts;
+    }
 
-            int fake_record = (rand() + pkt_dummy_data) % total_match;
-            okapi_bm25(fake_record, 1.2, 0.75);
+    std::string print_stats() override {
+        uint64_t num_queries = 0, num_batches = 0, num_terms_found = 0, num_terms_missing = 0;
+        uint64_t num_postings_scored = 0, num_results = 0;
+        for (BM25App* app : instances) {
+            num_queries += app->num_queries;
+            num_batches += app->num_batches;
+            num_terms_found += app->num_terms_found;
+            num_terms_missing += app->num_terms_missing;
+            num_postings_scored += app->num_postings_scored;
+            num_results += app->num_results;
         }
+
+        std::ostringstream out;
+        out << "============ BM25 APP STATS ============\n"
+            << "Index: " << index_name << " -- Lcores: " << instances.size() << "\n"
+            << "Kernel: " << simd_level_str(simd_level)
+            << " -- Self Bench: " << simd_ns_per_query << " ns/query"
+            << " (Scalar " << scalar_ns_per_query << " ns/query)\n"
+            << "Queries: " << num_queries
+            << " -- Per Batch: " << (num_batches ? num_queries / num_batches : 0)
+            << " -- Terms Found: " << num_terms_found
+            << " -- Terms Missing: " << num_terms_missing << "\n"
+            << "Postings Scored: " << num_postings_scored
+            << " -- Per Query: " << (num_queries ? num_postings_scored / num_queries : 0)
+            << " -- Results Returned: " << num_results << "\n";
+        return out.str();
     }
 
 
 private:
 
-    float bm25_mFast_Log2(float val) 
+    float bm25_mFast_Log2(float val)
     {
         union { float val; int32_t x; } u = { val };
         float log_2 = (float)(((u.x >> 23) & 255) - 128);
@@ -98,21 +243,152 @@ private:
         return (log_2);
     }
 
+    // idf * (K1 + 1), strictly positive: a zero accumulator means "not touched yet"
+    float idf_k1(const bm25_term_entry* term)
+    {
+        const bm25_index_header& h = index->get_header();
+        float df = (float)term->doc_freq;
+        float idf = std::max(1e-6f, bm25_mFast_Log2((h.num_docs - df + 0.5f) / (df + 0.5f) + 1.0f));
+        return idf * (K1 + 1);
+    }
+
+    // Phase 1: dictionary lookups, and start pulling in the head of every posting list
+    void add_queries(char* pkt_ptr, size_t len)
+    {
+        size_t num_tuples_in_pkt = len/tuple_size;
+        for (int i = 0; i < num_tuples_in_pkt; i++) {
+            _query q;
+            q.tuple = (_tuple*)(pkt_ptr + i * tuple_size);
+            q.num_terms = 0;
+            int num_words = (q.tuple->freq <= 0 || q.tuple->freq > WORD_LEN) ? WORD_LEN : q.tuple->freq;
+
+            uint32_t words[WORD_LEN];
+            memcpy(words, q.tuple->word, sizeof(words));
+            for (int w = 0; w < num_words; w++) {
+                const bm25_term_entry* term = index->find_term(words[w]);
+                if (term == nullptr) {
+                    num_terms_missing++;
+                    continue;
+                }
+                num_terms_found++;
+                rte_prefetch0(index->doc_ids_of(term));
+                rte_prefetch0(index->term_freqs_of(term));
+                if (index_heat) {
+                    index_heat->touch_range(index->doc_ids_of(term), term->doc_freq * sizeof(uint32_t));
+                    index_heat->touch_range(index->term_freqs_of(term), term->doc_freq * sizeof(uint32_t));
+                }
+                q.terms[q.num_terms++] = term;
+            }
+            batch.push_back(q);
+        }
+    }
+
+    // Phase 2: score, rank and write back every query of the batch
+    void run_batch()
+    {
+        for (_query& q : batch) {
+            int num_hits = search(q.terms, q.num_terms, score_kernel);
+            num_postings_scored += postings_of_query(q.terms, q.num_terms);
+
+            uint32_t words[WORD_LEN];
+            for (int k = 0; k < num_hits; k++)
+                words[k] = top_hits[k].doc_id;
+            memcpy(q.tuple->word, words, num_hits * sizeof(uint32_t));
+            q.tuple->freq = num_hits;
+            num_results += num_hits;
+        }
+        num_queries += batch.size();
+        num_batches++;
+    }
 
+    static uint64_t postings_of_query(const bm25_term_entry* const* terms, int num_terms)
+    {
+        uint64_t n = 0;
+        for (int t = 0; t < num_terms; t++)
+            n += terms[t]->doc_freq;
+        return n;
+    }
 
-    void okapi_bm25(int record, float K1, float B)
+    // Score the query and leave the best TOP_K in top_hits (best first), return how many
+    int search(const bm25_term_entry* const* terms, int num_terms, bm25_kernel_fn kernel)
     {
-        static float sum;
+        for (int t = 0; t < num_terms; t++)
+            kernel(index->doc_ids_of(terms[t]), index->term_freqs_of(terms[t]), terms[t]->doc_freq,
+                   idf_k1(terms[t]), doc_norm, accumulators.data());
 
-        for (int i = 0; i < states[record].term_count; i++) {
+        //*** Walk the same posting lists again: first visit of a doc takes its score and resets it */
+        auto better = [](const _hit& a, const _hit& b) {
+            return a.score > b.score || (a.score == b.score && a.doc_id < b.doc_id);
+        };
+        int num_hits = 0;
+        for (int t = 0; t < num_terms; t++) {
+            const uint32_t* doc_ids = index->doc_ids_of(terms[t]);
+            for (uint32_t i = 0; i < terms[t]->doc_freq; i++) {
+                uint32_t doc = doc_ids[i];
+                if (accumulators[doc] == 0.0f)
+                    continue;
+                _hit hit = {accumulators[doc], doc};
+                accumulators[doc] = 0.0f;
+                if (num_hits < TOP_K) {
+                    top_hits[num_hits++] = hit;
+                    std::push_heap(top_hits, top_hits + num_hits, better);
+                } else if (better(hit, top_hits[0])) {
+                    std::pop_heap(top_hits, top_hits + num_hits, better);
+                    top_hits[num_hits - 1] = hit;
+                    std::push_heap(top_hits, top_hits + num_hits, better);
+                }
+            }
+        }
+
+        std::sort_heap(top_hits, top_hits + num_hits, better);
+        return num_hits;
+    }
 
-            float idf = bm25_mFast_Log2(states[record].total_docs - states[record].docs_with_term + 0.5) / (states[record].docs_with_term + 0.5);
-            float right_side = ((states[record].term_frequency * (K1 + 1)) /
-                                (states[record].term_frequency + (K1 * (1 - B + 
-                                (B * (states[record].doc_length / 
-                                    states[record].avg_length))))));
-            sum += (idf * right_side);
+    /**
+     * Time the scalar and the selected kernel on the same random queries against the loaded index,
+     * so the speedup is reported for the configured footprint, and check they rank identically.
+     */
+    void self_bench()
+    {
+        const bm25_index_header& h = index->get_header();
+        std::mt19937 rng(0xb325);
+        std::vector<_query> queries(SELF_BENCH_QUERIES);
+        for (_query& q : queries) {
+            q.tuple = nullptr;
+            q.num_terms = 0;
+            for (int w = 0; w < SELF_BENCH_WORDS; w++) {
+                const bm25_term_entry* term = index->find_term(rng() % h.term_space);
+                if (term != nullptr)
+                    q.terms[q.num_terms++] = term;
+            }
         }
+
+        std::vector<_hit> scalar_hits(SELF_BENCH_QUERIES * TOP_K);
+        std::vector<int> scalar_counts(SELF_BENCH_QUERIES);
+        auto time_kernel = [&](bm25_kernel_fn kernel, bool reference) {
+            uint64_t best = UINT64_MAX;
+            for (int r = 0; r < SELF_BENCH_ROUNDS; r++) {
+                uint64_t start = rte_get_tsc_cycles();
+                for (int i = 0; i < SELF_BENCH_QUERIES; i++) {
+                    int n = search(queries[i].terms, queries[i].num_terms, kernel);
+                    if (r > 0)
+                        continue;
+                    if (reference) {
+                        scalar_counts[i] = n;
+                        std::copy(top_hits, top_hits + n, scalar_hits.begin() + i * TOP_K);
+                    } else if (n != scalar_counts[i] ||
+                               !std::equal(top_hits, top_hits + n, scalar_hits.begin() + i * TOP_K,
+                                   [](const _hit& a, const _hit& b) { return a.doc_id == b.doc_id && a.score == b.score; })) {
+                        self_bench_mismatches++;
+                    }
+                }
+                best = std::min(best, rte_get_tsc_cycles() - start);
+            }
+            return (double)best * 1e9 / rte_get_tsc_hz() / SELF_BENCH_QUERIES;
+        };
+
+        scalar_ns_per_query = time_kernel(bm25_score_scalar, true);
+        simd_ns_per_query = time_kernel(bm25_select_kernel(simd_level), false);
     }
 }; // class BM25App
 
@@ -122,4 +398,4 @@ private:
 
 #pragma GCC diagnostic pop
 
-#endif /* BM25_APP_H */
\ No newline at end of file
+#endif /* BM25_APP_H */
@@ -0,0 +1,337 @@
+#ifndef BM25_INDEX_H
+#define BM25_INDEX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "numa_mem.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * On-disk BM25 inverted index, everything is little endian and 64B aligned:
+ *
+ *   [bm25_index_header]
+ *   [bm25_term_entry  x num_terms   ]  @terms_offset,        sorted by term_id
+ *   [uint32_t         x num_postings]  @doc_ids_offset,      per term, sorted by doc_id
+ *   [uint32_t         x num_postings]  @term_freqs_offset,   same order as doc_ids
+ *   [uint32_t         x num_docs    ]  @doc_lengths_offset,  document length in terms
+ *
+ * Postings are structure-of-arrays, so the scoring kernel loads 8/16 doc ids and term frequencies
+ * with one instruction each.
+ *
+ * Queries are 32-bit words, they are reduced modulo term_space before the dictionary lookup,
+ * so an index built from hashed terms can be queried with whatever the TX side puts in the payload.
+ */
+struct bm25_index_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_terms;
+    uint32_t num_docs;
+    uint32_t term_space;
+    uint64_t num_postings;
+    float avg_doc_length;
+    uint32_t reserved;
+    uint64_t terms_offset;
+    uint64_t doc_ids_offset;
+    uint64_t term_freqs_offset;
+    uint64_t doc_lengths_offset;
+    uint64_t file_size;
+};
+
+struct bm25_term_entry {
+    uint32_t term_id;
+    uint32_t doc_freq;          // Number of postings of this term
+    uint64_t postings_start;    // Index into doc_ids/term_freqs
+};
+
+class BM25Index {
+
+public:
+    static constexpr uint64_t MAGIC = 0x35324d42414e4954ULL;    // "TINABM25"
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint64_t SECTION_ALIGN = 64;
+
+private:
+    void* map_base = nullptr;
+    size_t map_size = 0;
+
+    const bm25_index_header* header = nullptr;
+    const bm25_term_entry* terms = nullptr;
+    const uint32_t* doc_ids = nullptr;
+    const uint32_t* term_freqs = nullptr;
+    const uint32_t* doc_lengths = nullptr;
+
+    static uint64_t align_up(uint64_t v) {
+        return (v + SECTION_ALIGN - 1) & ~(SECTION_ALIGN - 1);
+    }
+
+    static bm25_index_header layout(uint32_t num_terms, uint32_t num_docs, uint64_t num_postings) {
+        bm25_index_header h;
+        memset(&h, 0, sizeof(h));
+        h.magic = MAGIC;
+        h.version = VERSION;
+        h.num_terms = num_terms;
+        h.num_docs = num_docs;
+        h.num_postings = num_postings;
+        h.terms_offset = align_up(sizeof(bm25_index_header));
+        h.doc_ids_offset = align_up(h.terms_offset + num_terms * sizeof(bm25_term_entry));
+        h.term_freqs_offset = align_up(h.doc_ids_offset + num_postings * sizeof(uint32_t));
+        h.doc_lengths_offset = align_up(h.term_freqs_offset + num_postings * sizeof(uint32_t));
+        h.file_size = align_up(h.doc_lengths_offset + num_docs * sizeof(uint32_t));
+        return h;
+    }
+
+    bool validate(const std::string& name) {
+        if (map_size < sizeof(bm25_index_header)) {
+            fprintf(stderr, "BM25 index %s is too small\n", name.c_str());
+            return false;
+        }
+        header = (const bm25_index_header*)map_base;
+        if (header->magic != MAGIC || header->version != VERSION) {
+            fprintf(stderr, "BM25 index %s has a bad magic/version\n", name.c_str());
+            return false;
+        }
+        if (header->file_size > map_size ||
+            header->num_postings > header->file_size / sizeof(uint32_t) ||
+            header->terms_offset < sizeof(bm25_index_header) ||
+            header->terms_offset > header->file_size || header->doc_ids_offset > header->file_size ||
+            header->term_freqs_offset > header->file_size || header->doc_lengths_offset > header->file_size ||
+            header->terms_offset + header->num_terms * sizeof(bm25_term_entry) > header->doc_ids_offset ||
+            header->doc_ids_offset + header->num_postings * sizeof(uint32_t) > header->term_freqs_offset ||
+            header->term_freqs_offset + header->num_postings * sizeof(uint32_t) > header->doc_lengths_offset ||
+            header->doc_lengths_offset + header->num_docs * sizeof(uint32_t) > header->file_size ||
+            header->term_space == 0 || header->num_docs == 0) {
+            fprintf(stderr, "BM25 index %s has inconsistent sections\n", name.c_str());
+            return false;
+        }
+        //The scorer divides by it
+        if (!std::isfinite(header->avg_doc_length) || header->avg_doc_length <= 0) {
+            fprintf(stderr, "BM25 index %s has a bad average doc length %f\n", name.c_str(), header->avg_doc_length);
+            return false;
+        }
+
+        terms = (const bm25_term_entry*)((const char*)map_base + header->terms_offset);
+        doc_ids = (const uint32_t*)((const char*)map_base + header->doc_ids_offset);
+        term_freqs = (const uint32_t*)((const char*)map_base + header->term_freqs_offset);
+        doc_lengths = (const uint32_t*)((const char*)map_base + header->doc_lengths_offset);
+        return true;
+    }
+
+    // Every posting list inside the postings with strictly increasing doc ids (the SIMD kernels' lanes
+    // must never hit the same doc), every doc id a document, the dictionary strictly sorted for
+    // find_term. Reads the whole index once, so it runs after the placement.
+    bool validate_postings(const std::string& name) const {
+        for (uint32_t t = 0; t < header->num_terms; t++) {
+            if (terms[t].postings_start > header->num_postings ||
+                terms[t].doc_freq > header->num_postings - terms[t].postings_start) {
+                fprintf(stderr, "BM25 index %s: term %u has postings out of the index\n", name.c_str(), t);
+                return false;
+            }
+            if (t > 0 && terms[t].term_id <= terms[t - 1].term_id) {
+                fprintf(stderr, "BM25 index %s: term %u is out of order\n", name.c_str(), t);
+                return false;
+            }
+            const uint32_t* ids = doc_ids + terms[t].postings_start;
+            for (uint32_t i = 1; i < terms[t].doc_freq; i++) {
+                if (ids[i] <= ids[i - 1]) {
+                    fprintf(stderr, "BM25 index %s: term %u lists doc %u after doc %u, doc ids must be strictly increasing\n",
+                        name.c_str(), t, ids[i], ids[i - 1]);
+                    return false;
+                }
+            }
+        }
+        for (uint64_t i = 0; i < header->num_postings; i++) {
+            if (doc_ids[i] >= header->num_docs) {
+                fprintf(stderr, "BM25 index %s: posting %lu points to doc %u, the index has %u\n",
+                    name.c_str(), i, doc_ids[i], header->num_docs);
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    BM25Index() {}
+    BM25Index(const BM25Index&) = delete;
+    BM25Index& operator=(const BM25Index&) = delete;
+
+    ~BM25Index() {
+        if (map_base)
+            munmap(map_base, map_size);
+    }
+
+    /**
+     * Map an index read-only. Nothing is copied, the page cache backs the index.
+     * numa_node != NUMA_NODE_ANY binds (and prefaults) the whole mapping on that node,
+     * otherwise the app placement policy applies (file pages can't be hugetlb, the page size is ignored).
+     * Return false (with the reason on stderr) if the index can't be used.
+     */
+    bool load(int fd, const std::string& name, int numa_node) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            fprintf(stderr, "Cannot stat BM25 index %s: %s\n", name.c_str(), strerror(errno));
+            return false;
+        }
+
+        map_size = st.st_size;
+        map_base = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map_base == MAP_FAILED) {
+            map_base = nullptr;
+            fprintf(stderr, "Cannot mmap BM25 index %s: %s\n", name.c_str(), strerror(errno));
+            return false;
+        }
+        if (!validate(name))
+            return false;
+
+        bool placed = true;
+        if (numa_node != NUMA_NODE_ANY)
+            placed = bind_range_to_node(map_base, map_size, numa_node, true);
+        else if (app_mem_placement.policy != MEM_DEFAULT)
+            placed = place_range(map_base, map_size, app_mem_placement, true);
+        else
+            madvise(map_base, map_size, MADV_WILLNEED);     //Async readahead, don't block the startup
+        return placed && validate_postings(name);
+    }
+
+    bool load(const std::string& path, int numa_node) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Cannot open BM25 index %s: %s\n", path.c_str(), strerror(errno));
+            return false;
+        }
+        bool ok = load(fd, path, numa_node);
+        close(fd);     //The mapping keeps the file alive
+        return ok;
+    }
+
+    /**
+     * Write a synthetic index with ~num_postings postings into fd.
+     * Document frequencies follow Zipf(1) over the term ranks, so a few terms have very long
+     * posting lists and most are short, like a real corpus.
+     */
+    static bool build_synthetic(int fd, uint64_t num_postings, uint32_t seed = 0x5eed) {
+        const uint32_t num_terms = 64 * 1024;
+        const uint32_t num_docs = (uint32_t)std::max<uint64_t>(1024, std::min<uint64_t>(num_postings / 32, UINT32_MAX / 2));
+
+        //*** Document frequency per term rank */
+        double harmonic = 0;
+        for (uint32_t r = 0; r < num_terms; r++)
+            harmonic += 1.0 / (r + 1);
+        std::vector<uint32_t> doc_freq(num_terms);
+        uint64_t total = 0;
+        for (uint32_t r = 0; r < num_terms; r++) {
+            doc_freq[r] = (uint32_t)std::min<double>(num_docs, std::max(1.0, num_postings / harmonic / (r + 1)));
+            total += doc_freq[r];
+        }
+
+        bm25_index_header h = layout(num_terms, num_docs, total);
+        h.term_space = num_terms;
+        if (ftruncate(fd, h.file_size) != 0) {
+            fprintf(stderr, "Cannot size synthetic BM25 index: %s\n", strerror(errno));
+            return false;
+        }
+
+        char* base = (char*)mmap(NULL, h.file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            fprintf(stderr, "Cannot map synthetic BM25 index: %s\n", strerror(errno));
+            return false;
+        }
+
+        bm25_term_entry* t = (bm25_term_entry*)(base + h.terms_offset);
+        uint32_t* ids = (uint32_t*)(base + h.doc_ids_offset);
+        uint32_t* tfs = (uint32_t*)(base + h.term_freqs_offset);
+        uint32_t* dl = (uint32_t*)(base + h.doc_lengths_offset);
+
+        //*** Term ids are a random permutation of the ranks, so hot terms are spread over the dictionary */
+        std::mt19937 rng(seed);
+        std::vector<uint32_t> term_of_rank(num_terms);
+        for (uint32_t i = 0; i < num_terms; i++)
+            term_of_rank[i] = i;
+        std::shuffle(term_of_rank.begin(), term_of_rank.end(), rng);
+        std::vector<uint32_t> rank_of_term(num_terms);
+        for (uint32_t r = 0; r < num_terms; r++)
+            rank_of_term[term_of_rank[r]] = r;
+
+        uint64_t pos = 0;
+        uint64_t total_length = 0;
+        std::geometric_distribution<uint32_t> tf_dist(0.5);
+        for (uint32_t term = 0; term < num_terms; term++) {
+            uint32_t df = doc_freq[rank_of_term[term]];
+            t[term].term_id = term;
+            t[term].doc_freq = df;
+            t[term].postings_start = pos;
+
+            //Evenly strided with a random start, sorted and unique by construction
+            double stride = (double)num_docs / df;
+            double start = std::uniform_real_distribution<double>(0, stride)(rng);
+            for (uint32_t i = 0; i < df; i++) {
+                uint32_t tf = 1 + tf_dist(rng);
+                ids[pos] = std::min<uint32_t>(num_docs - 1, (uint32_t)(start + i * stride));
+                tfs[pos] = tf;
+                dl[ids[pos]] += tf;
+                total_length += tf;
+                pos++;
+            }
+        }
+        for (uint32_t d = 0; d < num_docs; d++) {
+            if (dl[d] == 0) {
+                dl[d] = 1;
+                total_length++;
+            }
+        }
+
+        h.avg_doc_length = (float)total_length / num_docs;
+        memcpy(base, &h, sizeof(h));
+        munmap(base, h.file_size);
+        return true;
+    }
+
+    const bm25_index_header& get_header() const { return *header; }
+    size_t mapped_size() const { return map_size; }
+    const void* mapped_base() const { return map_base; }
+
+    // Binary search in the dictionary, nullptr if the term is not indexed
+    const bm25_term_entry* find_term(uint32_t word) const {
+        uint32_t term_id = word % header->term_space;
+        uint32_t lo = 0, hi = header->num_terms;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (terms[mid].term_id < term_id)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return (lo < header->num_terms && terms[lo].term_id == term_id) ? &terms[lo] : nullptr;
+    }
+
+    const uint32_t* doc_ids_of(const bm25_term_entry* term) const {
+        return doc_ids + term->postings_start;
+    }
+
+    const uint32_t* term_freqs_of(const bm25_term_entry* term) const {
+        return term_freqs + term->postings_start;
+    }
+
+    uint32_t doc_length(uint32_t doc_id) const {
+        return doc_lengths[doc_id];
+    }
+};
+
+} // namespace dpdk_apps
+
+#endif /* BM25_INDEX_H */
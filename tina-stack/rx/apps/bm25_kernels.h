@@ -0,0 +1,94 @@
+#ifndef BM25_KERNELS_H
+#define BM25_KERNELS_H
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "simd_dispatch.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Term-at-a-time BM25 scoring over one SoA posting list:
+ *
+ *   acc[doc_ids[i]] += idf_k1 * tf[i] / (tf[i] + doc_norm[doc_ids[i]])
+ *
+ * idf_k1 is idf * (K1 + 1) and doc_norm[d] is K1 * (1 - B + B * |d| / avgdl), both precomputed.
+ * Doc ids are unique within a posting list, so the gather/scatter lanes never conflict.
+ * All versions evaluate the same expression in the same order (mul, add, div, add), no FMA
+ * contraction is possible, so they produce bit-identical accumulators.
+ */
+typedef void (*bm25_kernel_fn)(const uint32_t* doc_ids, const uint32_t* term_freqs, uint32_t n,
+                               float idf_k1, const float* doc_norm, float* acc);
+
+inline void bm25_score_scalar(const uint32_t* doc_ids, const uint32_t* term_freqs, uint32_t n,
+                              float idf_k1, const float* doc_norm, float* acc)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t doc = doc_ids[i];
+        float tf = (float)term_freqs[i];
+        acc[doc] += (idf_k1 * tf) / (tf + doc_norm[doc]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+inline void bm25_score_avx2(const uint32_t* doc_ids, const uint32_t* term_freqs, uint32_t n,
+                            float idf_k1, const float* doc_norm, float* acc)
+{
+    const __m256 v_idf_k1 = _mm256_set1_ps(idf_k1);
+    alignas(32) uint32_t docs[8];
+    alignas(32) float sums[8];
+
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v_doc = _mm256_loadu_si256((const __m256i*)(doc_ids + i));
+        __m256 v_tf = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(term_freqs + i)));
+        __m256 v_norm = _mm256_i32gather_ps(doc_norm, v_doc, 4);
+        __m256 v_acc = _mm256_i32gather_ps(acc, v_doc, 4);
+
+        __m256 v_score = _mm256_div_ps(_mm256_mul_ps(v_idf_k1, v_tf), _mm256_add_ps(v_tf, v_norm));
+        v_acc = _mm256_add_ps(v_acc, v_score);
+
+        //No scatter before AVX-512
+        _mm256_store_si256((__m256i*)docs, v_doc);
+        _mm256_store_ps(sums, v_acc);
+        for (int l = 0; l < 8; l++)
+            acc[docs[l]] = sums[l];
+    }
+    bm25_score_scalar(doc_ids + i, term_freqs + i, n - i, idf_k1, doc_norm, acc);
+}
+
+__attribute__((target("avx512f")))
+inline void bm25_score_avx512(const uint32_t* doc_ids, const uint32_t* term_freqs, uint32_t n,
+                              float idf_k1, const float* doc_norm, float* acc)
+{
+    const __m512 v_idf_k1 = _mm512_set1_ps(idf_k1);
+
+    uint32_t i = 0;
+    for (; i < n; i += 16) {
+        //Masked tail instead of a scalar epilogue, masked-off lanes are neither loaded nor stored
+        __mmask16 m = (n - i >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        __m512i v_doc = _mm512_maskz_loadu_epi32(m, doc_ids + i);
+        __m512 v_tf = _mm512_cvtepi32_ps(_mm512_maskz_loadu_epi32(m, term_freqs + i));
+        __m512 v_norm = _mm512_mask_i32gather_ps(_mm512_set1_ps(1.0f), m, v_doc, doc_norm, 4);
+        __m512 v_acc = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), m, v_doc, acc, 4);
+
+        __m512 v_score = _mm512_div_ps(_mm512_mul_ps(v_idf_k1, v_tf), _mm512_add_ps(v_tf, v_norm));
+        v_acc = _mm512_add_ps(v_acc, v_score);
+        _mm512_mask_i32scatter_ps(acc, m, v_doc, v_acc, 4);
+    }
+}
+
+inline bm25_kernel_fn bm25_select_kernel(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_AVX512:   return bm25_score_avx512;
+        case SIMD_AVX2:     return bm25_score_avx2;
+        default:            return bm25_score_scalar;
+    }
+}
+
+} // namespace dpdk_apps
+
+#endif /* BM25_KERNELS_H */
@@ -0,0 +1,226 @@
+#ifndef CHAIN_APP_H
+#define CHAIN_APP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <rte_eal.h>
+#include <rte_cycles.h>
+
+#include "base_app.h"
+#include "llc_miss_counter.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Service function chain: several apps run one after the other on every burst, on the same lcore.
+ * Each stage gets the mbufs the previous one left in pkts[0, ret), so a stage that transmits
+ * (L3FWD) ends the chain for the packets it sent; the chain returns what the last stage left.
+ * L3FWD and Crypto on a cryptodev hand the mbufs to the device, so they can only be the last stage.
+ * Every stage is bracketed with the TSC and the LLC miss counter of the lcore, which tells how much
+ * of the chain's cache footprint each stage pays for, including the misses it takes on state the
+ * stages before it evicted.
+ *
+ * Spec: <APP>(<arg1>,<arg2>) -> <APP>(<arg1>) -> <APP>, the args are those of the app on its own.
+ * The stage instances are built by the caller, one per lcore, like the single-app case.
+ */
+class ChainApp: public BaseApp {
+
+public:
+    struct StageSpec {
+        std::string name;
+        std::string arg1;
+        std::string arg2;
+    };
+
+private:
+    struct _stage_stats {
+        uint64_t bursts = 0;
+        uint64_t pkts = 0;
+        uint64_t cycles = 0;
+        uint64_t llc_misses = 0;
+    };
+
+    static std::vector<std::string> stage_names;
+    static std::vector<ChainApp*> instances;
+    static std::vector<_stage_stats> interval_snapshot;     // Monitor only
+
+    std::vector<std::shared_ptr<BaseApp>> stages;
+    std::vector<_stage_stats> stats;
+    LlcMissCounter llc;
+    bool counter_opened = false;
+
+    static std::string trim(const std::string& s) {
+        size_t b = s.find_first_not_of(" \t");
+        size_t e = s.find_last_not_of(" \t");
+        return b == std::string::npos ? "" : s.substr(b, e - b + 1);
+    }
+
+    static std::vector<_stage_stats> totals() {
+        std::vector<_stage_stats> t(stage_names.size());
+        for (ChainApp* app : instances) {
+            for (size_t k = 0; k < t.size(); k++) {
+                t[k].bursts += app->stats[k].bursts;
+                t[k].pkts += app->stats[k].pkts;
+                t[k].cycles += app->stats[k].cycles;
+                t[k].llc_misses += app->stats[k].llc_misses;
+            }
+        }
+        return t;
+    }
+
+    static bool counters_enabled() {
+        for (ChainApp* app : instances)
+            if (app->llc.enabled())
+                return true;
+        return false;
+    }
+
+public:
+
+    // Split the spec into stages, rte_exit on a malformed one
+    static std::vector<StageSpec> parse(const std::string& spec)
+    {
+        std::vector<StageSpec> specs;
+        size_t pos = 0;
+        while (pos <= spec.size()) {
+            size_t arrow = spec.find("->", pos);
+            std::string stage = trim(spec.substr(pos, arrow == std::string::npos ? std::string::npos : arrow - pos));
+            pos = (arrow == std::string::npos) ? spec.size() + 1 : arrow + 2;
+
+            StageSpec s;
+            size_t open = stage.find('(');
+            if (open == std::string::npos) {
+                s.name = stage;
+            } else {
+                if (stage.back() != ')')
+                    rte_exit(EXIT_FAILURE, "Chain: missing ')' in stage \"%s\"\n", stage.c_str());
+                s.name = trim(stage.substr(0, open));
+                std::string args = stage.substr(open + 1, stage.size() - open - 2);
+                size_t comma = args.find(',');
+                s.arg1 = trim(args.substr(0, comma));
+                if (comma != std::string::npos)
+                    s.arg2 = trim(args.substr(comma + 1));
+            }
+            if (s.name.empty())
+                rte_exit(EXIT_FAILURE, "Chain: empty stage in \"%s\"\n", spec.c_str());
+            specs.push_back(s);
+        }
+        return specs;
+    }
+
+    static void init(const std::vector<std::string>& names)
+    {
+        stage_names = names;
+        interval_snapshot.assign(names.size(), _stage_stats());
+    }
+
+    ChainApp(const std::vector<std::shared_ptr<BaseApp>>& stage_apps): stages(stage_apps), stats(stage_apps.size()) {
+        assert(stages.size() == stage_names.size());
+        instances.push_back(this);
+    }
+    ~ChainApp() {}
+
+    void run(char* pkt_ptr, size_t len) override {
+        for (std::shared_ptr<BaseApp>& stage : stages)
+            stage->run(pkt_ptr, len);
+    }
+
+    void stop() override {
+        for (std::shared_ptr<BaseApp>& stage : stages)
+            stage->stop();
+    }
+
+    uint64_t run_burst(rte_mbuf** pkts, uint64_t nb_pkts) override
+    {
+        //The counter follows the thread that opens it, so the lcore opens its own
+        if (!counter_opened) {
+            counter_opened = true;
+            if (!llc.open())
+                printf("Chain: lcore %u has no user-space LLC miss counter, misses not reported\n", rte_lcore_id());
+        }
+
+        uint64_t misses = llc.read();
+        uint64_t tsc = rte_get_tsc_cycles();
+        for (size_t k = 0; k < stages.size() && nb_pkts > 0; k++) {
+            uint64_t left = stages[k]->run_burst(pkts, nb_pkts);
+            uint64_t now_misses = llc.read();
+            uint64_t now_tsc = rte_get_tsc_cycles();
+
+            _stage_stats& s = stats[k];
+            s.bursts++;
+            s.pkts += nb_pkts;
+            s.cycles += now_tsc - tsc;
+            s.llc_misses += now_misses - misses;
+
+            nb_pkts = left;
+            misses = now_misses;
+            tsc = now_tsc;
+        }
+        return nb_pkts;
+    }
+
+    std::string print_interval_stats() override {
+        std::vector<_stage_stats> t = totals();
+        bool misses = counters_enabled();
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << "Chain cycles/pkt" << (misses ? " (LLC misses/pkt)" : "") << ":";
+        for (size_t k = 0; k < t.size(); k++) {
+            uint64_t pkts = t[k].pkts - interval_snapshot[k].pkts;
+            uint64_t cycles = t[k].cycles - interval_snapshot[k].cycles;
+            uint64_t llc_misses = t[k].llc_misses - interval_snapshot[k].llc_misses;
+            out << (k ? " -> " : " ") << stage_names[k] << " " << (pkts ? (double)cycles / pkts : 0.0);
+            if (misses)
+                out << " (" << std::setprecision(2) << (pkts ? (double)llc_misses / pkts : 0.0) << std::setprecision(1) << ")";
+        }
+        interval_snapshot = t;
+
+        for (std::shared_ptr<BaseApp>& stage : stages) {
+            std::string s = stage->print_interval_stats();
+            if (!s.empty())
+                out << "\n" << s;
+        }
+        return out.str();
+    }
+
+    std::string print_stats() override {
+        std::vector<_stage_stats> t = totals();
+        bool misses = counters_enabled();
+        uint64_t total_cycles = 0;
+        for (const _stage_stats& s : t)
+            total_cycles += s.cycles;
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << "============ CHAIN APP STATS ============\n"
+            << "Stages: " << stage_names.size() << " -- Lcores: " << instances.size()
+            << " -- LLC Miss Counter: " << (misses ? "rdpmc" : "unavailable") << "\n";
+        for (size_t k = 0; k < t.size(); k++) {
+            out << "  [" << k << "] " << std::left << std::setw(12) << stage_names[k] << std::right
+                << " Pkts: " << t[k].pkts
+                << " -- Cycles/Pkt: " << (t[k].pkts ? (double)t[k].cycles / t[k].pkts : 0.0)
+                << " -- Cycle Share: " << (total_cycles ? t[k].cycles * 100.0 / total_cycles : 0.0) << "%";
+            if (misses)
+                out << " -- LLC Misses/Pkt: " << (t[k].pkts ? (double)t[k].llc_misses / t[k].pkts : 0.0);
+            out << "\n";
+        }
+
+        //Every stage app already sums its own lcores
+        for (std::shared_ptr<BaseApp>& stage : stages)
+            out << stage->print_stats() << "\n";
+        return out.str();
+    }
+};
+
+
+} // namespace dpdk_apps
+#endif /* CHAIN_APP_H */
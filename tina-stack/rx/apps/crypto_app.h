@@ -30,28 +30,51 @@
 #include <vector>
 
 #include <openssl/engine.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
 #include <openssl/sha.h>
 #include <openssl/aes.h>
 #include <openssl/pem.h>
 #include <openssl/rsa.h>
 
+#include <rte_eal.h>
+#include <rte_cryptodev.h>
+#include <rte_bus_vdev.h>
+
 #include "base_app.h"
+#include "../../tx/dpdk_exp_pkt.h"
 #include <string>
+#include <sstream>
 #include <unordered_map>
 
-#define USE_ISAL 0
+#include "sha256_multibuf.h"
+#include "simd_dispatch.h"
+#include <rte_cycles.h>
 
+// 1 to run SHA256_MB on the ISA-L crypto multi-buffer manager instead of sha256_multibuf.h
+#ifndef USE_ISAL
+#define USE_ISAL 0
+#endif
 
 #if USE_ISAL == 1
-#include "isa-l_crypto.h"
-#include "aes_thread.c"
+#include <isa-l_crypto.h>
 #endif
 
 
 namespace dpdk_apps{
 
 
-
+/**
+ * One instance per RX lcore, all per-packet state (cipher/digest contexts, RSA key, output buffer)
+ * is created once in the constructor, so the RX path only resets the IV and runs the cipher.
+ * Ciphers run in place over the payload that follows dpdk_exp_pkt, the headers the latency
+ * sampling relies on are never touched. AEAD tags go into the last AEAD_TAG_LEN bytes.
+ *
+ * With engine id "cryptodev:<device>" (e.g. cryptodev:crypto_aesni_mb, or a hardware device name)
+ * the same operations are offloaded to a DPDK cryptodev instead: every lcore owns one queue pair,
+ * a burst is enqueued as a whole and completions are reaped on the following bursts, so the RX
+ * loop never waits for the device. Each in-flight op holds a reference on its mbuf.
+ */
 class CryptoApp: public BaseApp {
 
 private:
@@ -63,32 +86,100 @@ private:
         RSA_ENC = 3,
         AES_DEC = 4,
         RSA_DEC = 5,
+        AES_GCM = 6,
+        CHACHA20_POLY1305 = 7,
+        SHA256_MB = 8,
 
         _ALGOCOUNTS
     };
 
+    static constexpr size_t PAYLOAD_OFFSET = sizeof(dpdk_exp_pkt);
+    static constexpr int AEAD_TAG_LEN = 16;
+    static constexpr int AEAD_IV_LEN = 12;
+    static constexpr int RSA_OAEP_OVERHEAD = 42;
+
+    static constexpr uint16_t MB_MAX_JOBS = 128;
+    static constexpr uint16_t CDEV_MAX_BURST = 128;
+    static constexpr uint32_t CDEV_QP_DESCRIPTORS = 2048;
+    static constexpr uint32_t CDEV_OP_CACHE = 256;
+    //Per-op private area, right after the sym op: IV, then room for a SHA-256 digest / empty AAD
+    static constexpr uint16_t CDEV_IV_OFFSET = sizeof(rte_crypto_op) + sizeof(rte_crypto_sym_op);
+    static constexpr uint16_t CDEV_DIGEST_OFFSET = CDEV_IV_OFFSET + AES_BLOCK_SIZE;
+    static constexpr uint16_t CDEV_OP_PRIV_SIZE = AES_BLOCK_SIZE + SHA256_DIGEST_LENGTH;
+
+    struct _cdev_state {
+        int dev_id;                         // < 0 when running on OpenSSL
+        std::string name;
+        rte_mempool* op_pool;
+        rte_mempool* sess_pool;
+        rte_mempool* sess_priv_pool;
+        rte_cryptodev_sym_session* sess;
+    };
+
     static ENGINE *engine;
     static std::vector<RSA*> rsa;
     static ALGO algo;
+    static unsigned char key[32];                   // Shared by all lcores, drawn once at init
+    static std::vector<CryptoApp*> instances;       // So lcore 0 can report the totals
+    static _cdev_state cdev;
 
     uint64_t core_id;
+
+    EVP_CIPHER_CTX* cipher_ctx = nullptr;
+    EVP_MD_CTX* md_ctx = nullptr;
+    std::vector<unsigned char> rsa_out;
+
+    SimdLevel simd_level = SIMD_SCALAR;
+    sha256_mb_job mb_jobs[MB_MAX_JOBS];
+#if USE_ISAL == 1
+    SHA256_HASH_CTX_MGR* isal_mgr = nullptr;
+    SHA256_HASH_CTX isal_ctx[MB_MAX_JOBS];
+#endif
+
+    uint64_t iv_counter = 0;
+    uint64_t digest_fold = 0;       // Keeps the digests alive
+
+    uint64_t num_pkts = 0;
+    uint64_t num_bytes = 0;
+    uint64_t num_skipped = 0;       // Payload too short for the algorithm
+    uint64_t num_failed = 0;
+    uint64_t hash_cycles = 0;       // TSC cycles spent in SHA-256, for the per-core throughput
+
+    uint64_t cdev_enqueued = 0;
+    uint64_t cdev_dequeued = 0;
+    uint64_t cdev_enqueue_full = 0;     // Queue pair full, packet not processed
+    uint64_t cdev_op_alloc_failed = 0;      // Burst not processed, the RX loop frees its mbufs
+    uint64_t interval_enqueue_full = 0;     // Monitor only, on instances[0]
+    uint64_t interval_alloc_failed = 0;
+
 public:
 
+    static constexpr const char* CDEV_PREFIX = "cryptodev:";
+
+    // The device still owns the mbufs when run_burst returns, nothing may read them after this app
+    static bool is_cryptodev(const std::string& engine_id) {
+        return engine_id.compare(0, strlen(CDEV_PREFIX), CDEV_PREFIX) == 0;
+    }
+
     static void init_engine(std::string engine_id, std::string algorithm, size_t num_lcores){
-        if (engine_id != "rdrand" && engine_id != "pka") {
+        const std::string cdev_prefix = CDEV_PREFIX;
+        bool use_cdev = is_cryptodev(engine_id);
+        if (!use_cdev && engine_id != "rdrand" && engine_id != "pka") {
             assert((std::string("Unknown engine id: %s\n") + engine_id).c_str() && false);
         }
 
-        /* Load the engine */
-        ENGINE_load_builtin_engines();
-        engine = ENGINE_by_id(engine_id.c_str());
-        if (engine == NULL) {
-            assert(false &&  "Error loading engine for CryptoApp");
-        }
+        if (!use_cdev) {
+            /* Load the engine */
+            ENGINE_load_builtin_engines();
+            engine = ENGINE_by_id(engine_id.c_str());
+            if (engine == NULL) {
+                assert(false &&  "Error loading engine for CryptoApp");
+            }
 
-        /* Set the engine as the default for all available algorithms */
-        if (!ENGINE_set_default(engine, ENGINE_METHOD_ALL)) {
-            assert(false && "Error setting default engine");
+            /* Set the engine as the default for all available algorithms */
+            if (!ENGINE_set_default(engine, ENGINE_METHOD_ALL)) {
+                assert(false && "Error setting default engine");
+            }
         }
 
         const std::unordered_map<std::string, ALGO> algo_map = {
@@ -96,7 +187,10 @@ public:
             {"AES", CryptoApp::AES},
             {"RSA_ENC", CryptoApp::RSA_ENC},
             {"AES_DEC", CryptoApp::AES_DEC},
-            {"RSA_DEC", CryptoApp::RSA_DEC}
+            {"RSA_DEC", CryptoApp::RSA_DEC},
+            {"AES_GCM", CryptoApp::AES_GCM},
+            {"CHACHA20_POLY1305", CryptoApp::CHACHA20_POLY1305},
+            {"SHA256_MB", CryptoApp::SHA256_MB}
         };
 
 
@@ -106,6 +200,15 @@ public:
         }
         algo = it->second;
 
+        if (RAND_bytes(key, sizeof(key)) != 1) {
+            assert(false && "Error drawing the CryptoApp key");
+        }
+
+        if (use_cdev) {
+            init_cryptodev(engine_id.substr(cdev_prefix.size()), num_lcores);
+            return;
+        }
+
         if (algo == RSA_ENC || algo == RSA_DEC) {
             /* Generate 16 RSA key pairs */
             for (int64_t i = 0; i < num_lcores; i++) {
@@ -115,7 +218,8 @@ public:
     }
 
     static void free_engine(int64_t algorithm){
-        ENGINE_free(engine);
+        if (engine)
+            ENGINE_free(engine);
 
         if (algorithm == RSA_ENC || algorithm == RSA_DEC) {
             /* Free the RSA structure */
@@ -126,78 +230,506 @@ public:
     }
 
     CryptoApp(uint64_t core_id): core_id(core_id) {
-        assert(engine && "Did not init the engine for CryptoApp");
+        assert((engine || cdev.dev_id >= 0) && "Did not init the engine for CryptoApp");
+        instances.push_back(this);
+        if (cdev.dev_id >= 0)
+            return;
+
+        switch (algo) {
+            case SHA256:
+                md_ctx = EVP_MD_CTX_new();
+                if (!md_ctx || EVP_DigestInit_ex(md_ctx, EVP_sha256(), NULL) != 1)
+                    rte_exit(EXIT_FAILURE, "Crypto: cannot set up the SHA256 context of lcore %lu\n", core_id);
+                break;
+
+            //*** Key schedule is expanded here once, per packet we only pass a new IV */
+            case AES:
+                cipher_ctx = EVP_CIPHER_CTX_new();
+                if (!cipher_ctx || EVP_EncryptInit_ex(cipher_ctx, EVP_aes_128_cbc(), NULL, key, NULL) != 1)
+                    rte_exit(EXIT_FAILURE, "Crypto: cannot set up the AES context of lcore %lu\n", core_id);
+                EVP_CIPHER_CTX_set_padding(cipher_ctx, 0);
+                break;
+
+            case AES_DEC:
+                cipher_ctx = EVP_CIPHER_CTX_new();
+                if (!cipher_ctx || EVP_DecryptInit_ex(cipher_ctx, EVP_aes_128_cbc(), NULL, key, NULL) != 1)
+                    rte_exit(EXIT_FAILURE, "Crypto: cannot set up the AES_DEC context of lcore %lu\n", core_id);
+                EVP_CIPHER_CTX_set_padding(cipher_ctx, 0);
+                break;
+
+            case AES_GCM:
+            case CHACHA20_POLY1305:
+                cipher_ctx = EVP_CIPHER_CTX_new();
+                if (!cipher_ctx
+                    || EVP_EncryptInit_ex(cipher_ctx, algo == AES_GCM ? EVP_aes_128_gcm() : EVP_chacha20_poly1305(), NULL, NULL, NULL) != 1
+                    || EVP_CIPHER_CTX_ctrl(cipher_ctx, EVP_CTRL_AEAD_SET_IVLEN, AEAD_IV_LEN, NULL) != 1
+                    || EVP_EncryptInit_ex(cipher_ctx, NULL, NULL, key, NULL) != 1)
+                    rte_exit(EXIT_FAILURE, "Crypto: cannot set up the %s context of lcore %lu\n", algo_name(algo), core_id);
+                break;
+
+            case RSA_ENC:
+            case RSA_DEC:
+                assert(core_id < rsa.size());
+                rsa_out.resize(RSA_size(rsa[core_id]));
+                break;
+
+            case SHA256_MB:
+                simd_level = detect_simd_level();
+#if USE_ISAL == 1
+                if (posix_memalign((void**)&isal_mgr, 16, sizeof(SHA256_HASH_CTX_MGR)) != 0)
+                    rte_exit(EXIT_FAILURE, "Crypto: cannot allocate the ISA-L SHA256 manager of lcore %lu\n", core_id);
+                sha256_ctx_mgr_init(isal_mgr);
+#endif
+                break;
+        }
     }
 
     ~CryptoApp() {
+#if USE_ISAL == 1
+        free(isal_mgr);
+#endif
+        EVP_CIPHER_CTX_free(cipher_ctx);
+        EVP_MD_CTX_free(md_ctx);
         if (core_id == 0) {
             free_engine(algo);
         }
     }
 
+    uint64_t run_burst(rte_mbuf** pkts, uint64_t nb_pkts) override {
+        uint64_t nb_burst = nb_pkts;
+        if (cdev.dev_id < 0) {
+            uint64_t start = rte_get_tsc_cycles();
+            if (algo == SHA256_MB) {
+                for (uint64_t i = 0; i < nb_pkts; i += MB_MAX_JOBS)
+                    sha256_mb_burst(pkts + i, std::min<uint64_t>(nb_pkts - i, MB_MAX_JOBS));
+            } else {
+                BaseApp::run_burst(pkts, nb_pkts);
+            }
+            if (algo == SHA256 || algo == SHA256_MB)
+                hash_cycles += rte_get_tsc_cycles() - start;
+            return nb_burst;
+        }
+
+        while (nb_pkts > 0) {
+            uint16_t n = std::min<uint64_t>(nb_pkts, CDEV_MAX_BURST);
+            cdev_enqueue(pkts, n);
+            pkts += n;
+            nb_pkts -= n;
+        }
+        cdev_dequeue();
+        return nb_burst;
+    }
+
     void run(char* pkt_ptr, size_t len) override {
 
+        if (len <= PAYLOAD_OFFSET) {
+            num_skipped++;
+            return;
+        }
+        unsigned char* payload = reinterpret_cast<unsigned char*>(pkt_ptr) + PAYLOAD_OFFSET;
+        int payload_len = len - PAYLOAD_OFFSET;
+        bool ok = true;
+        int out_len;
+
         switch(algo){
 
             case SHA256:
             {
-                /* Perform SHA256 operation using the loaded engine */
                 unsigned char digest[SHA256_DIGEST_LENGTH];
-
-                SHA256_CTX ctx;
-                SHA256_Init(&ctx);
-                SHA256_Update(&ctx, pkt_ptr, len);
-                SHA256_Final(digest, &ctx);
+                //Reuses the sha256 method bound in the constructor, no fetch or allocation
+                ok = EVP_DigestInit_ex(md_ctx, NULL, NULL) == 1 &&
+                     EVP_DigestUpdate(md_ctx, pkt_ptr, len) == 1 &&
+                     EVP_DigestFinal_ex(md_ctx, digest, NULL) == 1;
+                digest_fold ^= *(uint64_t*)digest;
+                payload_len = len;
                 break;
             }
 
             case AES:
+            case AES_DEC:
             {
-                /* Perform AES encryption and decryption using the loaded engine */
-                unsigned char key[AES_BLOCK_SIZE];
-                unsigned char iv[AES_BLOCK_SIZE];
-                unsigned char encrypted[len];
-                AES_KEY encrypt_key;
-
-                /* Initialize key and IV (in a real application, use a secure random number generator) */
-                memset(key, 0, sizeof(key));
-                memset(iv, 0, sizeof(iv));
-
-                /* Encrypt the text */
-                AES_set_encrypt_key(key, 128, &encrypt_key);
-                AES_cbc_encrypt(reinterpret_cast<const unsigned char*>(pkt_ptr), encrypted, len, &encrypt_key, iv, AES_ENCRYPT);
+                /* CBC without padding, a trailing partial block is left in clear */
+                unsigned char iv[AES_BLOCK_SIZE] = {0};
+                next_iv(iv);
+                payload_len &= ~(AES_BLOCK_SIZE - 1);
+                if (payload_len == 0) {
+                    num_skipped++;
+                    return;
+                }
+                if (algo == AES)
+                    ok = EVP_EncryptInit_ex(cipher_ctx, NULL, NULL, NULL, iv) == 1 &&
+                         EVP_EncryptUpdate(cipher_ctx, payload, &out_len, payload, payload_len) == 1;
+                else
+                    ok = EVP_DecryptInit_ex(cipher_ctx, NULL, NULL, NULL, iv) == 1 &&
+                         EVP_DecryptUpdate(cipher_ctx, payload, &out_len, payload, payload_len) == 1;
                 break;
             }
 
-            case RSA_ENC:
+            case AES_GCM:
+            case CHACHA20_POLY1305:
             {
-                /* Perform RSA encryption and decryption using the loaded engine */
-                unsigned char encrypted[len];
+                unsigned char iv[AEAD_IV_LEN] = {0};
+                next_iv(iv);
+                payload_len -= AEAD_TAG_LEN;
+                if (payload_len <= 0) {
+                    num_skipped++;
+                    return;
+                }
+                ok = EVP_EncryptInit_ex(cipher_ctx, NULL, NULL, NULL, iv) == 1 &&
+                     EVP_EncryptUpdate(cipher_ctx, payload, &out_len, payload, payload_len) == 1 &&
+                     EVP_EncryptFinal_ex(cipher_ctx, payload + out_len, &out_len) == 1 &&
+                     EVP_CIPHER_CTX_ctrl(cipher_ctx, EVP_CTRL_AEAD_GET_TAG, AEAD_TAG_LEN, payload + payload_len) == 1;
+                break;
+            }
 
-                /* Encrypt the text */
-                int64_t encrypted_length = RSA_public_encrypt(len, reinterpret_cast<const unsigned char*>(pkt_ptr), encrypted, rsa[core_id], RSA_PKCS1_OAEP_PADDING);
+            case SHA256_MB:
+            {
+                mb_jobs[0].data = reinterpret_cast<const uint8_t*>(pkt_ptr);
+                mb_jobs[0].len = len;
+                //A lone job would leave every other lane idle, the narrowest kernel wastes the least
+                sha256_mb(mb_jobs, 1, SIMD_SCALAR);
+                digest_fold ^= *(uint64_t*)mb_jobs[0].digest;
+                payload_len = len;
                 break;
             }
-            
-            case AES_DEC:
+
+            case RSA_ENC:
             {
-                unsigned char key[AES_BLOCK_SIZE];
-                unsigned char iv[AES_BLOCK_SIZE];
-                unsigned char decrypted[len];
-                AES_KEY decrypt_key;
-                AES_set_decrypt_key(key, 128, &decrypt_key);
-                AES_cbc_encrypt(reinterpret_cast<const unsigned char*>(pkt_ptr), decrypted, len, &decrypt_key, iv, AES_DECRYPT);
+                /* OAEP caps the plaintext at modulus size - 42 bytes */
+                payload_len = std::min<int>(payload_len, rsa_out.size() - RSA_OAEP_OVERHEAD);
+                ok = RSA_public_encrypt(payload_len, payload, rsa_out.data(), rsa[core_id], RSA_PKCS1_OAEP_PADDING) > 0;
                 break;
             }
 
             case RSA_DEC:
             {
-                unsigned char decrypted[len];
-                int64_t decrypted_length = RSA_private_decrypt(len, reinterpret_cast<const unsigned char*>(pkt_ptr), decrypted, rsa[core_id], RSA_PKCS1_OAEP_PADDING);
+                payload_len = std::min<int>(payload_len, rsa_out.size());
+                ok = RSA_private_decrypt(payload_len, payload, rsa_out.data(), rsa[core_id], RSA_PKCS1_OAEP_PADDING) > 0;
                 break;
             }
         }
-    } 
+
+        num_pkts++;
+        num_bytes += payload_len;
+        num_failed += !ok;
+    }
+
+    // The last bursts' ops complete after the lcore stopped polling, their mbufs go back here
+    void stop() override {
+        if (cdev.dev_id < 0)
+            return;
+        uint64_t deadline = rte_get_tsc_cycles() + rte_get_tsc_hz() / 10;
+        while (cdev_dequeued < cdev_enqueued && rte_get_tsc_cycles() < deadline)
+            cdev_dequeue();
+        if (cdev_dequeued < cdev_enqueued)
+            printf("Crypto: lcore %lu left %lu ops on cryptodev %s\n", core_id, cdev_enqueued - cdev_dequeued, cdev.name.c_str());
+    }
+
+    std::string print_interval_stats() override {
+        if (cdev.dev_id < 0 || instances.empty() || instances[0] != this)
+            return "";
+        uint64_t in_flight = 0, enqueue_full = 0, alloc_failed = 0;
+        for (CryptoApp* app : instances) {
+            in_flight += app->cdev_enqueued - app->cdev_dequeued;
+            enqueue_full += app->cdev_enqueue_full;
+            alloc_failed += app->cdev_op_alloc_failed;
+        }
+        std::ostringstream out;
+        out << "Crypto cryptodev: in flight " << in_flight
+            << " -- QP full " << enqueue_full - interval_enqueue_full
+            << " -- op alloc failed " << alloc_failed - interval_alloc_failed;
+        interval_enqueue_full = enqueue_full;
+        interval_alloc_failed = alloc_failed;
+        return out.str();
+    }
+
+    std::string print_stats() override {
+        uint64_t pkts = 0, bytes = 0, skipped = 0, failed = 0;
+        uint64_t enqueued = 0, dequeued = 0, enqueue_full = 0, alloc_failed = 0;
+        for (CryptoApp* app : instances) {
+            pkts += app->num_pkts;
+            bytes += app->num_bytes;
+            skipped += app->num_skipped;
+            failed += app->num_failed;
+            enqueued += app->cdev_enqueued;
+            dequeued += app->cdev_dequeued;
+            enqueue_full += app->cdev_enqueue_full;
+            alloc_failed += app->cdev_op_alloc_failed;
+        }
+
+        std::ostringstream out;
+        out << "============ CRYPTO APP STATS ============\n"
+            << "Algorithm: " << algo_name(algo) << " -- Lcores: " << instances.size()
+            << " -- Backend: " << (cdev.dev_id >= 0 ? "cryptodev " + cdev.name : std::string("OpenSSL")) << "\n"
+            << "Packets: " << pkts
+            << " -- Bytes Processed: " << bytes
+            << " -- Skipped (short payload): " << skipped
+            << " -- Failed: " << failed << "\n";
+        if (algo == SHA256 || algo == SHA256_MB) {
+            //Per lcore, the hashing cost is what limits the core
+            for (CryptoApp* app : instances) {
+                double seconds = (double)app->hash_cycles / rte_get_tsc_hz();
+                out << "  lcore " << app->core_id << " SHA-256"
+                    << (algo == SHA256_MB ? (USE_ISAL ? " (ISA-L mb)" : std::string(" (mb x") + std::to_string(sha256_mb_lanes(app->simd_level)) + ")") : "")
+                    << ": " << (seconds > 0 ? app->num_bytes / seconds / 1e6 : 0.0) << " MB/s"
+                    << " -- " << (app->num_bytes ? (double)app->hash_cycles / app->num_bytes : 0.0) << " cycles/B\n";
+            }
+        }
+        if (cdev.dev_id >= 0)
+            out << "Ops Enqueued: " << enqueued
+                << " -- Dequeued: " << dequeued
+                << " -- In Flight: " << enqueued - dequeued
+                << " -- QP Full: " << enqueue_full
+                << " -- Op Alloc Failed: " << alloc_failed << "\n";
+        return out.str();
+    }
+
+private:
+
+    // Hash up to MB_MAX_JOBS packets side by side in the SIMD lanes
+    void sha256_mb_burst(rte_mbuf** pkts, uint16_t n)
+    {
+#if USE_ISAL == 1
+        for (uint16_t i = 0; i < n; i++) {
+            hash_ctx_init(&isal_ctx[i]);
+            SHA256_HASH_CTX* done = sha256_ctx_mgr_submit(isal_mgr, &isal_ctx[i],
+                rte_pktmbuf_mtod(pkts[i], void*), pkts[i]->data_len, HASH_ENTIRE);
+            if (done != NULL)
+                digest_fold ^= done->job.result_digest[0];
+            num_bytes += pkts[i]->data_len;
+        }
+        SHA256_HASH_CTX* done;
+        while ((done = sha256_ctx_mgr_flush(isal_mgr)) != NULL)
+            digest_fold ^= done->job.result_digest[0];
+#else
+        for (uint16_t i = 0; i < n; i++) {
+            mb_jobs[i].data = rte_pktmbuf_mtod(pkts[i], const uint8_t*);
+            mb_jobs[i].len = pkts[i]->data_len;
+            num_bytes += pkts[i]->data_len;
+        }
+        sha256_mb(mb_jobs, n, simd_level);
+        for (uint16_t i = 0; i < n; i++)
+            digest_fold ^= *(uint64_t*)mb_jobs[i].digest;
+#endif
+        num_pkts += n;
+    }
+
+    static void init_cryptodev(const std::string& dev_name, size_t num_lcores)
+    {
+        cdev.name = dev_name;
+
+        //*** Software PMDs are virtual devices, create it unless it came with --vdev */
+        int dev_id = rte_cryptodev_get_dev_id(dev_name.c_str());
+        if (dev_id < 0) {
+            if (rte_vdev_init(dev_name.c_str(), NULL) != 0)
+                rte_exit(EXIT_FAILURE, "Crypto: cannot find or create cryptodev %s\n", dev_name.c_str());
+            dev_id = rte_cryptodev_get_dev_id(dev_name.c_str());
+            if (dev_id < 0)
+                rte_exit(EXIT_FAILURE, "Crypto: cryptodev %s not found after creation\n", dev_name.c_str());
+        }
+
+        rte_crypto_sym_xform xform;
+        memset(&xform, 0, sizeof(xform));
+        rte_cryptodev_sym_capability_idx cap;
+        memset(&cap, 0, sizeof(cap));
+        switch (algo) {
+            case AES:
+            case AES_DEC:
+                xform.type = cap.type = RTE_CRYPTO_SYM_XFORM_CIPHER;
+                xform.cipher.algo = cap.algo.cipher = RTE_CRYPTO_CIPHER_AES_CBC;
+                xform.cipher.op = (algo == AES) ? RTE_CRYPTO_CIPHER_OP_ENCRYPT : RTE_CRYPTO_CIPHER_OP_DECRYPT;
+                xform.cipher.key = {key, 16};
+                xform.cipher.iv = {CDEV_IV_OFFSET, AES_BLOCK_SIZE};
+                break;
+
+            case AES_GCM:
+            case CHACHA20_POLY1305:
+                xform.type = cap.type = RTE_CRYPTO_SYM_XFORM_AEAD;
+                xform.aead.algo = cap.algo.aead = (algo == AES_GCM) ? RTE_CRYPTO_AEAD_AES_GCM : RTE_CRYPTO_AEAD_CHACHA20_POLY1305;
+                xform.aead.op = RTE_CRYPTO_AEAD_OP_ENCRYPT;
+                xform.aead.key = {key, (uint16_t)(algo == AES_GCM ? 16 : 32)};
+                xform.aead.iv = {CDEV_IV_OFFSET, AEAD_IV_LEN};
+                xform.aead.digest_length = AEAD_TAG_LEN;
+                xform.aead.aad_length = 0;
+                break;
+
+            case SHA256:
+            case SHA256_MB:     //The device batches on its own
+                xform.type = cap.type = RTE_CRYPTO_SYM_XFORM_AUTH;
+                xform.auth.algo = cap.algo.auth = RTE_CRYPTO_AUTH_SHA256;
+                xform.auth.op = RTE_CRYPTO_AUTH_OP_GENERATE;
+                xform.auth.digest_length = SHA256_DIGEST_LENGTH;
+                break;
+
+            default:
+                rte_exit(EXIT_FAILURE, "Crypto: %s is not supported on cryptodev\n", algo_name(algo));
+        }
+        if (rte_cryptodev_sym_capability_get(dev_id, &cap) == NULL)
+            rte_exit(EXIT_FAILURE, "Crypto: cryptodev %s does not support %s\n", dev_name.c_str(), algo_name(algo));
+
+        //*** One queue pair per RX lcore */
+        rte_cryptodev_info info;
+        rte_cryptodev_info_get(dev_id, &info);
+        if (num_lcores > info.max_nb_queue_pairs)
+            rte_exit(EXIT_FAILURE, "Crypto: cryptodev %s has %u queue pairs, need %lu\n",
+                dev_name.c_str(), info.max_nb_queue_pairs, num_lcores);
+
+        int socket_id = rte_cryptodev_socket_id(dev_id);
+        if (socket_id < 0)
+            socket_id = rte_socket_id();
+
+        rte_cryptodev_config conf;
+        memset(&conf, 0, sizeof(conf));
+        conf.socket_id = socket_id;
+        conf.nb_queue_pairs = num_lcores;
+        if (rte_cryptodev_configure(dev_id, &conf) < 0)
+            rte_exit(EXIT_FAILURE, "Crypto: cannot configure cryptodev %s\n", dev_name.c_str());
+
+        cdev.sess_pool = rte_cryptodev_sym_session_pool_create("cdev_sess_pool", 2, 0, 0, 0, socket_id);
+        cdev.sess_priv_pool = rte_mempool_create("cdev_sess_priv_pool", 2,
+            rte_cryptodev_sym_get_private_session_size(dev_id), 0, 0, NULL, NULL, NULL, NULL, socket_id, 0);
+        if (cdev.sess_pool == NULL || cdev.sess_priv_pool == NULL)
+            rte_exit(EXIT_FAILURE, "Crypto: cannot create the session pools\n");
+
+        rte_cryptodev_qp_conf qp_conf;
+        qp_conf.nb_descriptors = CDEV_QP_DESCRIPTORS;
+        qp_conf.mp_session = cdev.sess_pool;
+        qp_conf.mp_session_private = cdev.sess_priv_pool;
+        for (uint16_t qp = 0; qp < num_lcores; qp++) {
+            if (rte_cryptodev_queue_pair_setup(dev_id, qp, &qp_conf, socket_id) < 0)
+                rte_exit(EXIT_FAILURE, "Crypto: cannot set up queue pair %u of %s\n", qp, dev_name.c_str());
+        }
+        if (rte_cryptodev_start(dev_id) < 0)
+            rte_exit(EXIT_FAILURE, "Crypto: cannot start cryptodev %s\n", dev_name.c_str());
+
+        //Enough ops to fill every queue pair plus one burst per lcore in hand
+        cdev.op_pool = rte_crypto_op_pool_create("cdev_op_pool", RTE_CRYPTO_OP_TYPE_SYMMETRIC,
+            num_lcores * (CDEV_QP_DESCRIPTORS + CDEV_MAX_BURST + CDEV_OP_CACHE), CDEV_OP_CACHE, CDEV_OP_PRIV_SIZE, socket_id);
+        if (cdev.op_pool == NULL)
+            rte_exit(EXIT_FAILURE, "Crypto: cannot create the crypto op pool\n");
+
+        cdev.sess = rte_cryptodev_sym_session_create(cdev.sess_pool);
+        if (cdev.sess == NULL || rte_cryptodev_sym_session_init(dev_id, cdev.sess, &xform, cdev.sess_priv_pool) < 0)
+            rte_exit(EXIT_FAILURE, "Crypto: cannot create the %s session on %s\n", algo_name(algo), dev_name.c_str());
+
+        cdev.dev_id = dev_id;
+        printf("Crypto: offloading %s to cryptodev %s (id %d, driver %s), %lu queue pairs on socket %d\n",
+            algo_name(algo), dev_name.c_str(), dev_id, info.driver_name, num_lcores, socket_id);
+    }
+
+    // Fill the op for one packet, false if the payload is too short for the algorithm
+    bool cdev_prepare_op(rte_crypto_op* op, rte_mbuf* m)
+    {
+        int payload_len = (int)m->data_len - (int)PAYLOAD_OFFSET;
+        rte_crypto_sym_op* sym = op->sym;
+        next_iv(rte_crypto_op_ctod_offset(op, uint8_t*, CDEV_IV_OFFSET));
+
+        switch (algo) {
+            case AES:
+            case AES_DEC:
+                payload_len &= ~(AES_BLOCK_SIZE - 1);
+                if (payload_len <= 0)
+                    return false;
+                sym->cipher.data.offset = PAYLOAD_OFFSET;
+                sym->cipher.data.length = payload_len;
+                break;
+
+            case AES_GCM:
+            case CHACHA20_POLY1305:
+                payload_len -= AEAD_TAG_LEN;
+                if (payload_len <= 0)
+                    return false;
+                sym->aead.data.offset = PAYLOAD_OFFSET;
+                sym->aead.data.length = payload_len;
+                sym->aead.digest.data = rte_pktmbuf_mtod_offset(m, uint8_t*, PAYLOAD_OFFSET + payload_len);
+                sym->aead.digest.phys_addr = rte_pktmbuf_iova_offset(m, PAYLOAD_OFFSET + payload_len);
+                sym->aead.aad.data = rte_crypto_op_ctod_offset(op, uint8_t*, CDEV_DIGEST_OFFSET);
+                sym->aead.aad.phys_addr = rte_crypto_op_ctophys_offset(op, CDEV_DIGEST_OFFSET);
+                break;
+
+            case SHA256:
+            case SHA256_MB:
+                payload_len = m->data_len;
+                sym->auth.data.offset = 0;
+                sym->auth.data.length = payload_len;
+                sym->auth.digest.data = rte_crypto_op_ctod_offset(op, uint8_t*, CDEV_DIGEST_OFFSET);
+                sym->auth.digest.phys_addr = rte_crypto_op_ctophys_offset(op, CDEV_DIGEST_OFFSET);
+                break;
+        }
+
+        rte_crypto_op_attach_sym_session(op, cdev.sess);
+        sym->m_src = m;
+        num_bytes += payload_len;
+        return true;
+    }
+
+    void cdev_enqueue(rte_mbuf** pkts, uint16_t nb_pkts)
+    {
+        rte_crypto_op* ops[CDEV_MAX_BURST];
+        if (rte_crypto_op_bulk_alloc(cdev.op_pool, RTE_CRYPTO_OP_TYPE_SYMMETRIC, ops, nb_pkts) == 0) {
+            cdev_op_alloc_failed += nb_pkts;
+            return;
+        }
+
+        //*** Ops of skipped packets are moved to the tail and given back */
+        uint16_t n = 0;
+        for (uint16_t i = 0; i < nb_pkts; i++) {
+            if (!cdev_prepare_op(ops[n], pkts[i])) {
+                num_skipped++;
+                continue;
+            }
+            rte_mbuf_refcnt_update(pkts[i], 1);     //The RX loop frees its reference right after us
+            n++;
+        }
+
+        uint16_t sent = rte_cryptodev_enqueue_burst(cdev.dev_id, core_id, ops, n);
+        cdev_enqueued += sent;
+        cdev_enqueue_full += n - sent;
+        for (uint16_t i = sent; i < n; i++)
+            rte_pktmbuf_free(ops[i]->sym->m_src);
+        if (nb_pkts > sent)
+            rte_mempool_put_bulk(cdev.op_pool, (void**)(ops + sent), nb_pkts - sent);
+    }
+
+    // Reap whatever has completed, never waits
+    void cdev_dequeue()
+    {
+        rte_crypto_op* ops[CDEV_MAX_BURST];
+        uint16_t n;
+        do {
+            n = rte_cryptodev_dequeue_burst(cdev.dev_id, core_id, ops, CDEV_MAX_BURST);
+            for (uint16_t i = 0; i < n; i++) {
+                num_failed += ops[i]->status != RTE_CRYPTO_OP_STATUS_SUCCESS;
+                rte_pktmbuf_free(ops[i]->sym->m_src);
+            }
+            if (n > 0)
+                rte_mempool_put_bulk(cdev.op_pool, (void**)ops, n);
+            cdev_dequeued += n;
+            num_pkts += n;
+        } while (n == CDEV_MAX_BURST);
+    }
+
+    static const char* algo_name(ALGO a) {
+        switch (a) {
+            case SHA256:                return "SHA256";
+            case AES:                   return "AES-128-CBC";
+            case RSA_ENC:               return "RSA_ENC";
+            case AES_DEC:               return "AES-128-CBC (decrypt)";
+            case RSA_DEC:               return "RSA_DEC";
+            case AES_GCM:               return "AES-128-GCM";
+            case CHACHA20_POLY1305:     return "ChaCha20-Poly1305";
+            case SHA256_MB:             return "SHA256 multi-buffer";
+            default:                    return "None";
+        }
+    }
+
+    // Unique per lcore and packet: [core id | counter], iv has room for at least 12 bytes
+    void next_iv(unsigned char* iv) {
+        uint32_t id = core_id;
+        uint64_t ctr = iv_counter++;
+        memcpy(iv, &id, sizeof(id));
+        memcpy(iv + sizeof(id), &ctr, sizeof(ctr));
+    }
 
 }; // End of class CryptoApp
 } // End of namespace dpdk_apps
@@ -0,0 +1,222 @@
+#ifndef DPI_APP_H
+#define DPI_APP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <rte_eal.h>
+#include <rte_ip.h>
+#include <rte_udp.h>
+#include <rte_cycles.h>
+
+#include "base_app.h"
+#include "fast_rand.h"
+#include "workload_gen.h"
+#include "teddy_kernels.h"
+#include "aho_corasick.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Multi-pattern payload inspection. Every UDP payload byte of the burst goes through the Teddy
+ * prefilter first, then only the packets with a candidate are verified by Aho-Corasick, starting
+ * at the first candidate. The match ids are the pattern indexes (line order in the file).
+ *
+ * Patterns: a file with one pattern per line, \xHH and \\ escapes, lines starting with '#' skipped,
+ * or random:<n>[:<len>] for n random patterns of len bytes (default 8) from the workload seed.
+ */
+class DpiApp: public BaseApp {
+
+private:
+    static constexpr uint32_t PAYLOAD_OFFSET = sizeof(rte_ether_hdr) + sizeof(rte_ipv4_hdr) + sizeof(rte_udp_hdr);
+    static constexpr uint32_t DEFAULT_RANDOM_LEN = 8;
+    static constexpr size_t TOP_PATTERNS_PRINTED = 10;
+
+    static std::vector<std::string> patterns;
+    static TeddyMasks teddy;
+    static AhoCorasick matcher;
+    static SimdLevel simd_level;
+    static teddy_scan_fn prefilter;
+    static std::vector<DpiApp*> instances;
+
+    std::vector<uint64_t> pattern_hits;     // Per pattern id, this lcore only
+    uint64_t num_pkts = 0;
+    uint64_t num_bytes = 0;
+    uint64_t num_candidates = 0;            // Packets handed to the verifier
+    uint64_t num_matched = 0;               // Packets with at least one match
+    uint64_t num_matches = 0;
+    uint64_t prefilter_cycles = 0;
+    uint64_t verify_cycles = 0;
+
+    static bool unescape(const std::string& line, std::string* out)
+    {
+        out->clear();
+        for (size_t i = 0; i < line.size(); i++) {
+            if (line[i] != '\\') {
+                out->push_back(line[i]);
+                continue;
+            }
+            if (i + 1 < line.size() && line[i + 1] == '\\') {
+                out->push_back('\\');
+                i++;
+            } else if (i + 3 < line.size() && line[i + 1] == 'x' && isxdigit(line[i + 2]) && isxdigit(line[i + 3])) {
+                out->push_back((char)strtoul(line.substr(i + 2, 2).c_str(), nullptr, 16));
+                i += 3;
+            } else {
+                return false;
+            }
+        }
+        return !out->empty();
+    }
+
+public:
+
+    // Load and compile the patterns once, rte_exit on any error
+    static void init(const std::string& spec)
+    {
+        if (spec.compare(0, 7, "random:") == 0) {
+            unsigned long n = 0, len = DEFAULT_RANDOM_LEN;
+            if (sscanf(spec.c_str(), "random:%lu:%lu", &n, &len) < 1 || n == 0 || len == 0)
+                rte_exit(EXIT_FAILURE, "DPI: random:<n>[:<len>] needs a positive count and length\n");
+            FastRand rng(workload_config.seed ^ 0x647069);
+            for (unsigned long i = 0; i < n; i++) {
+                std::string p(len, '\0');
+                for (char& c : p)
+                    c = (char)rng.next();
+                patterns.push_back(p);
+            }
+        } else {
+            std::ifstream in(spec);
+            if (!in)
+                rte_exit(EXIT_FAILURE, "DPI: cannot open pattern file %s\n", spec.c_str());
+            std::string line;
+            uint64_t line_no = 0;
+            while (std::getline(in, line)) {
+                line_no++;
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                if (line.empty() || line[0] == '#')
+                    continue;
+                std::string p;
+                if (!unescape(line, &p))
+                    rte_exit(EXIT_FAILURE, "DPI: %s:%lu, bad escape (only \\xHH and \\\\)\n", spec.c_str(), line_no);
+                patterns.push_back(p);
+            }
+            if (patterns.empty())
+                rte_exit(EXIT_FAILURE, "DPI: no pattern in %s\n", spec.c_str());
+        }
+
+        uint64_t start = rte_get_tsc_cycles();
+        teddy.build(patterns);
+        matcher.build(patterns);
+        simd_level = detect_simd_level();
+        prefilter = teddy_select_kernel(simd_level);
+
+        printf("DPI: %lu patterns, Teddy width %d (%s), Aho-Corasick %u states (%lu KB), built in %.1f ms\n",
+            patterns.size(), teddy.width, simd_level_str(simd_level), matcher.states(), matcher.memory() >> 10,
+            (rte_get_tsc_cycles() - start) * 1000.0 / rte_get_tsc_hz());
+    }
+
+    DpiApp(): pattern_hits(patterns.size(), 0) {
+        instances.push_back(this);
+    }
+    ~DpiApp() {}
+
+    void run(char* pkt_ptr, size_t len) override {
+        if (len <= PAYLOAD_OFFSET)
+            return;
+        const uint8_t* payload = (const uint8_t*)pkt_ptr + PAYLOAD_OFFSET;
+        uint32_t payload_len = len - PAYLOAD_OFFSET;
+        inspect(payload, payload_len, prefilter(teddy, payload, 0, payload_len));
+    }
+
+    uint64_t run_burst(rte_mbuf** pkts, uint64_t nb_pkts) override
+    {
+        const uint8_t* payloads[MAX_BURST];
+        uint32_t lens[MAX_BURST];
+        uint32_t firsts[MAX_BURST];
+        assert(nb_pkts <= MAX_BURST);
+
+        //*** Prefilter the whole burst, then verify the survivors */
+        uint64_t start = rte_get_tsc_cycles();
+        for (uint64_t i = 0; i < nb_pkts; i++) {
+            uint32_t len = pkts[i]->data_len;
+            payloads[i] = rte_pktmbuf_mtod_offset(pkts[i], const uint8_t*, PAYLOAD_OFFSET);
+            lens[i] = (len > PAYLOAD_OFFSET) ? len - PAYLOAD_OFFSET : 0;
+            firsts[i] = prefilter(teddy, payloads[i], 0, lens[i]);
+        }
+        uint64_t mid = rte_get_tsc_cycles();
+        for (uint64_t i = 0; i < nb_pkts; i++)
+            inspect(payloads[i], lens[i], firsts[i]);
+        uint64_t end = rte_get_tsc_cycles();
+
+        prefilter_cycles += mid - start;
+        verify_cycles += end - mid;
+        return nb_pkts;
+    }
+
+    std::string print_stats() override {
+        uint64_t pkts = 0, bytes = 0, candidates = 0, matched = 0, matches = 0, pre_cycles = 0, ver_cycles = 0;
+        std::vector<uint64_t> hits(patterns.size(), 0);
+        for (DpiApp* app : instances) {
+            pkts += app->num_pkts;
+            bytes += app->num_bytes;
+            candidates += app->num_candidates;
+            matched += app->num_matched;
+            matches += app->num_matches;
+            pre_cycles += app->prefilter_cycles;
+            ver_cycles += app->verify_cycles;
+            for (size_t p = 0; p < patterns.size(); p++)
+                hits[p] += app->pattern_hits[p];
+        }
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << "============ DPI APP STATS ============\n"
+            << "Patterns: " << patterns.size() << " -- Prefilter: Teddy x" << teddy.width << " " << simd_level_str(simd_level)
+            << " -- AC States: " << matcher.states() << " -- Lcores: " << instances.size() << "\n"
+            << "Packets: " << pkts << " -- Payload Bytes: " << bytes
+            << " -- Verified: " << candidates << " (" << (pkts ? candidates * 100.0 / pkts : 0.0) << "%)"
+            << " -- Matched: " << matched << " -- Matches: " << matches << "\n"
+            << "Cycles/Byte -- prefilter: " << (bytes ? (double)pre_cycles / bytes : 0.0)
+            << " -- verify: " << (bytes ? (double)ver_cycles / bytes : 0.0) << "\n";
+
+        std::vector<size_t> order(patterns.size());
+        for (size_t p = 0; p < order.size(); p++)
+            order[p] = p;
+        size_t top = std::min(TOP_PATTERNS_PRINTED, order.size());
+        std::partial_sort(order.begin(), order.begin() + top, order.end(),
+            [&hits](size_t a, size_t b) { return hits[a] > hits[b]; });
+        for (size_t k = 0; k < top && hits[order[k]] > 0; k++)
+            out << "  pattern " << order[k] << ": " << hits[order[k]] << "\n";
+        return out.str();
+    }
+
+private:
+
+    inline void inspect(const uint8_t* payload, uint32_t len, uint32_t first) {
+        num_pkts++;
+        num_bytes += len;
+        if (first >= len)
+            return;
+        num_candidates++;
+        uint32_t n = matcher.scan(payload, first, len, [this](uint32_t id) { pattern_hits[id]++; });
+        num_matched += (n != 0);
+        num_matches += n;
+    }
+};
+
+
+} // namespace dpdk_apps
+#endif /* DPI_APP_H */
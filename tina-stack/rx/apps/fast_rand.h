@@ -0,0 +1,64 @@
+#ifndef FAST_RAND_H
+#define FAST_RAND_H
+
+#include <stdint.h>
+
+
+namespace dpdk_apps{
+
+/**
+ * xoshiro256** (Blackman & Vigna), one generator per lcore.
+ * A handful of ALU ops per draw and no shared state, unlike rand() which takes a lock in glibc.
+ * The state is seeded through splitmix64 so that nearby seeds (seed + lcore id) give unrelated streams.
+ */
+class FastRand {
+
+private:
+    uint64_t s[4];
+
+    static inline uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+public:
+    explicit FastRand(uint64_t seed = 1) {
+        reseed(seed);
+    }
+
+    void reseed(uint64_t seed) {
+        for (int i = 0; i < 4; i++) {
+            uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            s[i] = z ^ (z >> 31);
+        }
+    }
+
+    inline uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+
+        return result;
+    }
+
+    // Uniform in [0, 1), 53 bits
+    inline double next_double() {
+        return (next() >> 11) * 0x1.0p-53;
+    }
+
+    // Uniform in [0, n), multiply-shift instead of a modulo (Lemire), bias is below 2^-64 * n
+    inline uint64_t next_below(uint64_t n) {
+        return (uint64_t)(((unsigned __int128)next() * n) >> 64);
+    }
+};
+
+} // namespace dpdk_apps
+
+#endif /* FAST_RAND_H */
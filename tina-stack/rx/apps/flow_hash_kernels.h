@@ -0,0 +1,101 @@
+#ifndef FLOW_HASH_KERNELS_H
+#define FLOW_HASH_KERNELS_H
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "simd_dispatch.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Two independent 32-bit hashes of a burst of 4-word flow keys (src ip, dst ip, ports, proto),
+ * MurmurHash3_x86_32 over the 4 words with two seeds. The keys are SoA so that one AVX2 register
+ * holds the same word of 8 keys; every version produces bit-identical hashes.
+ */
+typedef void (*flow_hash_fn)(const uint32_t* const words[4], uint32_t n, uint32_t* h1, uint32_t* h2);
+
+static constexpr uint32_t FLOW_HASH_SEED1 = 0x9747B28C;
+static constexpr uint32_t FLOW_HASH_SEED2 = 0x5BD1E995;
+
+inline uint32_t murmur3_4words(const uint32_t* const words[4], uint32_t i, uint32_t seed)
+{
+    uint32_t h = seed;
+    for (int w = 0; w < 4; w++) {
+        uint32_t k = words[w][i] * 0xCC9E2D51;
+        k = (k << 15) | (k >> 17);
+        h ^= k * 0x1B873593;
+        h = (h << 13) | (h >> 19);
+        h = h * 5 + 0xE6546B64;
+    }
+    h ^= 16;
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+inline void flow_hash_scalar(const uint32_t* const words[4], uint32_t n, uint32_t* h1, uint32_t* h2)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        h1[i] = murmur3_4words(words, i, FLOW_HASH_SEED1);
+        h2[i] = murmur3_4words(words, i, FLOW_HASH_SEED2);
+    }
+}
+
+__attribute__((target("avx2")))
+inline __m256i murmur3_4words_avx2(const __m256i v_words[4], uint32_t seed)
+{
+    const __m256i c1 = _mm256_set1_epi32(0xCC9E2D51);
+    const __m256i c2 = _mm256_set1_epi32(0x1B873593);
+    const __m256i five = _mm256_set1_epi32(5);
+    const __m256i n1 = _mm256_set1_epi32(0xE6546B64);
+
+    __m256i h = _mm256_set1_epi32(seed);
+    for (int w = 0; w < 4; w++) {
+        __m256i k = _mm256_mullo_epi32(v_words[w], c1);
+        k = _mm256_or_si256(_mm256_slli_epi32(k, 15), _mm256_srli_epi32(k, 17));
+        h = _mm256_xor_si256(h, _mm256_mullo_epi32(k, c2));
+        h = _mm256_or_si256(_mm256_slli_epi32(h, 13), _mm256_srli_epi32(h, 19));
+        h = _mm256_add_epi32(_mm256_mullo_epi32(h, five), n1);
+    }
+    h = _mm256_xor_si256(h, _mm256_set1_epi32(16));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x85EBCA6B));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 13));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0xC2B2AE35));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+    return h;
+}
+
+__attribute__((target("avx2")))
+inline void flow_hash_avx2(const uint32_t* const words[4], uint32_t n, uint32_t* h1, uint32_t* h2)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v_words[4];
+        for (int w = 0; w < 4; w++)
+            v_words[w] = _mm256_loadu_si256((const __m256i*)(words[w] + i));
+        _mm256_storeu_si256((__m256i*)(h1 + i), murmur3_4words_avx2(v_words, FLOW_HASH_SEED1));
+        _mm256_storeu_si256((__m256i*)(h2 + i), murmur3_4words_avx2(v_words, FLOW_HASH_SEED2));
+    }
+    const uint32_t* const tail[4] = {words[0] + i, words[1] + i, words[2] + i, words[3] + i};
+    flow_hash_scalar(tail, n - i, h1 + i, h2 + i);
+}
+
+// The AVX2 kernel already hashes a whole 32-packet burst in 4 iterations, AVX-512 uses it too
+inline flow_hash_fn flow_hash_select_kernel(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_AVX512:
+        case SIMD_AVX2:     return flow_hash_avx2;
+        default:            return flow_hash_scalar;
+    }
+}
+
+} // namespace dpdk_apps
+
+#endif /* FLOW_HASH_KERNELS_H */
@@ -30,11 +30,15 @@ namespace dpdk_apps{
 class HeaderTouchApp: public BaseApp {
 
 private:
+    static std::vector<HeaderTouchApp*> instances;
+
     uint64_t port_ending[4] = {0, 0, 0, 0};     
     std::vector<uint64_t> src_port_samples;
 
 public:
-    HeaderTouchApp(): src_port_samples(SRC_PORT_SAMPLE_SIZE,0) {}
+    HeaderTouchApp(): src_port_samples(SRC_PORT_SAMPLE_SIZE,0) {
+        instances.push_back(this);
+    }
     ~HeaderTouchApp(){}
 
     void run(char* pkt_ptr, size_t len) override {
@@ -49,9 +53,19 @@ public:
     }
 
     std::string print_stats() override {
+        uint64_t port_ending[4] = {0, 0, 0, 0};
+        std::vector<uint64_t> src_port_samples(SRC_PORT_SAMPLE_SIZE, 0);
+        for (HeaderTouchApp* app : instances) {
+            for (int i = 0; i < 4; i++)
+                port_ending[i] += app->port_ending[i];
+            for (uint64_t i = 0; i < SRC_PORT_SAMPLE_SIZE; i++)
+                src_port_samples[i] += app->src_port_samples[i];
+        }
+
         std::ostringstream out;
 
         out << "========== HeaderTouchApp Stats ============\n";
+        out << "Lcores: " << instances.size() << "\n";
         out << "\033[1;33m\033[1m" << "dst_port_sample LastTwoBits: \n\033[0m"
             << " [00]-" << std::setw(13) << port_ending[0]
             << " [01]-" << std::setw(13) << port_ending[1]
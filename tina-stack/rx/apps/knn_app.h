@@ -27,14 +27,43 @@
 #include <math.h>
 #include <stdint.h>
 #include <assert.h>
+#include <immintrin.h>
 
+#include <rte_eal.h>
 
 #include "base_app.h"
+#include "simd_dispatch.h"
+#include "numa_mem.h"
+#include "knn_grid.h"
+#include "workload_gen.h"
+#include "page_migrator.h"
+#include <memory>
 #include <vector>
+#include <string>
+#include <sstream>
 
 
 namespace dpdk_apps{
 
+/**
+ * Nearest-neighbour classification: every tuple is one query point, the KNN_K nearest
+ * training points vote for its category.
+ * The scan is allocation-free and O(n): coordinates are SoA, squared distances are computed
+ * in 64 bits (they reach 2^41 over VAL_RANGE) 4/8 at a time, and only the lanes that beat the
+ * current K-th best fall into the scalar top-K insertion.
+ * Ties are broken by training point index, so every kernel returns the same neighbours.
+ *
+ * With a grid index (see KnnGrid) the query scans rings of cells around its own cell and stops as
+ * soon as nothing outside the scanned block can still enter the top-K, giving the same neighbours
+ * as the full scan. Grid and training data can be bound to different NUMA nodes.
+ *
+ * Without the grid, all queries of a burst share one pass over the training set: it is streamed
+ * in L1-sized blocks and every query of the batch is evaluated against a block before moving on,
+ * so the training set is read once per burst instead of once per query.
+ *
+ * One instance per lcore: the first builds the training set and the grid, the others share them
+ * read-only and only own their batch and counters.
+ */
 class KnnApp: public BaseApp {
 
 private:
@@ -49,15 +78,9 @@ private:
         _KNN_TOTAL
     };
 
-    struct _knn_node {
-        int x;
-        int y;
-        enum _category type;
-    };
-
-    struct _train_node {
-        long long int dist;
-        enum _category type;
+    struct _neighbor {
+        int64_t dist;
+        uint32_t idx;
     };
 
     static constexpr int X = 1000;
@@ -66,112 +89,407 @@ private:
     static constexpr int VAL_RANGE = (1024 * 1024);
     static constexpr int KNN_K = 4;
 
-    int set_size;
-    std::vector<_knn_node> states;
+    static constexpr int SCAN_BLOCK_POINTS = 2048;     // 16KB of coordinates, stays in L1 across the batch
+    static constexpr size_t BATCH_QUERIES_HINT = 32 * 64;
 
-    int partition(struct _train_node *tuples,
-            int first,
-            int last)
-    {
-        long long int pivot_freq = tuples[first].dist;
-        int left_marker = first + 1, right_marker = last;
-        struct _train_node tmp;
-
-        while (left_marker < right_marker) {
-            while ((left_marker <= right_marker) &&
-                (tuples[left_marker].dist >= pivot_freq)) {
-                left_marker++;
-            }
-            while ((right_marker >= left_marker) &&
-                (tuples[right_marker].dist <= pivot_freq)) {
-                right_marker--;
-            }
+    // Sorted nearest first by (distance, index), valid entries are [0, count)
+    struct _topk {
+        _neighbor best[KNN_K];
+        int count;
 
-            if (left_marker < right_marker) {
-                tmp = tuples[left_marker];
-                tuples[left_marker] = tuples[right_marker];
-                tuples[right_marker] = tmp;
-            }
+        void clear() { count = 0; }
+
+        // Worst of the current top-K, everything at or above it can't get in
+        int64_t threshold() const {
+            return (count < KNN_K) ? INT64_MAX : best[KNN_K - 1].dist;
         }
 
-        tmp = tuples[first];
-        tuples[first] = tuples[right_marker];
-        tuples[right_marker] = tmp;
-        return right_marker;
-    }
+        static bool closer(int64_t dist_a, uint32_t idx_a, const _neighbor& b) {
+            return dist_a < b.dist || (dist_a == b.dist && idx_a < b.idx);
+        }
 
-    void quick_sort(struct _train_node *tuples,
-            int first,
-            int last)
-    {
-        if (first < last) {
-            int split_po = partition(tuples, first, last);
-            quick_sort(tuples, first, split_po - 1);
-            quick_sort(tuples, split_po + 1, last);
+        // The scans visit increasing indices, so for them the index never decides
+        void insert(int64_t dist, uint32_t idx)
+        {
+            if (count == KNN_K && !closer(dist, idx, best[KNN_K - 1]))
+                return;
+            int pos = (count < KNN_K) ? count++ : KNN_K - 1;
+            while (pos > 0 && closer(dist, idx, best[pos - 1])) {
+                best[pos] = best[pos - 1];
+                pos--;
+            }
+            best[pos] = {dist, idx};
         }
-    }
+    };
+
+    struct _query {
+        int x;
+        int y;
+        _topk topk;
+    };
+
+    static std::vector<KnnApp*> instances;
+
+    int set_size;
+
+    //*** Training set, structure-of-arrays in one mapping placed on data_node, shared by every lcore */
+    std::shared_ptr<void> data_mem;
+    size_t data_mem_size = 0;
+    int32_t* xs;
+    int32_t* ys;
+    uint8_t* types;
+
+    SimdLevel simd_level;
+
+    bool use_grid = false;
+    int index_node = NUMA_NODE_ANY;
+    int data_node = NUMA_NODE_ANY;
+    std::shared_ptr<KnnGrid> grid;
+
+    std::vector<_query> batch;              // This lcore's burst
+
+    uint64_t num_queries = 0;
+    uint64_t num_batches = 0;
+    uint64_t class_count[_KNN_TOTAL] = {0};
+
+    std::shared_ptr<KeyGenSet> key_gen;     // Query points, one stream per lcore
+
+    //*** Access heat for the page migrator, nullptr when it is off */
+    HeatRegion* data_heat = nullptr;
+    HeatRegion* grid_heat = nullptr;
+    uint64_t num_cells_scanned = 0;
+    uint64_t num_points_scanned = 0;
+    _category last_class = KNN_TYPE1;
 
 public:
-    KnnApp(int footprint_size)
-    :set_size(footprint_size), states(footprint_size)
+    /**
+     * footprint_size:  number of training points
+     * index_spec:      "" or "scan" for the full scan,
+     *                  "grid[:<index node>[:<data node>]]" to build the grid index
+     */
+    KnnApp(int footprint_size, const std::string& index_spec = "")
+    :set_size(footprint_size), grid(new KnnGrid()), key_gen(new KeyGenSet())
     {
-        printf("Size of each Knn Node: %lu, size of train_node: %lu\n", sizeof(_knn_node), sizeof(_train_node));
+        if (footprint_size <= 0)
+            rte_exit(EXIT_FAILURE, "KNN: data footprint must be > 0\n");
+        if (!parse_index_spec(index_spec))
+            rte_exit(EXIT_FAILURE, "KNN: invalid index spec %s, should be scan or grid[:<index node>[:<data node>]]\n", index_spec.c_str());
+
+        data_mem_size = (size_t)footprint_size * (sizeof(int32_t) * 2 + sizeof(uint8_t));
+        size_t mem_size = data_mem_size;
+        data_mem.reset(alloc_on_node(data_mem_size, data_node), [mem_size](void* p) { free_on_node(p, mem_size); });
+        if (data_mem == nullptr)
+            rte_exit(EXIT_FAILURE, "KNN: cannot allocate the training set on node %d\n", data_node);
+        xs = (int32_t*)data_mem.get();
+        ys = xs + footprint_size;
+        types = (uint8_t*)(ys + footprint_size);
+
+        //Training set and query streams both derive from the workload seed, so a run can be replayed
+        FastRand data_rng(workload_config.seed ^ 0x6B6E6E);
         for (int i = 0; i < footprint_size; i++) {
-            states[i].x = rand() % VAL_RANGE;
-            states[i].y = rand() % VAL_RANGE;
-            states[i].type = static_cast<_category>(rand() % _KNN_TOTAL);
+            xs[i] = data_rng.next_below(VAL_RANGE);
+            ys[i] = data_rng.next_below(VAL_RANGE);
+            types[i] = static_cast<_category>(data_rng.next_below(_KNN_TOTAL));
         }
+        key_gen->init(VAL_RANGE, "KNN query");
+        simd_level = detect_simd_level();
+        printf("KNN training set: %d points, %lu B per point, %s distance kernel, NUMA node %d\n",
+            set_size, sizeof(int32_t) * 2 + sizeof(uint8_t), simd_level_str(simd_level), data_node);
+
+        if (use_grid) {
+            if (!grid->build(xs, ys, footprint_size, VAL_RANGE, index_node))
+                rte_exit(EXIT_FAILURE, "KNN: cannot build the grid index\n");
+            printf("KNN grid index: %u x %u cells of width %u, %lu MB, NUMA node %d\n",
+                grid->get_dim(), grid->get_dim(), grid->get_cell_width(), grid->size_bytes() >> 20, index_node);
+        }
+        batch.reserve(BATCH_QUERIES_HINT);
+
+        data_heat = page_migrator.register_region("KNN training set", data_mem.get(), data_mem_size);
+        if (use_grid)
+            grid_heat = page_migrator.register_region("KNN grid", grid->memory(), grid->size_bytes());
+        instances.push_back(this);
+    }
+
+    // Another lcore's instance over the training set and grid first built, with a batch of its own
+    explicit KnnApp(const KnnApp& first):
+        set_size(first.set_size), data_mem(first.data_mem), data_mem_size(first.data_mem_size),
+        xs(first.xs), ys(first.ys), types(first.types), simd_level(first.simd_level),
+        use_grid(first.use_grid), index_node(first.index_node), data_node(first.data_node), grid(first.grid),
+        key_gen(first.key_gen), data_heat(first.data_heat), grid_heat(first.grid_heat)
+    {
+        batch.reserve(BATCH_QUERIES_HINT);
+        instances.push_back(this);
     }
 
     ~KnnApp() {}
 
-    void knn_process(int x, int y)
+    _category knn_process(int x, int y)
     {
-        int i, train_nodes_freq[_KNN_TOTAL], max_freq;
-        enum _category type;
-        struct _train_node *train_nodes;
+        batch.clear();
+        batch.push_back({x, y});
+        run_batch();
+        return last_class;
+    }
 
-        train_nodes = (struct _train_node *)malloc(sizeof(struct _train_node) * 
-                set_size);
-        assert(train_nodes);
-        memset(train_nodes_freq, 0x00, sizeof(int) * _KNN_TOTAL);
+    void run(char* pkt_ptr, size_t len) override
+    {
+        batch.clear();
+        add_queries(pkt_ptr, len);
+        run_batch();
+    }
 
+    uint64_t run_burst(rte_mbuf** pkts, uint64_t nb_pkts) override
+    {
+        batch.clear();
+        for (uint64_t i = 0; i < nb_pkts; i++)
+            add_queries(rte_pktmbuf_mtod(pkts[i], char*), pkts[i]->pkt_len);
+        run_batch();
+        return nb_pkts;
+    }
 
-        for (i = 0; i < set_size; i++) {
-            train_nodes[i].dist = (x - states[i].x) * (x - states[i].x) + 
-                (y - states[i].y) * (y - states[i].y);
-            train_nodes[i].type = states[i].type;
+    std::string print_stats() override {
+        uint64_t num_queries = 0, num_batches = 0, num_points_scanned = 0, num_cells_scanned = 0;
+        uint64_t class_count[_KNN_TOTAL] = {0};
+        for (KnnApp* app : instances) {
+            num_queries += app->num_queries;
+            num_batches += app->num_batches;
+            num_points_scanned += app->num_points_scanned;
+            num_cells_scanned += app->num_cells_scanned;
+            for (int i = 0; i < _KNN_TOTAL; i++)
+                class_count[i] += app->class_count[i];
         }
 
+        std::ostringstream out;
+        out << "============ KNN APP STATS ============\n"
+            << "Training Points: " << set_size << " -- Lcores: " << instances.size()
+            << " -- Kernel: " << (use_grid ? "Grid" : simd_level_str(simd_level))
+            << " -- Queries: " << num_queries
+            << " -- Per Batch: " << (num_batches ? num_queries / num_batches : 0) << "\n"
+            << "Points Scanned Per Query: " << (num_queries ? num_points_scanned / num_queries : 0);
+        if (use_grid)
+            out << " -- Cells Scanned Per Query: " << num_cells_scanned / std::max<uint64_t>(1, num_queries);
+        out << "\n"
+            << "Class Votes:";
+        for (int i = 0; i < _KNN_TOTAL; i++)
+            out << " " << class_count[i];
+        out << "\n";
+        return out.str();
+    }
 
-        quick_sort(train_nodes, 0, set_size - 1);
+private:
 
-        for (i = 0; i < KNN_K; i++) {
-            train_nodes_freq[train_nodes[i].type]++;
+    bool parse_index_spec(const std::string& spec)
+    {
+        if (spec.empty() || spec == "scan")
+            return true;
+        if (spec.compare(0, 4, "grid") != 0)
+            return false;
+        use_grid = true;
+        return spec == "grid" || sscanf(spec.c_str(), "grid:%d:%d", &index_node, &data_node) >= 1;
+    }
+
+    void add_queries(char* pkt_ptr, size_t len)
+    {
+        KeyGen& gen = key_gen->local();
+        size_t num_tuples_in_pkt = len/tuple_size;
+        for (int i = 0; i < num_tuples_in_pkt; i++) {
+            //Payload keys: x from words 0-1, y from words 2-3 of the tuple
+            const _tuple* t = (const _tuple*)(pkt_ptr + i * tuple_size);
+            int x = gen.next(&t->word[0]);
+            int y = gen.next(&t->word[2]);
+
+            batch.push_back({x, y});
         }
+    }
 
-        max_freq = 0;
-        for (i = 0; i < _KNN_TOTAL; i++) {
+    void run_batch()
+    {
+        for (_query& q : batch)
+            q.topk.clear();
+
+        if (use_grid) {
+            for (_query& q : batch)
+                search_grid(q.x, q.y, q.topk);
+        } else {
+            //*** Block-major: one block of the training set against every query, then the next block */
+            for (int begin = 0; begin < set_size; begin += SCAN_BLOCK_POINTS) {
+                int end = std::min(set_size, begin + SCAN_BLOCK_POINTS);
+                for (_query& q : batch)
+                    scan(q.x, q.y, begin, end, q.topk);
+                if (data_heat) {
+                    data_heat->touch_range(xs + begin, (end - begin) * sizeof(int32_t));
+                    data_heat->touch_range(ys + begin, (end - begin) * sizeof(int32_t));
+                }
+            }
+            num_points_scanned += (uint64_t)set_size * batch.size();
+        }
+
+        for (_query& q : batch)
+            last_class = classify(q.topk);
+        num_queries += batch.size();
+        num_batches++;
+    }
+
+    _category classify(const _topk& t)
+    {
+        int train_nodes_freq[_KNN_TOTAL] = {0};
+        for (int i = 0; i < t.count; i++)
+            train_nodes_freq[types[t.best[i].idx]]++;
+
+        int max_freq = 0;
+        _category type = KNN_TYPE1;
+        for (int i = 0; i < _KNN_TOTAL; i++) {
             if (train_nodes_freq[i] > max_freq) {
                 max_freq = train_nodes_freq[i];
                 type = static_cast<_category>(i);
             }
         }
+        class_count[type]++;
+        return type;
+    }
 
-        free(train_nodes);
+    void scan(int x, int y, int begin, int end, _topk& t)
+    {
+        switch (simd_level) {
+            case SIMD_AVX512:   scan_avx512(x, y, begin, end, t); break;
+            case SIMD_AVX2:     scan_avx2(x, y, begin, end, t); break;
+            default:            scan_scalar(x, y, begin, end, t); break;
+        }
     }
 
-    void run(char* pkt_ptr, size_t len) override {
+    void scan_cell(int x, int y, uint32_t cx, uint32_t cy, _topk& t)
+    {
+        const int32_t* gx = grid->xs();
+        const int32_t* gy = grid->ys();
+        const uint32_t* gi = grid->idx();
+        uint32_t end = grid->end(cx, cy);
+        for (uint32_t p = grid->begin(cx, cy); p < end; p++)
+            t.insert(distance(x, y, gx[p], gy[p]), gi[p]);
+        if (grid_heat) {
+            grid_heat->touch(gx + grid->begin(cx, cy));
+            grid_heat->touch(gy + grid->begin(cx, cy));
+        }
+        num_points_scanned += end - grid->begin(cx, cy);
+        num_cells_scanned++;
+    }
 
-        size_t num_tuples_in_pkt = len/tuple_size;
-        for (int i = 0; i < num_tuples_in_pkt; i++) {
-            uint8_t pkt_dummy_data = pkt_ptr[i * tuple_size];
-            
-            int fake_x = (rand() + pkt_dummy_data) % VAL_RANGE;
-            int fake_y = fake_x;
+    /**
+     * Scan the cells at Chebyshev distance r = 0, 1, 2... from the query cell.
+     * A point outside the scanned block is at least `gap` away along x or y, so once the K-th best is
+     * strictly closer than gap^2 nothing outside can enter (not even on an index tie-break).
+     */
+    void search_grid(int x, int y, _topk& t)
+    {
+        const int64_t dim = grid->get_dim();
+        const int64_t w = grid->get_cell_width();
+        const int64_t cx = grid->cell_coord(x);
+        const int64_t cy = grid->cell_coord(y);
+
+        for (int64_t r = 0; ; r++) {
+            int64_t x_lo = cx - r, x_hi = cx + r, y_lo = cy - r, y_hi = cy + r;
+            for (int64_t j = std::max<int64_t>(0, y_lo); j <= std::min(dim - 1, y_hi); j++) {
+                if (j == y_lo || j == y_hi) {
+                    for (int64_t i = std::max<int64_t>(0, x_lo); i <= std::min(dim - 1, x_hi); i++)
+                        scan_cell(x, y, i, j, t);
+                } else {
+                    if (x_lo >= 0)
+                        scan_cell(x, y, x_lo, j, t);
+                    if (x_hi < dim)
+                        scan_cell(x, y, x_hi, j, t);
+                }
+            }
+
+            //*** Closest possible distance to anything not scanned yet, INT64_MAX on the grid border */
+            int64_t gap = INT64_MAX;
+            if (x_lo > 0)           gap = std::min<int64_t>(gap, x - x_lo * w + 1);
+            if (x_hi < dim - 1)     gap = std::min<int64_t>(gap, (x_hi + 1) * w - x);
+            if (y_lo > 0)           gap = std::min<int64_t>(gap, y - y_lo * w + 1);
+            if (y_hi < dim - 1)     gap = std::min<int64_t>(gap, (y_hi + 1) * w - y);
+            if (gap == INT64_MAX)
+                return;
+            if (t.count == KNN_K && t.best[KNN_K - 1].dist < gap * gap)
+                return;
+        }
+    }
+
+    static int64_t distance(int x, int y, int32_t px, int32_t py) {
+        int64_t dx = (int64_t)x - px;
+        int64_t dy = (int64_t)y - py;
+        return dx * dx + dy * dy;
+    }
 
-            knn_process(fake_x, fake_y);
+    void scan_scalar(int x, int y, int begin, int end, _topk& t)
+    {
+        for (int i = begin; i < end; i++)
+            t.insert(distance(x, y, xs[i], ys[i]), i);
+    }
+
+    /**
+     * _mm256_mul_epi32 multiplies the low signed 32 bits of each 64-bit lane, so one block of 8 points
+     * gives the distances of the even points directly and of the odd ones after a 32-bit shift.
+     * Coordinates are < 2^20, so the 32-bit differences can't overflow.
+     */
+    __attribute__((target("avx2")))
+    void scan_avx2(int x, int y, int begin, int end, _topk& t)
+    {
+        const __m256i v_x = _mm256_set1_epi32(x);
+        const __m256i v_y = _mm256_set1_epi32(y);
+
+        int i = begin;
+        for (; i + 8 <= end; i += 8) {
+            __m256i dx = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)&xs[i]), v_x);
+            __m256i dy = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)&ys[i]), v_y);
+            __m256i d_even = _mm256_add_epi64(_mm256_mul_epi32(dx, dx), _mm256_mul_epi32(dy, dy));
+            dx = _mm256_srli_epi64(dx, 32);
+            dy = _mm256_srli_epi64(dy, 32);
+            __m256i d_odd = _mm256_add_epi64(_mm256_mul_epi32(dx, dx), _mm256_mul_epi32(dy, dy));
+
+            __m256i v_thr = _mm256_set1_epi64x(t.threshold());
+            int m_even = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v_thr, d_even)));
+            int m_odd = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v_thr, d_odd)));
+            if ((m_even | m_odd) == 0)
+                continue;
+
+            //Rare once the top-K has settled, redo the candidates in index order
+            for (int l = 0; l < 4; l++) {
+                if (m_even & (1 << l))
+                    t.insert(distance(x, y, xs[i + 2 * l], ys[i + 2 * l]), i + 2 * l);
+                if (m_odd & (1 << l))
+                    t.insert(distance(x, y, xs[i + 2 * l + 1], ys[i + 2 * l + 1]), i + 2 * l + 1);
+            }
+        }
+        scan_scalar(x, y, i, end, t);
+    }
+
+    __attribute__((target("avx512f")))
+    void scan_avx512(int x, int y, int begin, int end, _topk& t)
+    {
+        const __m512i v_x = _mm512_set1_epi32(x);
+        const __m512i v_y = _mm512_set1_epi32(y);
+
+        int i = begin;
+        for (; i + 16 <= end; i += 16) {
+            __m512i dx = _mm512_sub_epi32(_mm512_loadu_si512(&xs[i]), v_x);
+            __m512i dy = _mm512_sub_epi32(_mm512_loadu_si512(&ys[i]), v_y);
+            __m512i d_even = _mm512_add_epi64(_mm512_mul_epi32(dx, dx), _mm512_mul_epi32(dy, dy));
+            dx = _mm512_srli_epi64(dx, 32);
+            dy = _mm512_srli_epi64(dy, 32);
+            __m512i d_odd = _mm512_add_epi64(_mm512_mul_epi32(dx, dx), _mm512_mul_epi32(dy, dy));
+
+            __m512i v_thr = _mm512_set1_epi64(t.threshold());
+            __mmask8 m_even = _mm512_cmplt_epi64_mask(d_even, v_thr);
+            __mmask8 m_odd = _mm512_cmplt_epi64_mask(d_odd, v_thr);
+            if ((m_even | m_odd) == 0)
+                continue;
+
+            for (int l = 0; l < 8; l++) {
+                if (m_even & (1 << l))
+                    t.insert(distance(x, y, xs[i + 2 * l], ys[i + 2 * l]), i + 2 * l);
+                if (m_odd & (1 << l))
+                    t.insert(distance(x, y, xs[i + 2 * l + 1], ys[i + 2 * l + 1]), i + 2 * l + 1);
+            }
         }
+        scan_scalar(x, y, i, end, t);
     }
 
 };
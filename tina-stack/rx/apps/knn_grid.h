@@ -0,0 +1,114 @@
+#ifndef KNN_GRID_H
+#define KNN_GRID_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "numa_mem.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Uniform grid over the KNN training set, built once at startup.
+ * Points are bucketed by cell and copied cell after cell into SoA arrays, so scanning a cell
+ * streams a few contiguous cache lines. Each entry keeps the original point index, which is what
+ * the labels are looked up with and what equal distances are ordered by.
+ * All arrays come from one mapping that can be bound to a NUMA node, independently of the data.
+ */
+class KnnGrid {
+
+public:
+    static constexpr uint32_t POINTS_PER_CELL = 8;
+
+private:
+    uint32_t dim = 0;           // dim x dim cells
+    uint32_t cell_width = 0;
+
+    void* mem = nullptr;
+    size_t mem_size = 0;
+
+    uint32_t* cell_start = nullptr;     // dim * dim + 1 offsets into the arrays below
+    int32_t* cell_xs = nullptr;
+    int32_t* cell_ys = nullptr;
+    uint32_t* cell_idx = nullptr;
+
+public:
+    KnnGrid() {}
+    KnnGrid(const KnnGrid&) = delete;
+    KnnGrid& operator=(const KnnGrid&) = delete;
+
+    ~KnnGrid() {
+        free_on_node(mem, mem_size);
+    }
+
+    /**
+     * Coordinates must be in [0, val_range).
+     * Return false if the grid memory can't be allocated on numa_node.
+     */
+    bool build(const int32_t* xs, const int32_t* ys, uint32_t num_points, uint32_t val_range, int numa_node)
+    {
+        dim = std::max<uint32_t>(1, (uint32_t)sqrt((double)num_points / POINTS_PER_CELL));
+        cell_width = (val_range + dim - 1) / dim;
+        uint64_t num_cells = (uint64_t)dim * dim;
+
+        mem_size = (num_cells + 1) * sizeof(uint32_t) + (uint64_t)num_points * (sizeof(int32_t) * 2 + sizeof(uint32_t));
+        mem = alloc_on_node(mem_size, numa_node);
+        if (mem == nullptr) {
+            fprintf(stderr, "Cannot allocate %lu MB KNN grid on node %d\n", mem_size >> 20, numa_node);
+            return false;
+        }
+        cell_xs = (int32_t*)mem;
+        cell_ys = cell_xs + num_points;
+        cell_idx = (uint32_t*)(cell_ys + num_points);
+        cell_start = cell_idx + num_points;
+
+        //*** Counting sort by cell, stable so points keep index order within a cell */
+        memset(cell_start, 0, (num_cells + 1) * sizeof(uint32_t));
+        for (uint32_t i = 0; i < num_points; i++)
+            cell_start[cell_of(xs[i], ys[i]) + 1]++;
+        for (uint64_t c = 0; c < num_cells; c++)
+            cell_start[c + 1] += cell_start[c];
+
+        uint32_t* fill = (uint32_t*)alloc_on_node(num_cells * sizeof(uint32_t), NUMA_NODE_ANY);
+        if (fill == nullptr)
+            return false;
+        memcpy(fill, cell_start, num_cells * sizeof(uint32_t));
+        for (uint32_t i = 0; i < num_points; i++) {
+            uint32_t pos = fill[cell_of(xs[i], ys[i])]++;
+            cell_xs[pos] = xs[i];
+            cell_ys[pos] = ys[i];
+            cell_idx[pos] = i;
+        }
+        free_on_node(fill, num_cells * sizeof(uint32_t));
+        return true;
+    }
+
+    uint32_t get_dim() const { return dim; }
+    uint32_t get_cell_width() const { return cell_width; }
+    size_t size_bytes() const { return mem_size; }
+    const void* memory() const { return mem; }
+
+    uint32_t cell_coord(int32_t v) const {
+        return std::min<uint32_t>(dim - 1, (uint32_t)std::max<int32_t>(0, v) / cell_width);
+    }
+
+    uint64_t cell_of(int32_t x, int32_t y) const {
+        return (uint64_t)cell_coord(y) * dim + cell_coord(x);
+    }
+
+    // Points of cell (cx, cy) are [begin, end) of xs()/ys()/idx()
+    uint32_t begin(uint32_t cx, uint32_t cy) const { return cell_start[(uint64_t)cy * dim + cx]; }
+    uint32_t end(uint32_t cx, uint32_t cy) const { return cell_start[(uint64_t)cy * dim + cx + 1]; }
+
+    const int32_t* xs() const { return cell_xs; }
+    const int32_t* ys() const { return cell_ys; }
+    const uint32_t* idx() const { return cell_idx; }
+};
+
+} // namespace dpdk_apps
+
+#endif /* KNN_GRID_H */
@@ -14,7 +14,13 @@
 #include <assert.h>
 #include "uthash.h"
 
+#include <rte_eal.h>
+
 #include "base_app.h"
+#include "workload_gen.h"
+#include "numa_mem.h"
+#include "page_migrator.h"
+#include "../../tx/dpdk_exp_pkt.h"
 
 
 namespace dpdk_apps{
@@ -43,13 +49,19 @@ public:
 
     static uint64_t key_pool_count;
     static _kvs_state kvs_state;        //Shared with all KVS threads
+    struct entry* slab = nullptr;       //All entries in one mapping, placed by the app memory policy
+    HeatRegion* slab_heat = nullptr;    //Entry heat for the page migrator, nullptr when it is off
     uint64_t dummy_value;
+    KeyGenSet key_gen;                  //Keys and GET/SET mix, one stream per lcore
 
     KVSApp(){
         assert(key_pool_count != 0);
 
+        slab = (struct entry *)alloc_on_node(key_pool_count * sizeof(struct entry), NUMA_NODE_ANY);
+        if (slab == nullptr)
+            rte_exit(EXIT_FAILURE, "KVS: cannot allocate %lu entries\n", key_pool_count);
         for (uint64_t i = 0; i < key_pool_count; i++) {
-            struct entry *e = (struct entry *)malloc(sizeof(struct entry));
+            struct entry *e = &slab[i];
             e->id = i;
             e->num_gets = 0;
             e->num_sets = 0;
@@ -57,17 +69,15 @@ public:
             memset(e->value, 0, WORD_LEN);
             HASH_ADD_INT(kvs_state.mydb, id, e);
         }
-
+        key_gen.init(key_pool_count, "KVS");
+        slab_heat = page_migrator.register_region("KVS entries", slab, key_pool_count * sizeof(struct entry));
     }
 
     ~KVSApp() {
-        struct entry *e, *tmp;
         pthread_mutex_lock(&(kvs_state.lock));
-        HASH_ITER(hh, kvs_state.mydb, e, tmp) {
-            HASH_DEL(kvs_state.mydb, e);
-            free(e);
-        }        
+        HASH_CLEAR(hh, kvs_state.mydb);
         pthread_mutex_unlock(&(kvs_state.lock));
+        free_on_node(slab, key_pool_count * sizeof(struct entry));
     }
 
     //! This is the first version of KVS App
@@ -112,9 +122,12 @@ public:
    //! This is the second version of KVS App
     void run(char* pkt_ptr, size_t len) override {
 
-        int64_t key = rand() % key_pool_count;
+        //With the payload key distribution, the key is the first 8B after the experiment header
+        KeyGen& gen = key_gen.local();
+        const char* payload_key = (len >= sizeof(dpdk_exp_pkt) + sizeof(uint64_t)) ? pkt_ptr + sizeof(dpdk_exp_pkt) : nullptr;
+        int64_t key = gen.next(payload_key);
         enum Op_Type {SET = 0, GET = 1} operation_type;
-        operation_type = static_cast<Op_Type> (rand() % 2);
+        operation_type = static_cast<Op_Type> (gen.rng().next() & 1);
 
         struct entry *e;
         pthread_mutex_lock(&(kvs_state.lock));
@@ -140,6 +153,8 @@ public:
                 }
             }
         }
+        if (slab_heat && e)
+            slab_heat->touch(e);
 
         pthread_mutex_unlock(&(kvs_state.lock));
     }   
@@ -0,0 +1,245 @@
+#ifndef L3FWD_APP_H
+#define L3FWD_APP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <rte_eal.h>
+#include <rte_ethdev.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_lpm.h>
+#include <rte_malloc.h>
+
+#include "base_app.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * IPv4 L3 forwarding: longest prefix match on the destination address (rte_lpm, DIR-24-8),
+ * MAC rewrite, TTL decrement with an incremental checksum update, then out of the lcore's TX queue.
+ *
+ * Route file, one route per line, '#' starts a comment:
+ *   <a.b.c.d>/<len> <next hop MAC>     forward to that MAC
+ *   <a.b.c.d>/<len> reflect            send back to the packet's source MAC (the generator)
+ * No route file installs 0.0.0.0/0 reflect.
+ *
+ * The LPM table is shared (read only on the RX path), every lcore owns a TX buffer on its own queue,
+ * flushed once per burst. Forwarded mbufs are owned by the NIC from there on; run_burst hands the
+ * dropped ones (no route, TTL expired, not IPv4) back to the caller, which frees them as usual.
+ */
+class L3fwdApp: public BaseApp {
+
+private:
+    static constexpr uint32_t REFLECT = (1U << 24) - 1;    // Next hop of a reflect route, LPM next hops are 24-bit
+    static constexpr uint32_t MIN_TBL8S = 256;
+    static constexpr uint16_t TX_BUFFER_SIZE = 32;
+
+    static rte_lpm* lpm;
+    static std::vector<rte_ether_addr> next_hops;
+    static rte_ether_addr port_mac;
+    static uint16_t port;
+    static std::vector<L3fwdApp*> instances;
+
+    uint16_t queue;
+    rte_eth_dev_tx_buffer* tx_buffer;
+
+    uint64_t num_forwarded = 0;
+    uint64_t num_no_route = 0;
+    uint64_t num_ttl_expired = 0;
+    uint64_t num_not_ipv4 = 0;
+    uint64_t num_tx_dropped = 0;            // Bumped by the TX buffer error callback
+
+    struct _route {
+        uint32_t ip;
+        uint8_t depth;
+        uint32_t hop;
+    };
+
+    static bool parse_route(const std::string& line, _route* r)
+    {
+        unsigned a, b, c, d, len;
+        char hop[32];
+        if (sscanf(line.c_str(), "%u.%u.%u.%u/%u %31s", &a, &b, &c, &d, &len, hop) != 6)
+            return false;
+        if (a > 255 || b > 255 || c > 255 || d > 255 || len > RTE_LPM_MAX_DEPTH)
+            return false;
+        r->ip = RTE_IPV4(a, b, c, d);
+        r->depth = len;
+
+        if (strcmp(hop, "reflect") == 0) {
+            r->hop = REFLECT;
+            return true;
+        }
+        rte_ether_addr mac;
+        if (rte_ether_unformat_addr(hop, &mac) != 0)
+            return false;
+        r->hop = next_hops.size();
+        next_hops.push_back(mac);
+        return true;
+    }
+
+    // RFC 1624: HC' = ~(~HC + ~m + m'), the 16-bit word holding the TTL goes from m to m'
+    static inline void decrement_ttl(rte_ipv4_hdr* ip)
+    {
+        uint16_t old_word = (uint16_t)ip->time_to_live << 8 | ip->next_proto_id;
+        ip->time_to_live--;
+        uint16_t new_word = old_word - 0x0100;
+
+        uint32_t sum = (uint16_t)~rte_be_to_cpu_16(ip->hdr_checksum) + (uint16_t)~old_word + new_word;
+        sum = (sum & 0xFFFF) + (sum >> 16);
+        sum = (sum & 0xFFFF) + (sum >> 16);
+        ip->hdr_checksum = rte_cpu_to_be_16((uint16_t)~sum);
+    }
+
+public:
+
+    // Load the routes and create the shared LPM table on the port's socket, rte_exit on any error
+    static void init(const std::string& route_file, uint16_t port_id)
+    {
+        std::vector<_route> routes;
+        if (route_file.empty()) {
+            routes.push_back({0, 0, REFLECT});
+        } else {
+            std::ifstream in(route_file);
+            if (!in)
+                rte_exit(EXIT_FAILURE, "L3FWD: cannot open route file %s\n", route_file.c_str());
+            std::string line;
+            uint64_t line_no = 0;
+            while (std::getline(in, line)) {
+                line_no++;
+                line = line.substr(0, line.find('#'));
+                if (line.find_first_not_of(" \t\r") == std::string::npos)
+                    continue;
+                _route r;
+                if (!parse_route(line, &r))
+                    rte_exit(EXIT_FAILURE, "L3FWD: %s:%lu, should be <a.b.c.d>/<len> <MAC|reflect>\n", route_file.c_str(), line_no);
+                routes.push_back(r);
+            }
+            if (routes.empty())
+                rte_exit(EXIT_FAILURE, "L3FWD: no route in %s\n", route_file.c_str());
+        }
+
+        port = port_id;
+        if (rte_eth_macaddr_get(port, &port_mac) != 0)
+            rte_exit(EXIT_FAILURE, "L3FWD: cannot get the MAC of port %u\n", port);
+
+        //Every route longer than /24 takes a tbl8 group
+        struct rte_lpm_config config;
+        memset(&config, 0, sizeof(config));
+        config.max_rules = routes.size();
+        config.number_tbl8s = std::max<uint32_t>(MIN_TBL8S, routes.size());
+        lpm = rte_lpm_create("L3FWD_LPM", rte_eth_dev_socket_id(port), &config);
+        if (lpm == nullptr)
+            rte_exit(EXIT_FAILURE, "L3FWD: cannot create the LPM table, Errno: %s\n", rte_strerror(rte_errno));
+
+        for (const _route& r : routes) {
+            if (rte_lpm_add(lpm, r.ip, r.depth, r.hop) != 0)
+                rte_exit(EXIT_FAILURE, "L3FWD: cannot add route %u.%u.%u.%u/%u\n",
+                    r.ip >> 24, (r.ip >> 16) & 0xFF, (r.ip >> 8) & 0xFF, r.ip & 0xFF, r.depth);
+        }
+        printf("L3FWD: %lu routes, %lu next hops\n", routes.size(), next_hops.size());
+    }
+
+    L3fwdApp(uint16_t queue): queue(queue)
+    {
+        tx_buffer = (rte_eth_dev_tx_buffer*)rte_zmalloc_socket("L3FWD_TX_BUFFER",
+            RTE_ETH_TX_BUFFER_SIZE(TX_BUFFER_SIZE), 0, rte_eth_dev_socket_id(port));
+        if (tx_buffer == nullptr)
+            rte_exit(EXIT_FAILURE, "L3FWD: cannot allocate the TX buffer of queue %u\n", queue);
+        rte_eth_tx_buffer_init(tx_buffer, TX_BUFFER_SIZE);
+        //A full TX ring frees the unsent mbufs and counts them, it never stalls the lcore
+        rte_eth_tx_buffer_set_err_callback(tx_buffer, rte_eth_tx_buffer_count_callback, &num_tx_dropped);
+        instances.push_back(this);
+    }
+
+    ~L3fwdApp() {
+        rte_free(tx_buffer);
+    }
+
+    // Single packets have nowhere to go, run_burst is the data path
+    void run(char* pkt_ptr, size_t len) override {}
+
+    uint64_t run_burst(rte_mbuf** pkts, uint64_t nb_pkts) override
+    {
+        uint32_t dst_ips[MAX_BURST];
+        uint32_t hops[MAX_BURST];
+        uint64_t nb_left = 0;
+        assert(nb_pkts <= MAX_BURST);
+
+        for (uint64_t i = 0; i < nb_pkts; i++) {
+            rte_ipv4_hdr* ip = rte_pktmbuf_mtod_offset(pkts[i], rte_ipv4_hdr*, sizeof(rte_ether_hdr));
+            dst_ips[i] = rte_be_to_cpu_32(ip->dst_addr);
+        }
+        rte_lpm_lookup_bulk(lpm, dst_ips, hops, nb_pkts);
+
+        for (uint64_t i = 0; i < nb_pkts; i++) {
+            rte_mbuf* m = pkts[i];
+            rte_ether_hdr* eth = rte_pktmbuf_mtod(m, rte_ether_hdr*);
+            rte_ipv4_hdr* ip = (rte_ipv4_hdr*)(eth + 1);
+
+            if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)) {
+                num_not_ipv4++;
+                pkts[nb_left++] = m;
+                continue;
+            }
+            if (!(hops[i] & RTE_LPM_LOOKUP_SUCCESS)) {
+                num_no_route++;
+                pkts[nb_left++] = m;
+                continue;
+            }
+            if (ip->time_to_live <= 1) {
+                num_ttl_expired++;
+                pkts[nb_left++] = m;
+                continue;
+            }
+
+            uint32_t hop = hops[i] & ~RTE_LPM_LOOKUP_SUCCESS;
+            if (hop == REFLECT)
+                rte_ether_addr_copy(&eth->src_addr, &eth->dst_addr);
+            else
+                rte_ether_addr_copy(&next_hops[hop], &eth->dst_addr);
+            rte_ether_addr_copy(&port_mac, &eth->src_addr);
+            decrement_ttl(ip);
+
+            rte_eth_tx_buffer(port, queue, tx_buffer, m);
+            num_forwarded++;
+        }
+        rte_eth_tx_buffer_flush(port, queue, tx_buffer);
+        return nb_left;
+    }
+
+    std::string print_stats() override {
+        uint64_t forwarded = 0, no_route = 0, ttl_expired = 0, not_ipv4 = 0, tx_dropped = 0;
+        for (L3fwdApp* app : instances) {
+            forwarded += app->num_forwarded;
+            no_route += app->num_no_route;
+            ttl_expired += app->num_ttl_expired;
+            not_ipv4 += app->num_not_ipv4;
+            tx_dropped += app->num_tx_dropped;
+        }
+
+        std::ostringstream out;
+        out << "============ L3FWD APP STATS ============\n"
+            << "Lcores: " << instances.size() << " -- Next Hops: " << next_hops.size() << "\n"
+            << "Forwarded: " << forwarded
+            << " -- TX Dropped: " << tx_dropped
+            << " -- No Route: " << no_route
+            << " -- TTL Expired: " << ttl_expired
+            << " -- Not IPv4: " << not_ipv4 << "\n";
+        return out.str();
+    }
+};
+
+
+} // namespace dpdk_apps
+#endif /* L3FWD_APP_H */
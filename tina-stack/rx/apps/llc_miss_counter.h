@@ -0,0 +1,104 @@
+#ifndef LLC_MISS_COUNTER_H
+#define LLC_MISS_COUNTER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+
+namespace dpdk_apps{
+
+/**
+ * Last-level cache misses of the calling thread, read with rdpmc from user space.
+ * perf_event_open programs the counter and keeps it across context switches, the mmap'd control
+ * page gives the hardware counter index and the offset to add; reading costs a few ns, so it can
+ * bracket every stage of every burst. Needs perf_event_paranoid <= 2 (user-space only counting)
+ * and rdpmc enabled (/sys/devices/cpu/rdpmc = 1 or 2), otherwise the counter stays disabled
+ * and reads 0.
+ *
+ * Open it from the thread to be measured, the event follows that thread only.
+ */
+class LlcMissCounter {
+
+private:
+    int fd = -1;
+    perf_event_mmap_page* page = nullptr;
+
+    static inline uint64_t rdpmc(uint32_t counter) {
+        uint32_t lo, hi;
+        __asm__ volatile("rdpmc" : "=a" (lo), "=d" (hi) : "c" (counter));
+        return (uint64_t)hi << 32 | lo;
+    }
+
+public:
+    LlcMissCounter() {}
+    LlcMissCounter(const LlcMissCounter&) = delete;
+    LlcMissCounter& operator=(const LlcMissCounter&) = delete;
+    ~LlcMissCounter() { close(); }
+
+    bool open() {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd < 0)
+            return false;
+        void* p = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            close();
+            return false;
+        }
+        page = (perf_event_mmap_page*)p;
+        if (!page->cap_user_rdpmc) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (page)
+            munmap(page, sysconf(_SC_PAGESIZE));
+        if (fd >= 0)
+            ::close(fd);
+        page = nullptr;
+        fd = -1;
+    }
+
+    bool enabled() const { return page != nullptr; }
+
+    // Seqlock read of the control page, see include/uapi/linux/perf_event.h
+    inline uint64_t read() const {
+        if (!page)
+            return 0;
+        uint32_t seq;
+        uint64_t count;
+        do {
+            seq = page->lock;
+            __asm__ volatile("" ::: "memory");
+            uint32_t idx = page->index;
+            count = page->offset;
+            if (idx) {
+                uint32_t width = page->pmc_width;
+                int64_t pmc = rdpmc(idx - 1);
+                pmc <<= 64 - width;
+                pmc >>= 64 - width;
+                count += pmc;
+            }
+            __asm__ volatile("" ::: "memory");
+        } while (page->lock != seq);
+        return count;
+    }
+};
+
+} // namespace dpdk_apps
+
+#endif /* LLC_MISS_COUNTER_H */
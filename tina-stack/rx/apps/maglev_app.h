@@ -0,0 +1,381 @@
+#ifndef MAGLEV_APP_H
+#define MAGLEV_APP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <rte_eal.h>
+#include <rte_ip.h>
+#include <rte_udp.h>
+#include <rte_cycles.h>
+#include <rte_pause.h>
+
+#include "base_app.h"
+#include "numa_mem.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * L4 load balancer with Maglev consistent hashing (Eisenbud et al., NSDI'16).
+ *  - The lookup table (M slots, M prime) maps a flow hash to a backend, it is rebuilt from the
+ *    backend set and read by every lcore: the large, read-mostly working set
+ *  - A per-lcore direct-mapped connection table keeps established flows on their backend across rebuilds
+ *  - Forwarded packets get their destination rewritten to the backend, IPv4 and UDP checksums updated
+ *
+ * Backends are a file with one IPv4 address per line ('#' comments), or synthetic:<n> for 10.1.0.0/16.
+ * The main lcore polls the file mtime every monitor interval (reload_if_changed()) and rebuilds into
+ * the spare table, then flips the active one. Lcores pick the active table up at their next burst.
+ * After the flip the main lcore waits for the bursts in flight to end (an odd burst_epoch), so the
+ * next rebuild never rewrites a table an lcore still reads. The data path itself never waits.
+ */
+class MaglevApp: public BaseApp {
+
+private:
+    static constexpr uint64_t DEFAULT_TABLE_SIZE = 65537;
+    static constexpr uint32_t MAX_BACKENDS = 4096;
+    static constexpr uint32_t INVALID_BACKEND = UINT32_MAX;
+    static constexpr uint64_t CONN_TABLE_SIZE = 1 << 16;       // Per lcore, direct mapped
+
+    //*** Backends are never removed from the registry, only marked dead, so ids stay valid in the connection tables */
+    struct _backend {
+        uint32_t ip;                        // Network order
+        std::atomic<bool> alive;
+    };
+
+    struct _lookup_table {
+        numa_vector<uint32_t> slots;        // Backend ids
+        uint32_t num_backends = 0;
+    };
+
+    struct _conn_entry {
+        uint64_t key;                       // Flow hash, 0 = empty
+        uint32_t backend;
+        uint32_t pad;
+    };
+
+    static _backend backends[MAX_BACKENDS];
+    static uint32_t num_registered;
+    static _lookup_table tables[2];
+    static std::atomic<uint32_t> active;
+    static uint64_t table_size;
+    static std::string backend_spec;
+    static time_t backend_mtime;
+    static uint64_t num_rebuilds;
+    static std::vector<MaglevApp*> instances;
+
+    numa_vector<_conn_entry> conns;
+    std::atomic<uint64_t> burst_epoch{0};      // Odd while a burst is being forwarded
+
+    uint64_t num_pkts = 0;
+    uint64_t num_conn_hits = 0;
+    uint64_t num_conn_misses = 0;
+    uint64_t num_conn_dead = 0;             // Affinity broken because the backend went away
+    uint64_t num_no_backend = 0;
+    uint64_t backend_pkts[MAX_BACKENDS] = {0};
+
+    static inline uint64_t mix64(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static inline uint64_t flow_hash(const rte_ipv4_hdr* ip, const rte_udp_hdr* udp) {
+        uint64_t h = mix64(((uint64_t)ip->src_addr << 32 | ip->dst_addr) ^ 0x9E3779B97F4A7C15ULL);
+        h = mix64(h ^ ((uint64_t)udp->src_port << 32 | (uint64_t)udp->dst_port << 16 | ip->next_proto_id));
+        return h | 1;                       // Never 0, the empty connection key
+    }
+
+    // RFC 1624 for a 32-bit field, both halves folded into the checksum
+    static inline uint16_t csum_replace4(uint16_t csum, uint32_t old_val, uint32_t new_val) {
+        uint32_t sum = (uint16_t)~rte_be_to_cpu_16(csum);
+        sum += (uint16_t)~rte_be_to_cpu_16(old_val >> 16) + (uint16_t)~rte_be_to_cpu_16(old_val & 0xFFFF);
+        sum += rte_be_to_cpu_16(new_val >> 16) + rte_be_to_cpu_16(new_val & 0xFFFF);
+        sum = (sum & 0xFFFF) + (sum >> 16);
+        sum = (sum & 0xFFFF) + (sum >> 16);
+        return rte_cpu_to_be_16((uint16_t)~sum);
+    }
+
+    static bool is_prime(uint64_t n) {
+        if (n < 2)
+            return false;
+        for (uint64_t d = 2; d * d <= n; d++)
+            if (n % d == 0)
+                return false;
+        return true;
+    }
+
+    static bool load_backends(std::vector<uint32_t>* ips)
+    {
+        if (backend_spec.compare(0, 10, "synthetic:") == 0) {
+            uint64_t n = strtoul(backend_spec.c_str() + 10, nullptr, 10);
+            for (uint64_t i = 0; i < n; i++)
+                ips->push_back(rte_cpu_to_be_32(RTE_IPV4(10, 1, (i >> 8) & 0xFF, i & 0xFF)));
+            return !ips->empty() && n <= MAX_BACKENDS;
+        }
+
+        std::ifstream in(backend_spec);
+        if (!in)
+            return false;
+        std::string line;
+        while (std::getline(in, line)) {
+            line = line.substr(0, line.find('#'));
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            unsigned a, b, c, d;
+            if (sscanf(line.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+                fprintf(stderr, "Maglev: bad backend \"%s\" in %s\n", line.c_str(), backend_spec.c_str());
+                return false;
+            }
+            ips->push_back(rte_cpu_to_be_32(RTE_IPV4(a, b, c, d)));
+        }
+        return !ips->empty();
+    }
+
+    static uint32_t register_backend(uint32_t ip)
+    {
+        for (uint32_t id = 0; id < num_registered; id++)
+            if (backends[id].ip == ip)
+                return id;
+        if (num_registered == MAX_BACKENDS)
+            return INVALID_BACKEND;
+        backends[num_registered].ip = ip;
+        backends[num_registered].alive = false;
+        return num_registered++;
+    }
+
+    // Maglev population: every backend walks its own permutation of the slots, taking turns
+    static void populate(_lookup_table& table, const std::vector<uint32_t>& ids)
+    {
+        uint64_t n = ids.size();
+        std::vector<uint64_t> offset(n), skip(n), next(n, 0);
+        for (uint64_t i = 0; i < n; i++) {
+            uint64_t ip = backends[ids[i]].ip;
+            offset[i] = mix64(ip ^ 0x6F6666736574ULL) % table_size;
+            skip[i] = mix64(ip ^ 0x736B6970ULL) % (table_size - 1) + 1;
+        }
+
+        std::fill(table.slots.begin(), table.slots.end(), INVALID_BACKEND);
+        if (n == 0)
+            return;
+        uint64_t filled = 0;
+        while (true) {
+            for (uint64_t i = 0; i < n; i++) {
+                uint64_t c = (offset[i] + next[i] * skip[i]) % table_size;
+                while (table.slots[c] != INVALID_BACKEND) {
+                    next[i]++;
+                    c = (offset[i] + next[i] * skip[i]) % table_size;
+                }
+                table.slots[c] = ids[i];
+                next[i]++;
+                if (++filled == table_size)
+                    return;
+            }
+        }
+    }
+
+    // Build the backend set into the spare table, flip, then wait until no lcore reads the old one
+    static void rebuild(const std::vector<uint32_t>& ips)
+    {
+        std::vector<uint32_t> ids;
+        for (uint32_t ip : ips) {
+            uint32_t id = register_backend(ip);
+            if (id == INVALID_BACKEND) {
+                fprintf(stderr, "Maglev: more than %u backends ever registered, ignoring the rest\n", MAX_BACKENDS);
+                break;
+            }
+            if (std::find(ids.begin(), ids.end(), id) == ids.end())
+                ids.push_back(id);
+        }
+
+        uint32_t spare = active.load(std::memory_order_relaxed) ^ 1;
+        populate(tables[spare], ids);
+        tables[spare].num_backends = ids.size();
+
+        //Flows pinned to a removed backend re-hash from the flip on
+        active.store(spare);
+        for (uint32_t id = 0; id < num_registered; id++)
+            backends[id].alive.store(std::find(ids.begin(), ids.end(), id) != ids.end(), std::memory_order_relaxed);
+        num_rebuilds++;
+
+        for (MaglevApp* app : instances) {
+            uint64_t epoch = app->burst_epoch.load();
+            if (epoch & 1)
+                while (app->burst_epoch.load() == epoch)
+                    rte_pause();
+        }
+    }
+
+public:
+
+    // Size and fill the first table, rte_exit on a bad backend set
+    static void init(const std::string& spec, uint64_t requested_size)
+    {
+        backend_spec = spec;
+        table_size = requested_size ? requested_size : DEFAULT_TABLE_SIZE;
+        while (!is_prime(table_size))
+            table_size++;
+
+        std::vector<uint32_t> ips;
+        if (!load_backends(&ips))
+            rte_exit(EXIT_FAILURE, "Maglev: cannot load backends from %s, should be a file of IPv4 addresses or synthetic:<n>\n", spec.c_str());
+        if (table_size < ips.size() * 10)
+            fprintf(stderr, "WARNING, Maglev table size %lu is small for %lu backends, the load will be uneven\n", table_size, ips.size());
+
+        struct stat st;
+        backend_mtime = (stat(spec.c_str(), &st) == 0) ? st.st_mtime : 0;
+
+        tables[0].slots.resize(table_size);
+        tables[1].slots.resize(table_size);
+        active = 1;                         // So the first rebuild fills table 0
+        rebuild(ips);
+        printf("Maglev: %u backends, table size %lu (%lu KB)\n", tables[active].num_backends, table_size,
+            table_size * sizeof(uint32_t) >> 10);
+    }
+
+    // Main lcore, once per monitor interval
+    static void reload_if_changed()
+    {
+        struct stat st;
+        if (backend_mtime == 0 || stat(backend_spec.c_str(), &st) != 0 || st.st_mtime == backend_mtime)
+            return;
+
+        std::vector<uint32_t> ips;
+        if (!load_backends(&ips)) {
+            fprintf(stderr, "Maglev: keeping the current backends, %s is not valid\n", backend_spec.c_str());
+            backend_mtime = st.st_mtime;
+            return;
+        }
+        rebuild(ips);
+        backend_mtime = st.st_mtime;
+        printf("Maglev: rebuilt for %u backends (rebuild %lu)\n", tables[active].num_backends, num_rebuilds);
+    }
+
+    MaglevApp(): conns(CONN_TABLE_SIZE) {
+        for (_conn_entry& e : conns)
+            e.key = 0;
+        instances.push_back(this);
+    }
+    ~MaglevApp() {}
+
+    void run(char* pkt_ptr, size_t len) override {
+        burst_epoch.fetch_add(1);
+        forward(tables[active.load()], (rte_ipv4_hdr*)(pkt_ptr + sizeof(rte_ether_hdr)));
+        burst_epoch.fetch_add(1, std::memory_order_release);
+    }
+
+    uint64_t run_burst(rte_mbuf** pkts, uint64_t nb_pkts) override
+    {
+        //Mark the burst in flight before picking the table, rebuild() waits on it after a flip
+        burst_epoch.fetch_add(1);
+        const _lookup_table& table = tables[active.load()];
+        for (uint64_t i = 0; i < nb_pkts; i++)
+            forward(table, rte_pktmbuf_mtod_offset(pkts[i], rte_ipv4_hdr*, sizeof(rte_ether_hdr)));
+        burst_epoch.fetch_add(1, std::memory_order_release);
+        return nb_pkts;
+    }
+
+    std::string print_interval_stats() override {
+        uint64_t hits = 0, misses = 0;
+        for (MaglevApp* app : instances) {
+            hits += app->num_conn_hits;
+            misses += app->num_conn_misses;
+        }
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << "Maglev backends: " << tables[active.load()].num_backends
+            << " -- rebuilds: " << num_rebuilds
+            << " -- conn hit rate: " << (hits + misses ? hits * 100.0 / (hits + misses) : 0.0) << "%";
+        return out.str();
+    }
+
+    std::string print_stats() override {
+        uint64_t pkts = 0, hits = 0, misses = 0, dead = 0, no_backend = 0;
+        std::vector<uint64_t> per_backend(num_registered, 0);
+        for (MaglevApp* app : instances) {
+            pkts += app->num_pkts;
+            hits += app->num_conn_hits;
+            misses += app->num_conn_misses;
+            dead += app->num_conn_dead;
+            no_backend += app->num_no_backend;
+            for (uint32_t id = 0; id < num_registered; id++)
+                per_backend[id] += app->backend_pkts[id];
+        }
+
+        uint64_t min_pkts = UINT64_MAX, max_pkts = 0, alive = 0;
+        for (uint32_t id = 0; id < num_registered; id++) {
+            if (!backends[id].alive)
+                continue;
+            alive++;
+            min_pkts = std::min(min_pkts, per_backend[id]);
+            max_pkts = std::max(max_pkts, per_backend[id]);
+        }
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << "============ MAGLEV APP STATS ============\n"
+            << "Backends: " << alive << " alive, " << num_registered << " ever registered -- Table Size: " << table_size
+            << " -- Rebuilds: " << num_rebuilds << "\n"
+            << "Packets: " << pkts
+            << " -- Conn Hits: " << hits
+            << " -- Conn Misses: " << misses
+            << " -- Affinity Broken: " << dead
+            << " -- No Backend: " << no_backend << "\n"
+            << "Packets per Alive Backend -- min: " << (alive ? min_pkts : 0) << " -- max: " << max_pkts
+            << " -- mean: " << (alive ? (double)pkts / alive : 0.0) << "\n";
+        return out.str();
+    }
+
+private:
+
+    inline void forward(const _lookup_table& table, rte_ipv4_hdr* ip) {
+        rte_udp_hdr* udp = (rte_udp_hdr*)(ip + 1);
+        uint64_t key = flow_hash(ip, udp);
+        _conn_entry& conn = conns[key & (CONN_TABLE_SIZE - 1)];
+        num_pkts++;
+
+        uint32_t id;
+        if (conn.key == key && backends[conn.backend].alive.load(std::memory_order_relaxed)) {
+            id = conn.backend;
+            num_conn_hits++;
+        } else {
+            num_conn_dead += (conn.key == key);
+            num_conn_misses++;
+            id = table.slots[key % table_size];
+            if (id == INVALID_BACKEND) {
+                num_no_backend++;
+                return;
+            }
+            conn.key = key;
+            conn.backend = id;
+        }
+        backend_pkts[id]++;
+
+        uint32_t old_dst = ip->dst_addr;
+        uint32_t new_dst = backends[id].ip;
+        ip->dst_addr = new_dst;
+        ip->hdr_checksum = csum_replace4(ip->hdr_checksum, old_dst, new_dst);
+        if (ip->next_proto_id == IPPROTO_UDP && udp->dgram_cksum != 0) {
+            udp->dgram_cksum = csum_replace4(udp->dgram_cksum, old_dst, new_dst);
+            if (udp->dgram_cksum == 0)
+                udp->dgram_cksum = 0xFFFF;      //0 means no checksum for UDP
+        }
+    }
+};
+
+
+} // namespace dpdk_apps
+#endif /* MAGLEV_APP_H */
@@ -27,77 +27,290 @@
 #include <math.h>
 #include <stdint.h>
 #include <assert.h>
-#include "uthash.h"
+#include <vector>
+#include <sstream>
+#include <iomanip>
+
+#include <rte_cycles.h>
 
 #include "base_app.h"
+#include "timer_wheel.h"
+#include "numa_mem.h"
 #include "../../tx/dpdk_exp_pkt.h"
 
 
 namespace dpdk_apps{
 
+/**
+ * NAPT with connection tracking.
+ *  - One entry per 5-tuple, entries come from a pool preallocated at init, no malloc on the RX path
+ *  - Bucket array is sized at init as well, so the table never rehashes (uthash would stall on expand)
+ *  - Every entry sits in a hierarchical timer wheel, refreshing last_seen does NOT touch the wheel,
+ *    an expired entry that has been seen since is simply re-armed (lazy refresh)
+ *  - The wheel is advanced once per burst with a bounded eviction budget
+ *  - Each lcore's instance owns a slice of the external port range, so two lcores never hand out
+ *    the same external ip:port; a table larger than the slice spreads over more external IPs
+ */
 class NATApp: public BaseApp {
 
 private:
 
+    static constexpr uint32_t INVALID_IDX = UINT32_MAX;
+    static constexpr uint64_t DEFAULT_IDLE_TIMEOUT_MS = 30 * 1000;
+    static constexpr uint64_t TICK_US = 1000;                   // Wheel resolution
+    static constexpr size_t EVICT_BUDGET_PER_BURST = 64;
+
+    static constexpr uint32_t EXTERNAL_IP_BASE = 0x64400000;     // 100.64.0.0/10
+    static constexpr uint32_t EXTERNAL_PORT_BASE = 1024;
+    static constexpr uint32_t EXTERNAL_PORT_COUNT = 65536 - EXTERNAL_PORT_BASE;
+
+    struct _flow_key {
+        uint32_t src_ip;
+        uint32_t dst_ip;
+        uint16_t src_port;
+        uint16_t dst_port;
+        uint32_t proto;         //Padded to 16B so that memcmp/hash never sees garbage
+    };
+
     struct _nat_entry {
-        uint32_t internal_ip;
+        TimerNode timer;        //!Must be the first member, we cast TimerNode* back to _nat_entry*
+        _flow_key key;
         uint32_t external_ip;
-        UT_hash_handle hh;
+        uint16_t external_port;
+        uint32_t hash_next;     //Bucket chain, index into entries
+        uint64_t last_seen;     //TSC
     };
 
-    struct _nat_entry *mydb = nullptr;
+    //*** Sized once at init, placed by the app memory policy */
+    numa_vector<_nat_entry> entries;
+    numa_vector<uint32_t> buckets;
+    uint64_t bucket_mask;
+    numa_vector<uint32_t> free_list;
+
+    TimerWheel<4, 8> wheel;
+    uint64_t tick_cycles;
+    uint64_t idle_timeout_cycles;
+    uint64_t idle_timeout_ticks;
+
     uint64_t num_records;
+    uint32_t port_first;        // External port slice of this instance
+    uint32_t port_count;
+    uint64_t active_flows = 0;
 
     uint64_t num_hits = 0;
     uint64_t num_misses = 0;
+    uint64_t num_created = 0;
+    uint64_t num_evicted = 0;
+    uint64_t num_rearmed = 0;
+    uint64_t num_table_full = 0;
 
-public:
+    static std::vector<NATApp*> instances;
 
-    NATApp(uint64_t num_records): num_records(num_records)
-    {
-        struct _nat_entry *entry;
-        printf("Size of each nat_entry: %lu, total datasize: %lu\n", 
-            sizeof(struct _nat_entry), num_records * sizeof(struct _nat_entry));
-
-        for(int i = 0; i < num_records; i++) {
-            entry = (struct _nat_entry*)malloc(sizeof(struct _nat_entry));
-            entry->internal_ip = rand() % 4294967295 + 1; // Random 32-bit integer
-            entry->external_ip = rand() % 4294967295 + 1; // Random 32-bit integer
-            HASH_ADD_INT(mydb, external_ip, entry);
+    //*** Snapshots of the summed counters for the monitor, interval rates */
+    static uint64_t num_created_snapshot;
+    static uint64_t num_evicted_snapshot;
+    static uint64_t snapshot_tsc;
+
+    struct _totals {
+        uint64_t records = 0, active_flows = 0, armed = 0;
+        uint64_t hits = 0, misses = 0, created = 0, evicted = 0, rearmed = 0, table_full = 0;
+    };
+
+    static _totals totals() {
+        _totals t;
+        for (NATApp* app : instances) {
+            t.records += app->num_records;
+            t.active_flows += app->active_flows;
+            t.armed += app->wheel.size();
+            t.hits += app->num_hits;
+            t.misses += app->num_misses;
+            t.created += app->num_created;
+            t.evicted += app->num_evicted;
+            t.rearmed += app->num_rearmed;
+            t.table_full += app->num_table_full;
         }
+        return t;
     }
 
-    ~NATApp() {
-        struct _nat_entry *current_entry, *tmp;
+    static inline uint32_t hash_key(const _flow_key& key) {
+        uint64_t h = ((uint64_t)key.src_ip << 32 | key.dst_ip) * 0x9E3779B97F4A7C15ULL;
+        h ^= ((uint64_t)key.src_port << 32 | (uint64_t)key.dst_port << 16 | key.proto) * 0xC2B2AE3D27D4EB4FULL;
+        return (uint32_t)(h ^ (h >> 29));
+    }
+
+    static inline bool key_equal(const _flow_key& a, const _flow_key& b) {
+        return memcmp(&a, &b, sizeof(_flow_key)) == 0;
+    }
 
-        HASH_ITER(hh, mydb, current_entry, tmp) {
-            HASH_DEL(mydb, current_entry);
-            free(current_entry);
+    uint32_t lookup(const _flow_key& key, uint32_t hash) {
+        uint32_t idx = buckets[hash & bucket_mask];
+        while (idx != INVALID_IDX) {
+            if (key_equal(entries[idx].key, key))
+                return idx;
+            idx = entries[idx].hash_next;
         }
+        return INVALID_IDX;
     }
 
-    void run(char* pkt_ptr, size_t len) override {
+    void unlink_from_bucket(uint32_t idx) {
+        uint32_t* link = &buckets[hash_key(entries[idx].key) & bucket_mask];
+        while (*link != idx) {
+            assert(*link != INVALID_IDX && "NAT entry is not in its bucket");
+            link = &entries[*link].hash_next;
+        }
+        *link = entries[idx].hash_next;
+        entries[idx].hash_next = INVALID_IDX;
+    }
 
+    uint32_t create(const _flow_key& key, uint32_t hash, uint64_t now) {
+        if (free_list.empty()) {
+            num_table_full++;
+            return INVALID_IDX;
+        }
+        uint32_t idx = free_list.back();
+        free_list.pop_back();
+
+        _nat_entry& e = entries[idx];
+        e.key = key;
+        e.external_ip = rte_cpu_to_be_32(EXTERNAL_IP_BASE + idx / port_count);
+        e.external_port = rte_cpu_to_be_16(port_first + idx % port_count);
+        e.last_seen = now;
+        e.hash_next = buckets[hash & bucket_mask];
+        buckets[hash & bucket_mask] = idx;
+        wheel.schedule(&e.timer, now / tick_cycles + idle_timeout_ticks);
 
-        struct _nat_entry *entry;
-        dpdk_exp_pkt *pkt = (dpdk_exp_pkt*)pkt_ptr;
+        active_flows++;
+        num_created++;
+        return idx;
+    }
 
-        uint32_t external_ip = pkt->ipv4_hdr.src_addr;
+    void on_timer_expire(TimerNode* node, uint64_t now) {
+        _nat_entry* e = reinterpret_cast<_nat_entry*>(node);
+        uint64_t idle_until = e->last_seen + idle_timeout_cycles;
+        if (idle_until > now) {
+            //Seen since it was armed, re-arm on its real deadline
+            wheel.schedule(&e->timer, idle_until / tick_cycles);
+            num_rearmed++;
+            return;
+        }
+        uint32_t idx = (uint32_t)(e - entries.data());
+        unlink_from_bucket(idx);
+        free_list.push_back(idx);
+        active_flows--;
+        num_evicted++;
+    }
 
-        HASH_FIND_INT(mydb, &external_ip, entry);
+    void translate(dpdk_exp_pkt* pkt, uint64_t now) {
+        _flow_key key;
+        key.src_ip = pkt->ipv4_hdr.src_addr;
+        key.dst_ip = pkt->ipv4_hdr.dst_addr;
+        key.src_port = pkt->udp_hdr.src_port;
+        key.dst_port = pkt->udp_hdr.dst_port;
+        key.proto = pkt->ipv4_hdr.next_proto_id;
 
-        if (entry) {
-            pkt->ipv4_hdr.src_addr = entry->internal_ip;
+        uint32_t hash = hash_key(key);
+        uint32_t idx = lookup(key, hash);
+        if (idx != INVALID_IDX) {
             num_hits++;
+            entries[idx].last_seen = now;
         } else {
             num_misses++;
+            idx = create(key, hash, now);
+            if (idx == INVALID_IDX)
+                return;
         }
 
+        pkt->ipv4_hdr.src_addr = entries[idx].external_ip;
+        pkt->udp_hdr.src_port = entries[idx].external_port;
+    }
+
+public:
+
+    /**
+     * num_records:     maximum number of tracked flows (entry pool size)
+     * idle_timeout_ms: a flow not seen for this long gets evicted, 0 for default
+     * slice/num_slices: this instance's share of the external ports, one slice per lcore of the tenant
+     */
+    NATApp(uint64_t num_records, uint64_t idle_timeout_ms = 0, uint64_t slice = 0, uint64_t num_slices = 1):
+        entries(num_records),
+        buckets(rte_align64pow2(num_records == 0 ? 1 : num_records), INVALID_IDX),
+        wheel(rte_get_tsc_cycles() / (rte_get_tsc_hz() / (1000000 / TICK_US))),
+        num_records(num_records),
+        port_first(EXTERNAL_PORT_BASE + slice * (EXTERNAL_PORT_COUNT / num_slices)),
+        port_count(EXTERNAL_PORT_COUNT / num_slices)
+    {
+        assert(num_records != 0 && num_records < INVALID_IDX && "NAT needs a positive flow table size");
+        assert(slice < num_slices && num_slices <= EXTERNAL_PORT_COUNT);
+        if ((num_records + port_count - 1) / port_count > (1U << 22))
+            rte_exit(EXIT_FAILURE, "NAT: %lu flows over %u ports per lcore run out of 100.64.0.0/10\n", num_records, port_count);
+        bucket_mask = buckets.size() - 1;
+
+        if (idle_timeout_ms == 0)
+            idle_timeout_ms = DEFAULT_IDLE_TIMEOUT_MS;
+        tick_cycles = rte_get_tsc_hz() / (1000000 / TICK_US);
+        idle_timeout_cycles = idle_timeout_ms * (rte_get_tsc_hz() / 1000);
+        idle_timeout_ticks = idle_timeout_cycles / tick_cycles;
+
+        //Touch everything once so that the first packets don't pay the page faults
+        free_list.reserve(num_records);
+        for (uint64_t i = 0; i < num_records; i++) {
+            entries[i].hash_next = INVALID_IDX;
+            free_list.push_back(num_records - 1 - i);
+        }
+        snapshot_tsc = rte_get_tsc_cycles();
+        instances.push_back(this);
+
+        printf("Size of each nat_entry: %lu, total datasize: %lu, buckets: %lu, idle timeout: %lu ms, external ports %u-%u\n",
+            sizeof(struct _nat_entry), num_records * sizeof(struct _nat_entry), buckets.size(), idle_timeout_ms,
+            port_first, port_first + port_count - 1);
+    }
+
+    ~NATApp() {}
+
+    void run(char* pkt_ptr, size_t len) override {
+        translate((dpdk_exp_pkt*)pkt_ptr, rte_get_tsc_cycles());
+    }
+
+    uint64_t run_burst(rte_mbuf** pkts, uint64_t nb_pkts) override {
+        uint64_t now = rte_get_tsc_cycles();
+
+        //*** Bounded reclamation first, so a full table can make room for this burst */
+        wheel.advance(now / tick_cycles, EVICT_BUDGET_PER_BURST,
+            [this, now](TimerNode* node) { on_timer_expire(node, now); });
+
+        for (uint64_t i = 0; i < nb_pkts; i++)
+            translate(rte_pktmbuf_mtod(pkts[i], dpdk_exp_pkt*), now);
+        return nb_pkts;
+    }
+
+    std::string print_interval_stats() override {
+        uint64_t now = rte_get_tsc_cycles();
+        double seconds = (double)(now - snapshot_tsc) / rte_get_tsc_hz();
+        _totals t = totals();
+
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(2)
+            << "NAT flows: " << t.active_flows << "/" << t.records
+            << " (" << (t.active_flows * 100.0 / t.records) << "%)"
+            << " -- created/s: " << (seconds > 0 ? (t.created - num_created_snapshot) / seconds : 0.0)
+            << " -- evicted/s: " << (seconds > 0 ? (t.evicted - num_evicted_snapshot) / seconds : 0.0)
+            << " -- table full: " << t.table_full;
+
+        num_created_snapshot = t.created;
+        num_evicted_snapshot = t.evicted;
+        snapshot_tsc = now;
+        return oss.str();
     }
 
     std::string print_stats() override {
+        _totals t = totals();
         std::ostringstream oss;
-        oss << "============ NAT APP STATS ============\n" << "Hits: " << num_hits << " Misses: " << num_misses << "\n";
+        oss << "============ NAT APP STATS ============\n"
+            << "Lcores: " << instances.size() << "\n"
+            << "Hits: " << t.hits << " Misses: " << t.misses << "\n"
+            << "Active Flows: " << t.active_flows << "/" << t.records << " Timers Armed: " << t.armed << "\n"
+            << "Created: " << t.created << " Evicted: " << t.evicted << " Re-armed: " << t.rearmed
+            << " Table Full: " << t.table_full << "\n";
         return  oss.str();
     }
 };
@@ -107,4 +320,3 @@ public:
 
 #pragma GCC diagnostic pop
 #endif /* NAT_APP_H */
-
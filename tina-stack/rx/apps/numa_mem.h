@@ -0,0 +1,329 @@
+#ifndef NUMA_MEM_H
+#define NUMA_MEM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <numaif.h>
+#include <numa.h>
+#include <linux/mman.h>
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <rte_lcore.h>
+
+
+namespace dpdk_apps{
+
+static constexpr int NUMA_NODE_ANY = -1;
+
+/**
+ * Placement of app state (indexes, tables, pools), set once from the command line (-m):
+ *
+ *   default                        first touch on base pages, what the heap would do
+ *   local                          node of the first RX lcore
+ *   bind:<node>                    one given node
+ *   interleave[:<node>,<node>...]  page-interleaved, by default over every node with CPUs (the SNC nodes)
+ *   far                            the far tier, the highest node without CPUs (CXL), else the highest node
+ *
+ * followed by an optional "+2m" or "+1g" to back the mappings with hugetlb pages of that size.
+ * A hugepage mapping that can't be satisfied falls back to base pages with a warning.
+ * An explicit node given to an app (e.g. KNN grid:<node>) takes precedence over the policy.
+ */
+enum MemPolicy {
+    MEM_DEFAULT = 0,
+    MEM_LOCAL = 1,
+    MEM_BIND = 2,
+    MEM_INTERLEAVE = 3,
+    MEM_FAR = 4,
+
+    _MemPolicyCount
+};
+
+struct MemPlacement {
+    MemPolicy policy = MEM_DEFAULT;
+    int node = NUMA_NODE_ANY;               // MEM_BIND
+    unsigned long interleave_mask = 0;      // MEM_INTERLEAVE, 0 = every node with CPUs
+    size_t page_size = 0;                   // 0 = base pages, else the hugetlb page size
+};
+
+inline MemPlacement app_mem_placement;
+
+inline bool parse_mem_placement(const std::string& spec, MemPlacement* p)
+{
+    std::string policy = spec;
+    p->page_size = 0;
+    size_t plus = spec.find('+');
+    if (plus != std::string::npos) {
+        std::string pages = spec.substr(plus + 1);
+        policy = spec.substr(0, plus);
+        if (pages == "2m")
+            p->page_size = 2UL << 20;
+        else if (pages == "1g")
+            p->page_size = 1UL << 30;
+        else
+            return false;
+    }
+
+    p->interleave_mask = 0;
+    if (policy == "default")
+        p->policy = MEM_DEFAULT;
+    else if (policy == "local")
+        p->policy = MEM_LOCAL;
+    else if (policy == "far")
+        p->policy = MEM_FAR;
+    else if (policy.compare(0, 5, "bind:") == 0) {
+        p->policy = MEM_BIND;
+        return sscanf(policy.c_str(), "bind:%d", &p->node) == 1 && p->node >= 0 && p->node < 64;
+    } else if (policy.compare(0, 10, "interleave") == 0) {
+        p->policy = MEM_INTERLEAVE;
+        if (policy == "interleave")
+            return true;
+        if (policy[10] != ':')
+            return false;
+        char* cur = &policy[11];
+        while (*cur) {
+            char* endptr;
+            long node = strtol(cur, &endptr, 10);
+            if (endptr == cur || node < 0 || node >= 64)
+                return false;
+            p->interleave_mask |= 1UL << node;
+            cur = (*endptr == ',') ? endptr + 1 : endptr;
+            if (*endptr != ',' && *endptr != '\0')
+                return false;
+        }
+        return p->interleave_mask != 0;
+    } else
+        return false;
+    return true;
+}
+
+// Nodes that have CPUs, i.e. DRAM (SNC) nodes rather than CPU-less memory expanders
+inline unsigned long cpu_nodes_mask()
+{
+    unsigned long mask = 0;
+    if (numa_available() < 0)
+        return 1;
+    struct bitmask* cpus = numa_allocate_cpumask();
+    for (int node = 0; node <= numa_max_node() && node < 64; node++) {
+        if (numa_node_to_cpus(node, cpus) == 0 && numa_bitmask_weight(cpus) > 0)
+            mask |= 1UL << node;
+    }
+    numa_free_cpumask(cpus);
+    return mask ? mask : 1;
+}
+
+inline int far_node()
+{
+    if (numa_available() < 0)
+        return 0;
+    unsigned long with_cpus = cpu_nodes_mask();
+    for (int node = std::min(numa_max_node(), 63); node >= 0; node--) {
+        if (!(with_cpus & (1UL << node)) && numa_bitmask_isbitset(numa_all_nodes_ptr, node))
+            return node;
+    }
+    return numa_max_node();
+}
+
+inline int local_node()
+{
+    unsigned lcore = rte_get_next_lcore(-1, 1, 0);
+    return (lcore < RTE_MAX_LCORE) ? (int)rte_lcore_to_socket_id(lcore) : 0;
+}
+
+// mbind() mode and node mask of a placement, false for MEM_DEFAULT (nothing to do)
+inline bool placement_mask(const MemPlacement& p, int* mode, unsigned long* mask)
+{
+    switch (p.policy) {
+        case MEM_LOCAL:         *mode = MPOL_BIND; *mask = 1UL << local_node(); return true;
+        case MEM_BIND:          *mode = MPOL_BIND; *mask = 1UL << p.node; return true;
+        case MEM_FAR:           *mode = MPOL_BIND; *mask = 1UL << far_node(); return true;
+        case MEM_INTERLEAVE:    *mode = MPOL_INTERLEAVE; *mask = p.interleave_mask ? p.interleave_mask : cpu_nodes_mask(); return true;
+        default:                return false;
+    }
+}
+
+inline std::string mem_placement_str(const MemPlacement& p)
+{
+    std::string s;
+    int mode;
+    unsigned long mask;
+    switch (p.policy) {
+        case MEM_DEFAULT:       s = "default (first touch)"; break;
+        case MEM_LOCAL:         s = "local"; break;
+        case MEM_BIND:          s = "bind"; break;
+        case MEM_INTERLEAVE:    s = "interleave"; break;
+        case MEM_FAR:           s = "far"; break;
+        default:                s = "unknown"; break;
+    }
+    if (p.policy != MEM_DEFAULT && placement_mask(p, &mode, &mask)) {
+        s += " (nodes";
+        for (int node = 0; node < 64; node++)
+            if (mask & (1UL << node))
+                s += " " + std::to_string(node);
+        s += ")";
+    }
+    s += (p.page_size == (1UL << 30)) ? ", 1GB pages" : (p.page_size ? ", 2MB pages" : ", 4KB pages");
+    return s;
+}
+
+/**
+ * Apply mode/mask to [addr, addr+len) and migrate whatever is already resident.
+ * !Page cache pages of a regular file are allocated with the *task* policy, not the vma policy,
+ * !so we also set the calling thread's policy while prefaulting. shmem/memfd/anonymous follow the vma policy.
+ */
+inline bool mbind_range(void* addr, size_t len, int mode, unsigned long nodemask, bool prefault)
+{
+    unsigned long maxnode = sizeof(nodemask) * 8;
+
+    if (mbind(addr, len, mode, &nodemask, maxnode, MPOL_MF_MOVE | (mode == MPOL_BIND ? MPOL_MF_STRICT : 0)) != 0) {
+        fprintf(stderr, "mbind to node mask 0x%lx failed: %s\n", nodemask, strerror(errno));
+        return false;
+    }
+
+    if (prefault) {
+        if (set_mempolicy(mode, &nodemask, maxnode) != 0)
+            fprintf(stderr, "set_mempolicy to node mask 0x%lx failed: %s\n", nodemask, strerror(errno));
+
+        volatile const char* p = (const char*)addr;
+        long page_size = sysconf(_SC_PAGESIZE);
+        for (size_t off = 0; off < len; off += page_size)
+            (void)p[off];
+
+        set_mempolicy(MPOL_DEFAULT, NULL, 0);
+    }
+    return true;
+}
+
+// Bind [addr, addr+len) to numa_node, NUMA_NODE_ANY leaves it alone
+inline bool bind_range_to_node(void* addr, size_t len, int numa_node, bool prefault)
+{
+    if (numa_node == NUMA_NODE_ANY)
+        return true;
+    return mbind_range(addr, len, MPOL_BIND, 1UL << numa_node, prefault);
+}
+
+// Place an existing mapping (e.g. a file mapping) according to p, MEM_DEFAULT leaves it alone
+inline bool place_range(void* addr, size_t len, const MemPlacement& p, bool prefault)
+{
+    int mode;
+    unsigned long mask;
+    if (!placement_mask(p, &mode, &mask))
+        return true;
+    return mbind_range(addr, len, mode, mask, prefault);
+}
+
+//*** Real length of every mapping, hugetlb mappings are rounded up and must be unmapped as such */
+struct _mapping_registry {
+    std::mutex lock;
+    std::unordered_map<void*, size_t> sizes;
+};
+
+inline _mapping_registry& mapping_registry()
+{
+    static _mapping_registry registry;
+    return registry;
+}
+
+// Anonymous memory placed according to p, released by free_on_node()
+inline void* alloc_placed(size_t len, const MemPlacement& p)
+{
+    void* addr = MAP_FAILED;
+    size_t map_len = len;
+
+    if (p.page_size) {
+        map_len = (len + p.page_size - 1) & ~(p.page_size - 1);
+        int huge_flag = (p.page_size == (1UL << 30)) ? MAP_HUGE_1GB : MAP_HUGE_2MB;
+        addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | huge_flag, -1, 0);
+        if (addr == MAP_FAILED) {
+            static bool warned = false;
+            if (!warned)
+                fprintf(stderr, "WARNING, cannot get %lu MB of %s hugepages (%s), falling back to base pages\n",
+                    map_len >> 20, p.page_size == (1UL << 30) ? "1GB" : "2MB", strerror(errno));
+            warned = true;
+            map_len = len;
+        }
+    }
+    if (addr == MAP_FAILED)
+        addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+        return nullptr;
+
+    if (!place_range(addr, map_len, p, false)) {
+        munmap(addr, map_len);
+        return nullptr;
+    }
+
+    _mapping_registry& registry = mapping_registry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    registry.sizes[addr] = map_len;
+    return addr;
+}
+
+// Anonymous memory on numa_node, or placed by the app policy when NUMA_NODE_ANY
+inline void* alloc_on_node(size_t len, int numa_node)
+{
+    if (numa_node == NUMA_NODE_ANY)
+        return alloc_placed(len, app_mem_placement);
+
+    MemPlacement p = app_mem_placement;
+    p.policy = MEM_BIND;
+    p.node = numa_node;
+    return alloc_placed(len, p);
+}
+
+inline void free_on_node(void* addr, size_t len)
+{
+    if (addr == nullptr)
+        return;
+
+    _mapping_registry& registry = mapping_registry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    auto it = registry.sizes.find(addr);
+    if (it != registry.sizes.end()) {
+        len = it->second;
+        registry.sizes.erase(it);
+    }
+    munmap(addr, len);
+}
+
+/**
+ * std allocator on top of alloc_on_node(), so app state held in containers follows the policy too.
+ * Every allocation is its own mapping: only meant for large, sized-once containers.
+ */
+template <class T>
+struct NumaAllocator {
+    typedef T value_type;
+
+    NumaAllocator() = default;
+    template <class U> NumaAllocator(const NumaAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        void* p = alloc_on_node(n * sizeof(T), NUMA_NODE_ANY);
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return (T*)p;
+    }
+
+    void deallocate(T* p, size_t n) {
+        free_on_node(p, n * sizeof(T));
+    }
+
+    template <class U> bool operator==(const NumaAllocator<U>&) const { return true; }
+    template <class U> bool operator!=(const NumaAllocator<U>&) const { return false; }
+};
+
+template <class T>
+using numa_vector = std::vector<T, NumaAllocator<T>>;
+
+} // namespace dpdk_apps
+
+#endif /* NUMA_MEM_H */
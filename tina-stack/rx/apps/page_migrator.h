@@ -0,0 +1,386 @@
+#ifndef PAGE_MIGRATOR_H
+#define PAGE_MIGRATOR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <numaif.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <rte_common.h>
+#include <rte_eal.h>
+#include <rte_lcore.h>
+
+#include "numa_mem.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Access heat of one app region (index, table, training set), in CHUNK_SIZE chunks.
+ * Apps bump the counters on their hot path. Every lcore has its own array and is its only writer
+ * (relaxed load + store, no locked instruction, no line shared with another lcore). The migrator
+ * only reads them and keeps the last value it saw, the heat of an epoch is the difference.
+ */
+class HeatRegion {
+
+public:
+    static constexpr int CHUNK_SHIFT = 21;                  // 2MB, also the hugepage size
+    static constexpr size_t CHUNK_SIZE = 1UL << CHUNK_SHIFT;
+
+private:
+    friend class PageMigrator;
+
+    std::string name;
+    uintptr_t base;
+    size_t len;
+    size_t page_size;                   // Of the mapping, a hugetlb page moves (and is charged) whole
+    size_t num_chunks;
+    std::vector<std::unique_ptr<std::atomic<uint32_t>[], decltype(&free)>> heat;   // [lcore index][chunk], bumped by that lcore
+    std::vector<uint32_t> heat_seen;    // [lcore index * num_chunks + chunk], migrator only
+    std::vector<uint32_t> score;        // Exponentially decayed heat, migrator only
+    std::vector<int8_t> node;           // Where the chunk's first page is, -1 = not resident
+
+    inline std::atomic<uint32_t>* lcore_heat() {
+        int i = rte_lcore_index(rte_lcore_id());
+        return (i >= 0 && (size_t)i < heat.size()) ? heat[i].get() : nullptr;
+    }
+
+    // Cache line aligned and padded, so no two lcores' arrays share a line
+    static std::atomic<uint32_t>* alloc_heat(size_t n) {
+        size_t bytes = RTE_ALIGN_CEIL(n * sizeof(std::atomic<uint32_t>), RTE_CACHE_LINE_SIZE);
+        void* mem = nullptr;
+        if (posix_memalign(&mem, RTE_CACHE_LINE_SIZE, bytes) != 0)
+            rte_exit(EXIT_FAILURE, "Page migrator: cannot allocate the heat counters\n");
+        std::atomic<uint32_t>* h = (std::atomic<uint32_t>*)mem;
+        for (size_t c = 0; c < n; c++)
+            new (&h[c]) std::atomic<uint32_t>(0);
+        return h;
+    }
+
+    static inline void bump(std::atomic<uint32_t>& h) {
+        h.store(h.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // KernelPageSize of the mapping holding addr, the base page size if smaps can't tell
+    static size_t mapping_page_size(const void* addr) {
+        size_t size = sysconf(_SC_PAGESIZE);
+        std::ifstream smaps("/proc/self/smaps");
+        std::string line;
+        bool inside = false;
+        while (std::getline(smaps, line)) {
+            uintptr_t lo, hi;
+            size_t kb;
+            if (sscanf(line.c_str(), "%lx-%lx ", &lo, &hi) == 2 && line.find(':') > line.find(' '))
+                inside = (uintptr_t)addr >= lo && (uintptr_t)addr < hi;
+            else if (inside && sscanf(line.c_str(), "KernelPageSize: %lu kB", &kb) == 1)
+                return kb << 10;
+        }
+        return size;
+    }
+
+public:
+    HeatRegion(const std::string& name, const void* addr, size_t len):
+        name(name), base((uintptr_t)addr), len(len), page_size(mapping_page_size(addr)),
+        num_chunks((len + CHUNK_SIZE - 1) >> CHUNK_SHIFT),
+        heat_seen(rte_lcore_count() * num_chunks, 0), score(num_chunks, 0), node(num_chunks, -1)
+    {
+        for (unsigned i = 0; i < rte_lcore_count(); i++)
+            heat.emplace_back(alloc_heat(num_chunks), &free);
+    }
+
+    inline void touch(const void* p) {
+        size_t c = ((uintptr_t)p - base) >> CHUNK_SHIFT;
+        std::atomic<uint32_t>* h = lcore_heat();
+        if (c < num_chunks && h)
+            bump(h[c]);
+    }
+
+    inline void touch_range(const void* p, size_t n) {
+        std::atomic<uint32_t>* h = lcore_heat();
+        if (n == 0 || h == nullptr)
+            return;
+        size_t first = ((uintptr_t)p - base) >> CHUNK_SHIFT;
+        size_t last = std::min(num_chunks - 1, ((uintptr_t)p + n - 1 - base) >> CHUNK_SHIFT);
+        for (size_t c = first; c <= last; c++)
+            bump(h[c]);
+    }
+
+    // Heat since the last call, summed over the lcores, migrator only
+    uint32_t drain(size_t c) {
+        uint32_t total = 0;
+        for (size_t i = 0; i < heat.size(); i++) {
+            uint32_t now = heat[i][c].load(std::memory_order_relaxed);
+            uint32_t& seen = heat_seen[i * num_chunks + c];
+            total += now - seen;
+            seen = now;
+        }
+        return total;
+    }
+};
+
+/**
+ * Background hot/cold migration of the registered regions with move_pages(2).
+ * Every EPOCH_MS the heat is folded into a decayed score, then:
+ *   - chunks scoring above HOT_FACTOR x the region mean and not on the hot node are promoted,
+ *     hottest first, to the node of the RX lcores (the processing SNC node)
+ *   - chunks on the hot node that have gone cold (score 0) are demoted to the far node
+ * Both are charged against a byte budget refilled at budget_mbps, a chunk of a hugetlb region at
+ * least one whole hugepage. Unused budget doesn't accumulate beyond one epoch (or the largest chunk
+ * or hugepage, if larger), so the RX path never sees a migration burst.
+ * The thread inherits the main lcore affinity, it never runs on an RX lcore.
+ */
+class PageMigrator {
+
+private:
+    static constexpr uint64_t EPOCH_MS = 100;
+    static constexpr uint32_t HOT_FACTOR = 2;
+
+    std::vector<std::unique_ptr<HeatRegion>> regions;
+    uint64_t budget_mbps = 0;
+    int hot_node = NUMA_NODE_ANY;
+    int cold_node = NUMA_NODE_ANY;
+
+    pthread_t thread;
+    std::atomic<bool> running{false};
+
+    uint64_t credit = 0;                // Bytes that may still be moved
+
+    uint64_t num_epochs = 0;
+    uint64_t bytes_promoted = 0;
+    uint64_t bytes_demoted = 0;
+    uint64_t pages_failed = 0;
+    uint64_t epochs_budget_exhausted = 0;
+
+public:
+
+    // 0 keeps the migrator off, regions are then never created and apps skip the counters
+    void set_budget_mbps(uint64_t mbps) { budget_mbps = mbps; }
+    bool enabled() const { return budget_mbps != 0; }
+
+    // nullptr when disabled
+    HeatRegion* register_region(const std::string& name, const void* addr, size_t len)
+    {
+        if (!enabled() || addr == nullptr || len == 0 || running)
+            return nullptr;
+        regions.emplace_back(new HeatRegion(name, addr, len));
+        return regions.back().get();
+    }
+
+    bool start()
+    {
+        if (!enabled() || regions.empty())
+            return false;
+        hot_node = local_node();
+        cold_node = far_node();
+        if (hot_node == cold_node) {
+            fprintf(stderr, "WARNING, page migration disabled: the far node is the local node (%d)\n", hot_node);
+            return false;
+        }
+        running = true;
+        if (pthread_create(&thread, NULL, thread_main, this) != 0) {
+            running = false;
+            return false;
+        }
+        pthread_setname_np(thread, "page_migrator");
+        printf("Page migrator: %lu regions, hot node %d, cold node %d, budget %lu MB/s\n",
+            regions.size(), hot_node, cold_node, budget_mbps);
+        return true;
+    }
+
+    void stop()
+    {
+        if (!running)
+            return;
+        running = false;
+        pthread_join(thread, NULL);
+    }
+
+    std::string print_stats() const
+    {
+        std::ostringstream out;
+        out << "Page Migrator -- epochs: " << num_epochs
+            << " -- promoted: " << (bytes_promoted >> 20) << " MB"
+            << " -- demoted: " << (bytes_demoted >> 20) << " MB"
+            << " -- failed pages: " << pages_failed
+            << " -- budget-bound epochs: " << epochs_budget_exhausted << "\n";
+        for (const auto& r : regions) {
+            size_t on_hot = 0, on_cold = 0;
+            for (size_t c = 0; c < r->num_chunks; c++) {
+                on_hot += (r->node[c] == hot_node);
+                on_cold += (r->node[c] == cold_node);
+            }
+            out << "  " << r->name << ": " << (r->len >> 20) << " MB, "
+                << on_hot << "/" << r->num_chunks << " chunks on node " << hot_node << ", "
+                << on_cold << " on node " << cold_node << "\n";
+        }
+        return out.str();
+    }
+
+private:
+
+    static void* thread_main(void* arg)
+    {
+        PageMigrator* self = (PageMigrator*)arg;
+        for (auto& r : self->regions)
+            self->query_nodes(*r);
+
+        while (self->running) {
+            usleep(EPOCH_MS * 1000);
+            self->epoch();
+        }
+        return NULL;
+    }
+
+    void query_nodes(HeatRegion& r)
+    {
+        std::vector<void*> pages(r.num_chunks);
+        std::vector<int> status(r.num_chunks);
+        for (size_t c = 0; c < r.num_chunks; c++)
+            pages[c] = (void*)(r.base + (c << HeatRegion::CHUNK_SHIFT));
+        if (move_pages(0, r.num_chunks, pages.data(), NULL, status.data(), 0) != 0)
+            return;
+        for (size_t c = 0; c < r.num_chunks; c++)
+            r.node[c] = (status[c] >= 0) ? (int8_t)status[c] : -1;
+    }
+
+    // Budget a chunk of r takes at most
+    static uint64_t chunk_cost(const HeatRegion& r)
+    {
+        return std::max<uint64_t>(HeatRegion::CHUNK_SIZE, r.page_size);
+    }
+
+    // Move one chunk (the whole hugepage holding it), return the bytes that changed node
+    uint64_t migrate_chunk(HeatRegion& r, size_t c, int target)
+    {
+        const uintptr_t page_size = r.page_size;
+        uintptr_t begin = r.base + (c << HeatRegion::CHUNK_SHIFT);
+        uintptr_t end = std::min(r.base + r.len, begin + HeatRegion::CHUNK_SIZE);
+        begin &= ~(page_size - 1);
+        end = (end + page_size - 1) & ~(page_size - 1);
+
+        size_t n = (end - begin) / page_size;
+        void* pages[HeatRegion::CHUNK_SIZE / 4096 + 1];
+        int nodes[HeatRegion::CHUNK_SIZE / 4096 + 1];
+        int status[HeatRegion::CHUNK_SIZE / 4096 + 1];
+        n = std::min(n, sizeof(pages) / sizeof(pages[0]));
+        for (size_t i = 0; i < n; i++)
+            pages[i] = (void*)(begin + i * page_size);
+
+        //*** Only the pages not yet on the target move, and count */
+        int where[HeatRegion::CHUNK_SIZE / 4096 + 1];       // Node of every page once done, or -errno
+        if (move_pages(0, n, pages, NULL, where, 0) < 0) {
+            pages_failed += n;
+            return 0;
+        }
+        void* to_move[HeatRegion::CHUNK_SIZE / 4096 + 1];
+        size_t moving[HeatRegion::CHUNK_SIZE / 4096 + 1];
+        size_t m = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (where[i] == target || where[i] == -ENOENT)      //Already there, or never touched
+                continue;
+            to_move[m] = pages[i];
+            nodes[m] = target;
+            moving[m++] = i;
+        }
+
+        uint64_t moved = 0;
+        if (m > 0 && move_pages(0, m, to_move, nodes, status, MPOL_MF_MOVE) < 0) {
+            pages_failed += m;
+            m = 0;
+        }
+        for (size_t j = 0; j < m; j++) {
+            if (status[j] == target) {
+                moved += page_size;
+                where[moving[j]] = target;
+            } else {
+                pages_failed++;
+            }
+        }
+
+        //*** A chunk is on target once all its resident pages are, o/w where a page that stayed is */
+        //A hugepage larger than a chunk took its neighbours along
+        uintptr_t region_end = std::min(end, r.base + r.len);
+        for (uintptr_t a = std::max(begin, r.base); a < region_end; a += HeatRegion::CHUNK_SIZE) {
+            size_t k = (a - r.base) >> HeatRegion::CHUNK_SHIFT;
+            uintptr_t chunk_end = std::min(region_end, r.base + ((k + 1) << HeatRegion::CHUNK_SHIFT));
+            int8_t chunk_node = target;
+            for (size_t i = (a - begin) / page_size; i < n && begin + i * page_size < chunk_end; i++) {
+                if (where[i] != target && where[i] != -ENOENT) {
+                    chunk_node = (where[i] >= 0) ? (int8_t)where[i] : -1;
+                    break;
+                }
+            }
+            r.node[k] = chunk_node;
+        }
+        return moved;
+    }
+
+    void epoch()
+    {
+        struct _candidate {
+            HeatRegion* r;
+            size_t c;
+            uint32_t score;
+        };
+        std::vector<_candidate> hot, cold;
+
+        for (auto& rp : regions) {
+            HeatRegion& r = *rp;
+            uint64_t total = 0;
+            for (size_t c = 0; c < r.num_chunks; c++) {
+                uint32_t h = r.drain(c);
+                r.score[c] = r.score[c] / 2 + h;
+                total += r.score[c];
+            }
+            uint64_t mean = total / r.num_chunks;
+            for (size_t c = 0; c < r.num_chunks; c++) {
+                if (r.score[c] > 0 && r.score[c] >= mean * HOT_FACTOR && r.node[c] != hot_node)
+                    hot.push_back({&r, c, r.score[c]});
+                else if (r.score[c] == 0 && r.node[c] == hot_node)
+                    cold.push_back({&r, c, 0});
+            }
+        }
+
+        std::sort(hot.begin(), hot.end(), [](const _candidate& a, const _candidate& b) { return a.score > b.score; });
+
+        uint64_t per_epoch = (budget_mbps << 20) * EPOCH_MS / 1000;
+        uint64_t max_cost = HeatRegion::CHUNK_SIZE;
+        for (auto& rp : regions)
+            max_cost = std::max(max_cost, chunk_cost(*rp));
+        credit = std::min(credit + per_epoch, std::max(per_epoch, max_cost));
+        uint64_t& budget = credit;
+        bool exhausted = false;
+        for (const _candidate& k : hot) {
+            if (budget < chunk_cost(*k.r)) { exhausted = true; break; }
+            uint64_t moved = migrate_chunk(*k.r, k.c, hot_node);
+            bytes_promoted += moved;
+            budget -= std::min(budget, std::max<uint64_t>(moved, 4096));
+        }
+        for (const _candidate& k : cold) {
+            if (budget < chunk_cost(*k.r)) { exhausted = true; break; }
+            uint64_t moved = migrate_chunk(*k.r, k.c, cold_node);
+            bytes_demoted += moved;
+            budget -= std::min(budget, std::max<uint64_t>(moved, 4096));
+        }
+        epochs_budget_exhausted += exhausted;
+        num_epochs++;
+    }
+};
+
+// Configured from the command line (-w), started by main once the apps registered their regions
+inline PageMigrator page_migrator;
+
+} // namespace dpdk_apps
+
+#endif /* PAGE_MIGRATOR_H */
@@ -0,0 +1,234 @@
+#ifndef SERVICE_TIME_H
+#define SERVICE_TIME_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fast_rand.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Synthetic service-time distribution, parsed from a spec string:
+ *
+ *   <ns>                               legacy, constant wait once per burst
+ *   const:<ns>                         constant, per packet
+ *   exp:<mean ns>                      exponential
+ *   bimodal:<ns1>:<ns2>:<p2>           ns2 with probability p2, ns1 otherwise
+ *   lognormal:<mean ns>:<sigma>        heavy tailed, sigma of the underlying normal
+ *   cdf:<file>                         empirical CDF, one "<ns> <cumulative probability>" pair per line,
+ *                                      linearly interpolated between points
+ *
+ * Draws are returned in TSC cycles, converted with a 32.32 fixed-point factor so the hot path has
+ * no floating point besides what the distribution itself needs.
+ */
+class ServiceTimeDist {
+
+public:
+    enum Kind {
+        CONST = 0,
+        EXP = 1,
+        BIMODAL = 2,
+        LOGNORMAL = 3,
+        EMPIRICAL = 4,
+
+        _KindCount
+    };
+
+private:
+    Kind kind = CONST;
+    bool per_burst = false;
+
+    double a = 0;           // const/exp: ns; bimodal: ns1; lognormal: mu
+    double b = 0;           // bimodal: ns2; lognormal: sigma
+    double p = 0;           // bimodal: p2
+    std::vector<double> cdf_ns;
+    std::vector<double> cdf_prob;
+    std::string cdf_path;
+
+    uint64_t cycles_per_ns_q32 = 0;
+
+    double spare_normal = 0;
+    bool has_spare_normal = false;
+
+public:
+
+    // Return false on a malformed spec or unreadable CDF file
+    bool parse(const std::string& spec, uint64_t tsc_hz)
+    {
+        cycles_per_ns_q32 = (uint64_t)((((unsigned __int128)tsc_hz << 32) + 999999999ULL) / 1000000000ULL);   // Rounded up, so whole ns stay whole cycles
+
+        char* endptr;
+        double v = strtod(spec.c_str(), &endptr);
+        if (!spec.empty() && *endptr == '\0') {
+            kind = CONST;
+            per_burst = true;
+            a = v;
+            return v >= 0;
+        }
+
+        per_burst = false;
+        size_t colon = spec.find(':');
+        std::string name = spec.substr(0, colon);
+        std::string params = (colon == std::string::npos) ? "" : spec.substr(colon + 1);
+
+        if (name == "const") {
+            kind = CONST;
+            return sscanf(params.c_str(), "%lf", &a) == 1 && a >= 0;
+        }
+        if (name == "exp") {
+            kind = EXP;
+            return sscanf(params.c_str(), "%lf", &a) == 1 && a > 0;
+        }
+        if (name == "bimodal") {
+            kind = BIMODAL;
+            return sscanf(params.c_str(), "%lf:%lf:%lf", &a, &b, &p) == 3 && a >= 0 && b >= 0 && p >= 0 && p <= 1;
+        }
+        if (name == "lognormal") {
+            double mean;
+            kind = LOGNORMAL;
+            if (sscanf(params.c_str(), "%lf:%lf", &mean, &b) != 2 || mean <= 0 || b < 0)
+                return false;
+            a = log(mean) - b * b / 2;      // E[X] = exp(mu + sigma^2 / 2)
+            return true;
+        }
+        if (name == "cdf") {
+            kind = EMPIRICAL;
+            cdf_path = params;
+            return load_cdf(params);
+        }
+        return false;
+    }
+
+    bool is_per_burst() const { return per_burst; }
+
+    uint64_t ns_to_cycles(uint64_t ns) const {
+        return (uint64_t)(((unsigned __int128)ns * cycles_per_ns_q32) >> 32);
+    }
+
+    uint64_t sample_ns(FastRand& rng)
+    {
+        switch (kind) {
+            case CONST:
+                return (uint64_t)a;
+            case EXP:
+                return (uint64_t)(-a * log1p(-rng.next_double()));
+            case BIMODAL:
+                return (uint64_t)(rng.next_double() < p ? b : a);
+            case LOGNORMAL:
+                return (uint64_t)exp(a + b * next_normal(rng));
+            case EMPIRICAL:
+                return (uint64_t)sample_cdf(rng.next_double());
+            default:
+                return 0;
+        }
+    }
+
+    uint64_t sample_cycles(FastRand& rng) {
+        return ns_to_cycles(sample_ns(rng));
+    }
+
+    double mean_ns() const
+    {
+        switch (kind) {
+            case CONST:
+            case EXP:       return a;
+            case BIMODAL:   return a * (1 - p) + b * p;
+            case LOGNORMAL: return exp(a + b * b / 2);
+            case EMPIRICAL:
+            {
+                double mean = cdf_ns[0] * cdf_prob[0];
+                for (size_t i = 1; i < cdf_ns.size(); i++)
+                    mean += (cdf_prob[i] - cdf_prob[i - 1]) * (cdf_ns[i - 1] + cdf_ns[i]) / 2;
+                return mean;
+            }
+            default:        return 0;
+        }
+    }
+
+    std::string describe() const
+    {
+        std::ostringstream out;
+        switch (kind) {
+            case CONST:     out << "const " << a << " ns" << (per_burst ? " per burst" : ""); break;
+            case EXP:       out << "exp mean " << a << " ns"; break;
+            case BIMODAL:   out << "bimodal " << a << "/" << b << " ns, p2 " << p; break;
+            case LOGNORMAL: out << "lognormal mean " << mean_ns() << " ns, sigma " << b; break;
+            case EMPIRICAL: out << "cdf " << cdf_path << " (" << cdf_ns.size() << " points, mean " << mean_ns() << " ns)"; break;
+            default:        break;
+        }
+        return out.str();
+    }
+
+private:
+
+    // Box-Muller, both values of a pair are used
+    double next_normal(FastRand& rng)
+    {
+        if (has_spare_normal) {
+            has_spare_normal = false;
+            return spare_normal;
+        }
+        double u1 = 1.0 - rng.next_double();     // (0, 1], log stays finite
+        double u2 = rng.next_double();
+        double r = sqrt(-2.0 * log(u1));
+        spare_normal = r * sin(2 * M_PI * u2);
+        has_spare_normal = true;
+        return r * cos(2 * M_PI * u2);
+    }
+
+    double sample_cdf(double u) const
+    {
+        size_t i = std::upper_bound(cdf_prob.begin(), cdf_prob.end(), u) - cdf_prob.begin();
+        if (i == 0)
+            return cdf_ns[0];
+        if (i == cdf_prob.size())
+            return cdf_ns.back();
+        double span = cdf_prob[i] - cdf_prob[i - 1];
+        return cdf_ns[i - 1] + (cdf_ns[i] - cdf_ns[i - 1]) * (u - cdf_prob[i - 1]) / span;
+    }
+
+    bool load_cdf(const std::string& path)
+    {
+        std::ifstream in(path);
+        if (!in.is_open()) {
+            fprintf(stderr, "Cannot open service time CDF %s\n", path.c_str());
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+            double ns, prob;
+            if (sscanf(line.c_str(), "%lf %lf", &ns, &prob) != 2)
+                continue;
+            if (ns < 0 || (!cdf_prob.empty() && (prob < cdf_prob.back() || ns < cdf_ns.back()))) {
+                fprintf(stderr, "Service time CDF %s is not monotonic at \"%s\"\n", path.c_str(), line.c_str());
+                return false;
+            }
+            cdf_ns.push_back(ns);
+            cdf_prob.push_back(prob);
+        }
+        if (cdf_prob.empty() || cdf_prob.back() <= 0)
+            return false;
+
+        //Accept cumulative counts or percentages as well
+        double total = cdf_prob.back();
+        for (double& prob : cdf_prob)
+            prob /= total;
+        return true;
+    }
+};
+
+} // namespace dpdk_apps
+
+#endif /* SERVICE_TIME_H */
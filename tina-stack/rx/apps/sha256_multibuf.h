@@ -0,0 +1,216 @@
+#ifndef SHA256_MULTIBUF_H
+#define SHA256_MULTIBUF_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "simd_dispatch.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Multi-buffer SHA-256: up to 4/8/16 independent messages are hashed in the lanes of one
+ * SSE2/AVX2/AVX-512 register, one 64B block per lane per step.
+ * Messages of unequal length are handled like the ISA-L job manager: a lane whose message is done
+ * is refilled with the next pending job right away, so lanes only idle at the very end of a batch.
+ */
+struct sha256_mb_job {
+    const uint8_t* data;
+    uint32_t len;
+    uint8_t digest[32];
+};
+
+namespace sha256_mb_detail {
+
+typedef uint32_t v4u __attribute__((vector_size(16)));
+typedef uint32_t v8u __attribute__((vector_size(32)));
+typedef uint32_t v16u __attribute__((vector_size(64)));
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint8_t ZERO_BLOCK[64] = {0};
+
+// A macro rather than a function: a function returning a 256/512-bit vector changes the ABI
+#define SHA256_MB_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// Per lane progress through its job, the last one or two blocks come from `tail` (padding + length)
+struct lane {
+    sha256_mb_job* job;
+    uint32_t block;
+    uint32_t full_blocks;
+    uint32_t total_blocks;
+    uint8_t tail[128];
+};
+
+static inline void lane_start(lane& l, sha256_mb_job* job)
+{
+    l.job = job;
+    l.block = 0;
+    l.full_blocks = job->len / 64;
+    uint32_t rem = job->len % 64;
+    uint32_t tail_blocks = (rem + 9 <= 64) ? 1 : 2;
+    l.total_blocks = l.full_blocks + tail_blocks;
+
+    memset(l.tail, 0, sizeof(l.tail));
+    memcpy(l.tail, job->data + (uint64_t)l.full_blocks * 64, rem);
+    l.tail[rem] = 0x80;
+    uint64_t bits = (uint64_t)job->len * 8;
+    for (int i = 0; i < 8; i++)
+        l.tail[tail_blocks * 64 - 1 - i] = (uint8_t)(bits >> (8 * i));
+}
+
+static inline const uint8_t* lane_block(const lane& l)
+{
+    if (l.job == nullptr)
+        return ZERO_BLOCK;      //Idle lane, computes garbage that is never read
+    if (l.block < l.full_blocks)
+        return l.job->data + (uint64_t)l.block * 64;
+    return l.tail + (l.block - l.full_blocks) * 64;
+}
+
+static inline uint32_t load_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * Inlined into the target-specific wrappers below, so the generic vector code is compiled
+ * for the ISA of the caller.
+ */
+template <typename V, int LANES>
+static inline __attribute__((always_inline)) void run(sha256_mb_job* jobs, size_t num_jobs)
+{
+    lane lanes[LANES];
+    V state[8];
+    size_t next_job = 0;
+    int active = 0;
+
+    for (int l = 0; l < LANES; l++)
+        lanes[l].job = nullptr;
+    for (int i = 0; i < 8; i++)
+        state[i] = V{} + IV[i];
+
+    auto refill = [&](int l) {
+        if (next_job < num_jobs) {
+            lane_start(lanes[l], &jobs[next_job++]);
+            for (int i = 0; i < 8; i++)
+                state[i][l] = IV[i];
+            active++;
+        }
+    };
+    for (int l = 0; l < LANES; l++)
+        refill(l);
+
+    while (active > 0) {
+        //*** Message schedule, transposed: w[t][lane] */
+        const uint8_t* blocks[LANES];
+        for (int l = 0; l < LANES; l++)
+            blocks[l] = lane_block(lanes[l]);
+
+        V w[16];
+        for (int t = 0; t < 16; t++)
+            for (int l = 0; l < LANES; l++)
+                w[t][l] = load_be32(blocks[l] + 4 * t);
+
+        V a = state[0], b = state[1], c = state[2], d = state[3];
+        V e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int t = 0; t < 64; t++) {
+            V wt;
+            if (t < 16) {
+                wt = w[t];
+            } else {
+                V w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+                V s0 = SHA256_MB_ROTR(w15, 7) ^ SHA256_MB_ROTR(w15, 18) ^ (w15 >> 3);
+                V s1 = SHA256_MB_ROTR(w2, 17) ^ SHA256_MB_ROTR(w2, 19) ^ (w2 >> 10);
+                wt = w[t & 15] = w[t & 15] + s0 + w[(t - 7) & 15] + s1;
+            }
+            V S1 = SHA256_MB_ROTR(e, 6) ^ SHA256_MB_ROTR(e, 11) ^ SHA256_MB_ROTR(e, 25);
+            V ch = (e & f) ^ (~e & g);
+            V t1 = h + S1 + ch + K[t] + wt;
+            V S0 = SHA256_MB_ROTR(a, 2) ^ SHA256_MB_ROTR(a, 13) ^ SHA256_MB_ROTR(a, 22);
+            V maj = (a & b) ^ (a & c) ^ (b & c);
+            V t2 = S0 + maj;
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+
+        //*** Retire finished lanes and hand them the next job */
+        for (int l = 0; l < LANES; l++) {
+            if (lanes[l].job == nullptr || ++lanes[l].block < lanes[l].total_blocks)
+                continue;
+            for (int i = 0; i < 8; i++) {
+                uint32_t v = state[i][l];
+                lanes[l].job->digest[4 * i + 0] = v >> 24;
+                lanes[l].job->digest[4 * i + 1] = v >> 16;
+                lanes[l].job->digest[4 * i + 2] = v >> 8;
+                lanes[l].job->digest[4 * i + 3] = v;
+            }
+            lanes[l].job = nullptr;
+            active--;
+            refill(l);
+        }
+    }
+}
+
+} // namespace sha256_mb_detail
+
+
+inline void sha256_mb_sse2(sha256_mb_job* jobs, size_t num_jobs)
+{
+    sha256_mb_detail::run<sha256_mb_detail::v4u, 4>(jobs, num_jobs);
+}
+
+__attribute__((target("avx2")))
+inline void sha256_mb_avx2(sha256_mb_job* jobs, size_t num_jobs)
+{
+    sha256_mb_detail::run<sha256_mb_detail::v8u, 8>(jobs, num_jobs);
+}
+
+__attribute__((target("avx512f")))
+inline void sha256_mb_avx512(sha256_mb_job* jobs, size_t num_jobs)
+{
+    sha256_mb_detail::run<sha256_mb_detail::v16u, 16>(jobs, num_jobs);
+}
+
+inline int sha256_mb_lanes(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_AVX512:   return 16;
+        case SIMD_AVX2:     return 8;
+        default:            return 4;
+    }
+}
+
+// Hash every job, digests are written into the jobs
+inline void sha256_mb(sha256_mb_job* jobs, size_t num_jobs, SimdLevel level)
+{
+    switch (level) {
+        case SIMD_AVX512:   sha256_mb_avx512(jobs, num_jobs); break;
+        case SIMD_AVX2:     sha256_mb_avx2(jobs, num_jobs); break;
+        default:            sha256_mb_sse2(jobs, num_jobs); break;
+    }
+}
+
+} // namespace dpdk_apps
+
+#undef SHA256_MB_ROTR
+
+#endif /* SHA256_MULTIBUF_H */
@@ -0,0 +1,57 @@
+#ifndef SIMD_DISPATCH_H
+#define SIMD_DISPATCH_H
+
+#include <string>
+
+
+namespace dpdk_apps{
+
+/**
+ * Runtime ISA dispatch for the app kernels.
+ * Kernels are compiled with __attribute__((target(...))), so the binary still runs on any x86-64
+ * and the best supported version is picked once at app init.
+ */
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_AVX2 = 1,
+    SIMD_AVX512 = 2,
+
+    _SimdLevelCount
+};
+
+// Upper bound set from the command line (-v), lets us compare kernels on the same machine
+inline SimdLevel simd_level_cap = SIMD_AVX512;
+
+inline SimdLevel detect_simd_level()
+{
+    __builtin_cpu_init();
+    SimdLevel level = SIMD_SCALAR;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        level = SIMD_AVX2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl"))
+        level = SIMD_AVX512;
+    return (level < simd_level_cap) ? level : simd_level_cap;
+}
+
+inline const char* simd_level_str(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_AVX512:   return "AVX-512";
+        case SIMD_AVX2:     return "AVX2";
+        default:            return "Scalar";
+    }
+}
+
+inline bool parse_simd_level(const std::string& str, SimdLevel* level)
+{
+    if (str == "scalar")        *level = SIMD_SCALAR;
+    else if (str == "avx2")     *level = SIMD_AVX2;
+    else if (str == "avx512")   *level = SIMD_AVX512;
+    else                        return false;
+    return true;
+}
+
+} // namespace dpdk_apps
+
+#endif /* SIMD_DISPATCH_H */
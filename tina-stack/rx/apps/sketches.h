@@ -0,0 +1,264 @@
+#ifndef SKETCHES_H
+#define SKETCHES_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "numa_mem.h"
+
+
+namespace dpdk_apps{
+
+// 5-tuple, padded to 4 words so it hashes with the flow hash kernels as is
+struct FlowKey {
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint32_t ports;         // src << 16 | dst, network order ports
+    uint32_t proto;
+
+    bool operator==(const FlowKey& o) const {
+        return src_ip == o.src_ip && dst_ip == o.dst_ip && ports == o.ports && proto == o.proto;
+    }
+};
+
+/**
+ * Count-min sketch, DEPTH rows of width counters (width a power of 2).
+ * Row r is indexed with h1 + r * h2 (Kirsch-Mitzenmacher), so one pair of hashes feeds every row.
+ * Overestimates by at most e / width * N with probability 1 - e^-DEPTH.
+ */
+class CountMinSketch {
+
+public:
+    static constexpr uint32_t DEPTH = 4;
+
+private:
+    numa_vector<uint32_t> counters;
+    uint32_t width = 0;
+    uint32_t mask = 0;
+
+public:
+    void init(uint32_t w) {
+        width = w;
+        mask = w - 1;
+        counters.assign((size_t)DEPTH * width, 0);
+    }
+
+    uint32_t get_width() const { return width; }
+    size_t memory() const { return counters.size() * sizeof(uint32_t); }
+    const void* data() const { return counters.data(); }
+
+    // Add one and return the new estimate
+    inline uint32_t update(uint32_t h1, uint32_t h2) {
+        uint32_t estimate = UINT32_MAX;
+        h2 |= 1;
+        for (uint32_t r = 0; r < DEPTH; r++) {
+            uint32_t& c = counters[(size_t)r * width + ((h1 + r * h2) & mask)];
+            c++;
+            estimate = std::min(estimate, c);
+        }
+        return estimate;
+    }
+
+    inline uint32_t estimate(uint32_t h1, uint32_t h2) const {
+        uint32_t estimate = UINT32_MAX;
+        h2 |= 1;
+        for (uint32_t r = 0; r < DEPTH; r++)
+            estimate = std::min(estimate, counters[(size_t)r * width + ((h1 + r * h2) & mask)]);
+        return estimate;
+    }
+
+    void clear() {
+        std::fill(counters.begin(), counters.end(), 0);
+    }
+
+    // Sketches of the same width add up counter by counter
+    void merge(const CountMinSketch& o) {
+        for (size_t i = 0; i < counters.size(); i++)
+            counters[i] += o.counters[i];
+    }
+};
+
+/**
+ * HyperLogLog distinct counter, 2^P one-byte registers, standard error 1.04 / sqrt(2^P).
+ */
+class HyperLogLog {
+
+public:
+    static constexpr uint32_t P = 14;
+    static constexpr uint32_t M = 1U << P;
+
+private:
+    uint8_t registers[M];
+
+public:
+    HyperLogLog() { clear(); }
+
+    inline void add(uint64_t h) {
+        uint32_t idx = h >> (64 - P);
+        uint64_t rest = (h << P) | (1ULL << (P - 1));      // Sentinel bit bounds the rank
+        uint8_t rank = __builtin_clzll(rest) + 1;
+        if (rank > registers[idx])
+            registers[idx] = rank;
+    }
+
+    double estimate() const {
+        double sum = 0;
+        uint32_t zeros = 0;
+        for (uint32_t i = 0; i < M; i++) {
+            sum += ldexp(1.0, -registers[i]);
+            zeros += (registers[i] == 0);
+        }
+        double alpha = 0.7213 / (1.0 + 1.079 / M);
+        double e = alpha * M * M / sum;
+        if (e <= 2.5 * M && zeros)
+            e = M * log((double)M / zeros);                 // Linear counting for the small range
+        return e;
+    }
+
+    void clear() {
+        memset(registers, 0, sizeof(registers));
+    }
+
+    void merge(const HyperLogLog& o) {
+        for (uint32_t i = 0; i < M; i++)
+            registers[i] = std::max(registers[i], o.registers[i]);
+    }
+};
+
+/**
+ * Top-k heavy hitters fed by a count-min sketch: a min-heap of the k flows with the largest
+ * estimates, plus a linear-probing index from flow hash to heap slot.
+ * A key's estimate never decreases and the heap keeps the last one it saw, so a packet whose
+ * estimate is below the heap minimum can't belong to a heap flow: that test alone filters out
+ * the mice, only the candidates pay for the index lookup.
+ */
+class TopK {
+
+public:
+    struct Entry {
+        FlowKey key;
+        uint32_t hash;
+        uint32_t count;
+    };
+
+private:
+    static constexpr int32_t EMPTY = -1;
+
+    std::vector<Entry> heap;
+    std::vector<int32_t> index;          // Heap slot, or EMPTY
+    uint32_t index_mask = 0;
+    uint32_t k = 0;
+
+    inline uint32_t find_slot(const FlowKey& key, uint32_t hash) const {
+        uint32_t s = hash & index_mask;
+        while (index[s] != EMPTY && !(heap[index[s]].hash == hash && heap[index[s]].key == key))
+            s = (s + 1) & index_mask;
+        return s;
+    }
+
+    // Backward-shift deletion, keeps every probe sequence intact without tombstones
+    void erase_slot(uint32_t s) {
+        uint32_t hole = s;
+        index[hole] = EMPTY;
+        for (uint32_t cur = (hole + 1) & index_mask; index[cur] != EMPTY; cur = (cur + 1) & index_mask) {
+            uint32_t home = heap[index[cur]].hash & index_mask;
+            //Move cur into the hole unless its home lies cyclically in (hole, cur]
+            bool stays = (hole <= cur) ? (home > hole && home <= cur) : (home > hole || home <= cur);
+            if (!stays) {
+                index[hole] = index[cur];
+                index[cur] = EMPTY;
+                hole = cur;
+            }
+        }
+    }
+
+    // Look both slots up while heap[] still matches index[], then swap both sides
+    void swap_entries(uint32_t a, uint32_t b) {
+        uint32_t sa = find_slot(heap[a].key, heap[a].hash);
+        uint32_t sb = find_slot(heap[b].key, heap[b].hash);
+        std::swap(heap[a], heap[b]);
+        std::swap(index[sa], index[sb]);
+    }
+
+    void sift_down(uint32_t i) {
+        while (true) {
+            uint32_t smallest = i, l = 2 * i + 1, r = 2 * i + 2;
+            if (l < heap.size() && heap[l].count < heap[smallest].count)
+                smallest = l;
+            if (r < heap.size() && heap[r].count < heap[smallest].count)
+                smallest = r;
+            if (smallest == i)
+                return;
+            swap_entries(i, smallest);
+            i = smallest;
+        }
+    }
+
+    void sift_up(uint32_t i) {
+        while (i > 0 && heap[(i - 1) / 2].count > heap[i].count) {
+            swap_entries(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+public:
+    void init(uint32_t capacity) {
+        k = capacity;
+        heap.clear();
+        heap.reserve(k);
+        uint32_t index_size = 1;
+        while (index_size < 4 * k)
+            index_size <<= 1;
+        index.assign(index_size, EMPTY);
+        index_mask = index_size - 1;
+    }
+
+    inline uint32_t min_count() const {
+        return heap.size() < k ? 0 : heap[0].count;
+    }
+
+    inline void offer(const FlowKey& key, uint32_t hash, uint32_t count) {
+        if (count <= min_count())
+            return;
+        uint32_t s = find_slot(key, hash);
+        if (index[s] != EMPTY) {
+            heap[index[s]].count = count;
+            sift_down(index[s]);
+            return;
+        }
+        if (heap.size() < k) {
+            heap.push_back({key, hash, count});
+            index[s] = heap.size() - 1;
+            sift_up(heap.size() - 1);
+            return;
+        }
+        //Evict the minimum, then the new flow takes its place at the root
+        erase_slot(find_slot(heap[0].key, heap[0].hash));
+        heap[0] = {key, hash, count};
+        index[find_slot(key, hash)] = 0;
+        sift_down(0);
+    }
+
+    const std::vector<Entry>& entries() const { return heap; }
+
+    // Every heap entry is found at its own slot and the index holds nothing else
+    bool consistent() const {
+        size_t used = 0;
+        for (int32_t slot : index)
+            used += (slot != EMPTY);
+        if (used != heap.size())
+            return false;
+        for (uint32_t i = 0; i < heap.size(); i++) {
+            if (index[find_slot(heap[i].key, heap[i].hash)] != (int32_t)i)
+                return false;
+        }
+        return true;
+    }
+};
+
+} // namespace dpdk_apps
+
+#endif /* SKETCHES_H */
@@ -0,0 +1,125 @@
+#ifndef TEDDY_KERNELS_H
+#define TEDDY_KERNELS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "simd_dispatch.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Teddy multi-literal prefilter (the Hyperscan one, without the fat variant).
+ * Patterns are sorted by their first bytes and split into 8 buckets. For each of the first `width`
+ * bytes (1 to 3, no more than the shortest pattern) there are two 16-entry tables, indexed by the low
+ * and the high nibble, whose bit b says "some pattern of bucket b can have this nibble here".
+ * Offset i is a candidate when, for one bucket, all width bytes from i pass both nibble lookups.
+ *
+ * The scan only returns the first candidate: every match starts at a candidate, so a verifier run
+ * from there still sees all of them, and a packet without candidates is never verified.
+ * The tables are 16 bytes, repeated in both halves so that vpshufb looks them up per 128-bit lane.
+ */
+struct TeddyMasks {
+    static constexpr int MAX_WIDTH = 3;
+    static constexpr int NUM_BUCKETS = 8;
+
+    int width = 1;
+    alignas(32) uint8_t lo[MAX_WIDTH][32];
+    alignas(32) uint8_t hi[MAX_WIDTH][32];
+
+    void build(const std::vector<std::string>& patterns)
+    {
+        size_t min_len = SIZE_MAX;
+        for (const std::string& p : patterns)
+            min_len = std::min(min_len, p.size());
+        width = (int)std::max<size_t>(1, std::min<size_t>(MAX_WIDTH, min_len));
+        memset(lo, 0, sizeof(lo));
+        memset(hi, 0, sizeof(hi));
+
+        //Similar prefixes in the same bucket keep the cross-pattern false positives down
+        std::vector<std::string> prefixes;
+        for (const std::string& p : patterns)
+            prefixes.push_back(p.substr(0, width));
+        std::sort(prefixes.begin(), prefixes.end());
+        prefixes.erase(std::unique(prefixes.begin(), prefixes.end()), prefixes.end());
+
+        size_t per_bucket = (prefixes.size() + NUM_BUCKETS - 1) / NUM_BUCKETS;
+        for (size_t i = 0; i < prefixes.size(); i++) {
+            uint8_t bucket_bit = 1 << (i / per_bucket);
+            for (int k = 0; k < width; k++) {
+                uint8_t c = prefixes[i][k];
+                lo[k][c & 0xF] |= bucket_bit;
+                hi[k][c >> 4] |= bucket_bit;
+            }
+        }
+        for (int k = 0; k < width; k++) {
+            memcpy(lo[k] + 16, lo[k], 16);
+            memcpy(hi[k] + 16, hi[k], 16);
+        }
+    }
+};
+
+// Offset of the first candidate in data[from, len), len when there is none
+typedef uint32_t (*teddy_scan_fn)(const TeddyMasks& t, const uint8_t* data, uint32_t from, uint32_t len);
+
+inline uint32_t teddy_scan_scalar(const TeddyMasks& t, const uint8_t* data, uint32_t from, uint32_t len)
+{
+    if (len < (uint32_t)t.width)
+        return len;
+    for (uint32_t i = from; i + t.width <= len; i++) {
+        uint8_t acc = 0xFF;
+        for (int k = 0; k < t.width; k++) {
+            uint8_t c = data[i + k];
+            acc &= t.lo[k][c & 0xF] & t.hi[k][c >> 4];
+        }
+        if (acc)
+            return i;
+    }
+    return len;
+}
+
+__attribute__((target("avx2")))
+inline uint32_t teddy_scan_avx2(const TeddyMasks& t, const uint8_t* data, uint32_t from, uint32_t len)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo[TeddyMasks::MAX_WIDTH], hi[TeddyMasks::MAX_WIDTH];
+    for (int k = 0; k < t.width; k++) {
+        lo[k] = _mm256_load_si256((const __m256i*)t.lo[k]);
+        hi[k] = _mm256_load_si256((const __m256i*)t.hi[k]);
+    }
+
+    uint32_t i = from;
+    for (; i + 32 + t.width - 1 <= len; i += 32) {
+        __m256i acc = _mm256_set1_epi8((char)0xFF);
+        for (int k = 0; k < t.width; k++) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(data + i + k));
+            __m256i v_lo = _mm256_and_si256(v, nibble);
+            __m256i v_hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+            acc = _mm256_and_si256(acc, _mm256_and_si256(_mm256_shuffle_epi8(lo[k], v_lo), _mm256_shuffle_epi8(hi[k], v_hi)));
+        }
+        uint32_t candidates = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(acc, zero));
+        if (candidates)
+            return i + __builtin_ctz(candidates);
+    }
+    return teddy_scan_scalar(t, data, i, len);
+}
+
+// No AVX-512 variant, the scan is load bound and the AVX2 one already streams two lines per iteration
+inline teddy_scan_fn teddy_select_kernel(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_AVX512:
+        case SIMD_AVX2:     return teddy_scan_avx2;
+        default:            return teddy_scan_scalar;
+    }
+}
+
+} // namespace dpdk_apps
+
+#endif /* TEDDY_KERNELS_H */
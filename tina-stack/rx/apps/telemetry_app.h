@@ -0,0 +1,282 @@
+#ifndef TELEMETRY_APP_H
+#define TELEMETRY_APP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <rte_eal.h>
+#include <rte_ip.h>
+#include <rte_udp.h>
+#include <rte_cycles.h>
+
+#include "base_app.h"
+#include "flow_hash_kernels.h"
+#include "sketches.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Streaming flow telemetry over the 5-tuple: a count-min sketch (per-flow packet counts), a
+ * HyperLogLog (distinct flows) and a count-min fed top-k (heavy hitters).
+ * Every lcore updates private sketches, the burst is hashed at once with the SIMD flow hash.
+ * The monitor merges all lcores on every interval: count-min counters add up, HLL registers take
+ * the max, and the heavy-hitter candidates of every lcore are re-ranked on the merged count-min.
+ * The sketches are cumulative since start. Their counters and registers are single words the merge
+ * reads while the lcores keep writing, a merged value may lag by a few updates but is never torn.
+ * The top-k heap moves whole entries around, so the merge never reads it: every PUBLISH_MS the
+ * owning lcore copies its candidates into the spare half of a double buffer and flips the
+ * generation, the merge retries a copy the lcore flipped under it.
+ *
+ * The count-min size is the tunable footprint (KB), rounded down to a power-of-2 width.
+ */
+class TelemetryApp: public BaseApp {
+
+private:
+    static constexpr uint64_t DEFAULT_CM_KB = 1024;
+    static constexpr uint32_t DEFAULT_TOP_K = 32;
+    static constexpr uint32_t TOP_PRINTED_INTERVAL = 5;
+    static constexpr uint64_t PUBLISH_MS = 100;
+
+    static uint32_t cm_width;
+    static uint32_t top_k;
+    static SimdLevel simd_level;
+    static flow_hash_fn hash_kernel;
+    static std::vector<TelemetryApp*> instances;
+
+    //*** Merged view, main lcore only */
+    static CountMinSketch merged_cm;
+    static HyperLogLog merged_hll;
+    static uint64_t merged_pkts_snapshot;
+    static uint64_t merged_tsc_snapshot;
+
+    CountMinSketch cm;
+    HyperLogLog hll;
+    TopK topk;
+
+    //*** Top-k candidates published by the owning lcore, buffer gen & 1 is the current one */
+    std::vector<TopK::Entry> published[2];
+    std::atomic<uint32_t> published_gen{0};
+    uint64_t publish_cycles = 0;
+    uint64_t next_publish = 0;
+
+    uint64_t num_pkts = 0;
+    uint64_t hash_cycles = 0;
+    uint64_t update_cycles = 0;
+
+    struct _heavy_hitter {
+        FlowKey key;
+        uint32_t count;
+    };
+
+    // Merge every lcore into the static view, return the merged top n
+    static std::vector<_heavy_hitter> merge(uint64_t* pkts, size_t n)
+    {
+        merged_cm.clear();
+        merged_hll.clear();
+        *pkts = 0;
+        std::vector<TopK::Entry> candidates;
+        for (TelemetryApp* app : instances) {
+            merged_cm.merge(app->cm);
+            merged_hll.merge(app->hll);
+            *pkts += app->num_pkts;
+            app->read_published(candidates);
+        }
+
+        std::vector<_heavy_hitter> top;
+        for (const TopK::Entry& c : candidates) {
+            if (std::find_if(top.begin(), top.end(), [&c](const _heavy_hitter& h) { return h.key == c.key; }) != top.end())
+                continue;
+            const uint32_t* const words[4] = {&c.key.src_ip, &c.key.dst_ip, &c.key.ports, &c.key.proto};
+            uint32_t h1, h2;
+            flow_hash_scalar(words, 1, &h1, &h2);
+            top.push_back({c.key, merged_cm.estimate(h1, h2)});
+        }
+        std::sort(top.begin(), top.end(), [](const _heavy_hitter& a, const _heavy_hitter& b) { return a.count > b.count; });
+        if (top.size() > n)
+            top.resize(n);
+        return top;
+    }
+
+    static std::string key_str(const FlowKey& key)
+    {
+        char src[INET_ADDRSTRLEN], dst[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &key.src_ip, src, sizeof(src));
+        inet_ntop(AF_INET, &key.dst_ip, dst, sizeof(dst));
+        std::ostringstream out;
+        out << src << ":" << ntohs(key.ports >> 16) << " -> " << dst << ":" << ntohs(key.ports & 0xFFFF) << " /" << key.proto;
+        return out.str();
+    }
+
+public:
+
+    // Size the sketches, rte_exit if the footprint can't hold one counter per row
+    static void init(uint64_t cm_kb, uint64_t k)
+    {
+        uint64_t bytes = (cm_kb ? cm_kb : DEFAULT_CM_KB) << 10;
+        uint64_t width = bytes / (CountMinSketch::DEPTH * sizeof(uint32_t));
+        if (width == 0 || width > (1ULL << 31))
+            rte_exit(EXIT_FAILURE, "Telemetry: count-min footprint %lu KB out of range\n", cm_kb);
+        cm_width = 1U << (63 - __builtin_clzll(width));
+        top_k = k ? k : DEFAULT_TOP_K;
+        simd_level = detect_simd_level();
+        hash_kernel = flow_hash_select_kernel(simd_level);
+        merged_cm.init(cm_width);
+
+        printf("Telemetry: count-min %u x %u (%lu KB, eps %.2e), HLL 2^%u registers, top-%u, flow hash %s\n",
+            CountMinSketch::DEPTH, cm_width, ((uint64_t)cm_width * CountMinSketch::DEPTH * sizeof(uint32_t)) >> 10,
+            M_E / cm_width, HyperLogLog::P, top_k, simd_level_str(simd_level));
+    }
+
+    TelemetryApp() {
+        cm.init(cm_width);
+        topk.init(top_k);
+        published[0].reserve(top_k);
+        published[1].reserve(top_k);
+        publish_cycles = rte_get_tsc_hz() * PUBLISH_MS / 1000;
+        instances.push_back(this);
+    }
+    ~TelemetryApp() {}
+
+    void run(char* pkt_ptr, size_t len) override {
+        const rte_ipv4_hdr* ip = (const rte_ipv4_hdr*)(pkt_ptr + sizeof(rte_ether_hdr));
+        const rte_udp_hdr* udp = (const rte_udp_hdr*)(ip + 1);
+        FlowKey key = {ip->src_addr, ip->dst_addr, (uint32_t)udp->src_port << 16 | udp->dst_port, ip->next_proto_id};
+        const uint32_t* const words[4] = {&key.src_ip, &key.dst_ip, &key.ports, &key.proto};
+        uint32_t h1, h2;
+        flow_hash_scalar(words, 1, &h1, &h2);
+        update(key, h1, h2);
+        num_pkts++;
+        maybe_publish(rte_get_tsc_cycles());
+    }
+
+    uint64_t run_burst(rte_mbuf** pkts, uint64_t nb_pkts) override
+    {
+        uint32_t src[MAX_BURST], dst[MAX_BURST], ports[MAX_BURST], proto[MAX_BURST];
+        uint32_t h1[MAX_BURST], h2[MAX_BURST];
+        assert(nb_pkts <= MAX_BURST);
+
+        uint64_t start = rte_get_tsc_cycles();
+        for (uint64_t i = 0; i < nb_pkts; i++) {
+            const rte_ipv4_hdr* ip = rte_pktmbuf_mtod_offset(pkts[i], const rte_ipv4_hdr*, sizeof(rte_ether_hdr));
+            const rte_udp_hdr* udp = (const rte_udp_hdr*)(ip + 1);
+            src[i] = ip->src_addr;
+            dst[i] = ip->dst_addr;
+            ports[i] = (uint32_t)udp->src_port << 16 | udp->dst_port;
+            proto[i] = ip->next_proto_id;
+        }
+        const uint32_t* const words[4] = {src, dst, ports, proto};
+        hash_kernel(words, nb_pkts, h1, h2);
+        uint64_t mid = rte_get_tsc_cycles();
+
+        for (uint64_t i = 0; i < nb_pkts; i++)
+            update({src[i], dst[i], ports[i], proto[i]}, h1[i], h2[i]);
+        num_pkts += nb_pkts;
+
+        uint64_t end = rte_get_tsc_cycles();
+        hash_cycles += mid - start;
+        update_cycles += end - mid;
+        maybe_publish(end);
+        return nb_pkts;
+    }
+
+    // Workers are done, publish what they added since their last interval
+    void stop() override {
+        assert(topk.consistent());
+        publish();
+    }
+
+    std::string print_interval_stats() override {
+        uint64_t pkts;
+        std::vector<_heavy_hitter> top = merge(&pkts, TOP_PRINTED_INTERVAL);
+        uint64_t now = rte_get_tsc_cycles();
+        double seconds = (double)(now - merged_tsc_snapshot) / rte_get_tsc_hz();
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(0)
+            << "Telemetry pkts/s: " << (merged_tsc_snapshot && seconds > 0 ? (pkts - merged_pkts_snapshot) / seconds : 0.0)
+            << " -- distinct flows: " << merged_hll.estimate()
+            << " -- top " << top.size() << ":";
+        for (const _heavy_hitter& h : top)
+            out << " [" << key_str(h.key) << " " << h.count << "]";
+        merged_pkts_snapshot = pkts;
+        merged_tsc_snapshot = now;
+        return out.str();
+    }
+
+    std::string print_stats() override {
+        uint64_t pkts, hash = 0, upd = 0;
+        std::vector<_heavy_hitter> top = merge(&pkts, top_k);
+        for (TelemetryApp* app : instances) {
+            hash += app->hash_cycles;
+            upd += app->update_cycles;
+        }
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << "============ TELEMETRY APP STATS ============\n"
+            << "Count-Min: " << CountMinSketch::DEPTH << " x " << cm_width
+            << " -- HLL: 2^" << HyperLogLog::P << " -- Top-K: " << top_k
+            << " -- Flow Hash: " << simd_level_str(simd_level) << " -- Lcores: " << instances.size() << "\n"
+            << "Packets: " << pkts << " -- Distinct Flows (HLL): " << std::setprecision(0) << merged_hll.estimate() << "\n"
+            << std::setprecision(2)
+            << "Cycles/Packet -- hash: " << (pkts ? (double)hash / pkts : 0.0)
+            << " -- update: " << (pkts ? (double)upd / pkts : 0.0) << "\n"
+            << "Heavy Hitters (count-min estimate):\n";
+        for (const _heavy_hitter& h : top)
+            out << "  " << key_str(h.key) << "  " << h.count << "\n";
+        return out.str();
+    }
+
+private:
+
+    inline void update(const FlowKey& key, uint32_t h1, uint32_t h2) {
+        uint32_t count = cm.update(h1, h2);
+        hll.add((uint64_t)h1 << 32 | h2);
+        topk.offer(key, h1, count);
+    }
+
+    // Owning lcore only
+    void publish() {
+        uint32_t gen = published_gen.load(std::memory_order_relaxed);
+        const std::vector<TopK::Entry>& e = topk.entries();
+        std::vector<TopK::Entry>& spare = published[(gen + 1) & 1];
+        spare.assign(e.begin(), e.begin() + std::min(e.size(), (size_t)top_k));
+        published_gen.store(gen + 1, std::memory_order_release);
+    }
+
+    inline void maybe_publish(uint64_t now) {
+        if (now < next_publish)
+            return;
+        publish();
+        next_publish = now + publish_cycles;
+    }
+
+    // Append the current candidates, retrying while the owner flips the buffer being copied
+    void read_published(std::vector<TopK::Entry>& out) const {
+        size_t mark = out.size();
+        for (;;) {
+            uint32_t gen = published_gen.load(std::memory_order_acquire);
+            const std::vector<TopK::Entry>& cur = published[gen & 1];
+            out.insert(out.end(), cur.begin(), cur.begin() + std::min(cur.size(), (size_t)top_k));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (published_gen.load(std::memory_order_relaxed) == gen)
+                return;
+            out.resize(mark);
+        }
+    }
+};
+
+
+} // namespace dpdk_apps
+#endif /* TELEMETRY_APP_H */
@@ -0,0 +1,169 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+
+namespace dpdk_apps{
+
+/**
+ * Intrusive node for TimerWheel, embed it into whatever needs to expire.
+ * !A node can only sit in one slot at a time, always cancel() before reuse
+ */
+struct TimerNode {
+    TimerNode* prev = nullptr;
+    TimerNode* next = nullptr;
+    uint64_t expire_tick = 0;
+
+    bool scheduled() const { return next != nullptr; }
+};
+
+/**
+ * Hierarchical timing wheel (Varghese & Lauck), LEVELS x 2^SLOT_BITS slots.
+ * Level 0 has a resolution of 1 tick, level n covers 2^(SLOT_BITS * (n+1)) ticks.
+ * Schedule/cancel are O(1), advance() only walks the slots it passes and cascades
+ * the upper level slot every time the lower level wraps.
+ *
+ * advance() takes a budget so that the caller (the RX path) never spends more than
+ * a bounded amount of work in one call: at most budget nodes fired and MAX_TICKS_PER_ADVANCE
+ * slots walked, the rest is done on next call. An empty wheel jumps straight to the target.
+ */
+template <size_t LEVELS = 4, size_t SLOT_BITS = 8>
+class TimerWheel {
+
+private:
+    static constexpr uint64_t SLOTS = 1ULL << SLOT_BITS;
+    static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+    static constexpr uint64_t MAX_TICKS_PER_ADVANCE = SLOTS;
+    static constexpr uint64_t MAX_DELTA = (LEVELS * SLOT_BITS >= 64) ? UINT64_MAX : ((1ULL << (LEVELS * SLOT_BITS)) - 1);
+
+    TimerNode slots[LEVELS][SLOTS];     // Sentinels of circular lists
+    uint64_t now_tick;
+    uint64_t num_scheduled = 0;
+
+    static void list_init(TimerNode* head) {
+        head->prev = head;
+        head->next = head;
+    }
+
+    static void list_add_tail(TimerNode* head, TimerNode* node) {
+        node->prev = head->prev;
+        node->next = head;
+        head->prev->next = node;
+        head->prev = node;
+    }
+
+    static void list_del(TimerNode* node) {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        node->prev = nullptr;
+        node->next = nullptr;
+    }
+
+    TimerNode* slot_for(uint64_t expire_tick) {
+        uint64_t delta = expire_tick - now_tick;
+        for (size_t level = 0; level < LEVELS - 1; level++) {
+            if (delta < (1ULL << (SLOT_BITS * (level + 1))))
+                return &slots[level][(expire_tick >> (SLOT_BITS * level)) & SLOT_MASK];
+        }
+        if (delta > MAX_DELTA)
+            expire_tick = now_tick + MAX_DELTA;
+        return &slots[LEVELS - 1][(expire_tick >> (SLOT_BITS * (LEVELS - 1))) & SLOT_MASK];
+    }
+
+    // Re-distribute one upper level slot into the lower levels, called when level-1 wraps
+    void cascade(size_t level) {
+        if (level >= LEVELS)
+            return;
+        uint64_t idx = (now_tick >> (SLOT_BITS * level)) & SLOT_MASK;
+        if (idx == 0)
+            cascade(level + 1);
+
+        TimerNode* head = &slots[level][idx];
+        TimerNode pending;
+        list_init(&pending);
+        while (head->next != head) {
+            TimerNode* node = head->next;
+            list_del(node);
+            list_add_tail(&pending, node);
+        }
+        while (pending.next != &pending) {
+            TimerNode* node = pending.next;
+            list_del(node);
+            list_add_tail(slot_for(node->expire_tick), node);
+        }
+    }
+
+public:
+    TimerWheel(uint64_t start_tick = 0): now_tick(start_tick) {
+        for (size_t l = 0; l < LEVELS; l++)
+            for (size_t s = 0; s < SLOTS; s++)
+                list_init(&slots[l][s]);
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    uint64_t current_tick() const { return now_tick; }
+    uint64_t size() const { return num_scheduled; }
+
+    void schedule(TimerNode* node, uint64_t expire_tick) {
+        assert(!node->scheduled() && "TimerNode is already scheduled");
+        // Never schedule into the slot currently being drained, o/w advance() could spin
+        node->expire_tick = (expire_tick > now_tick) ? expire_tick : now_tick + 1;
+        list_add_tail(slot_for(node->expire_tick), node);
+        num_scheduled++;
+    }
+
+    void cancel(TimerNode* node) {
+        if (!node->scheduled())
+            return;
+        list_del(node);
+        num_scheduled--;
+    }
+
+    /**
+     * Move the wheel toward target_tick, firing at most budget expired nodes and walking at most
+     * MAX_TICKS_PER_ADVANCE ticks.
+     * on_expire(TimerNode*) is called with the node already unlinked, it may schedule() it again.
+     * Return the number of fired nodes.
+     */
+    template <typename F>
+    size_t advance(uint64_t target_tick, size_t budget, F&& on_expire) {
+        size_t fired = 0;
+        uint64_t ticks = 0;
+        while (true) {
+            //Nothing can fire nor cascade, every slot is empty
+            if (num_scheduled == 0) {
+                if (now_tick < target_tick)
+                    now_tick = target_tick;
+                return fired;
+            }
+
+            TimerNode* head = &slots[0][now_tick & SLOT_MASK];
+            while (head->next != head) {
+                if (fired == budget)
+                    return fired;
+                TimerNode* node = head->next;
+                list_del(node);
+                num_scheduled--;
+                fired++;
+                on_expire(node);
+            }
+
+            if (now_tick >= target_tick || ticks == MAX_TICKS_PER_ADVANCE)
+                return fired;
+
+            now_tick++;
+            ticks++;
+            if ((now_tick & SLOT_MASK) == 0)
+                cascade(1);
+        }
+    }
+};
+
+} // namespace dpdk_apps
+
+#endif /* TIMER_WHEEL_H */
@@ -0,0 +1,161 @@
+#ifndef TOUCH_APP_H
+#define TOUCH_APP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+
+#include <rte_cycles.h>
+
+#include "base_app.h"
+#include "fast_rand.h"
+#include "service_time.h"
+#include "workload_gen.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Emulated microservice: read touch_bytes of every packet, then busy-wait for a service time
+ * drawn from a ServiceTimeDist. One instance per lcore, each with its own PRNG stream (workload seed + lcore).
+ *
+ * The wait is measured from the start of the packet, so touching the data and drawing the sample
+ * are part of the service time instead of being added to it. A packet whose touch + draw already
+ * overshoots the drawn time is counted as an overrun.
+ * The legacy plain-number spec keeps the old behaviour: touch the whole burst, then wait once.
+ */
+class TouchApp: public BaseApp {
+
+private:
+    static constexpr int HIST_BUCKETS = 64;          // log2(ns) buckets
+
+    static ServiceTimeDist dist_config;
+    static uint64_t touch_bytes;                     // 0 = the whole packet
+    static std::vector<TouchApp*> instances;
+
+    int core_id;
+    ServiceTimeDist dist;
+    FastRand rng;
+    volatile uint64_t touch_sink = 0;
+
+    uint64_t num_pkts = 0;
+    uint64_t num_bytes_touched = 0;
+    uint64_t num_overrun = 0;
+    uint64_t drawn_ns_sum = 0;
+    uint64_t drawn_ns_max = 0;
+    uint64_t drawn_ns_hist[HIST_BUCKETS] = {0};
+
+public:
+
+    // Parse the distribution once, rte_exit on a bad spec
+    static void init(const std::string& spec, uint64_t bytes, uint64_t tsc_hz)
+    {
+        if (!dist_config.parse(spec, tsc_hz))
+            rte_exit(EXIT_FAILURE, "Touch: invalid service time %s, should be <ns>, const:<ns>, exp:<mean>, "
+                                   "bimodal:<ns1>:<ns2>:<p2>, lognormal:<mean>:<sigma> or cdf:<file>\n", spec.c_str());
+        touch_bytes = bytes;
+    }
+
+    static std::string describe() {
+        return dist_config.describe();
+    }
+
+    TouchApp(int core_id): core_id(core_id), dist(dist_config), rng(workload_config.seed + core_id) {
+        instances.push_back(this);
+    }
+    ~TouchApp() {}
+
+    void run(char* pkt_ptr, size_t len) override {
+        uint64_t start = rte_rdtsc();
+        touch(pkt_ptr, len);
+
+        uint64_t ns = dist.sample_ns(rng);
+        uint64_t deadline = start + dist.ns_to_cycles(ns);
+        record(ns);
+
+        if (rte_rdtsc() >= deadline)
+            num_overrun++;
+        while (rte_rdtsc() < deadline);
+    }
+
+    uint64_t run_burst(rte_mbuf** pkts, uint64_t nb_pkts) override {
+        if (!dist.is_per_burst())
+            return BaseApp::run_burst(pkts, nb_pkts);
+
+        for (uint64_t i = 0; i < nb_pkts; i++)
+            touch(rte_pktmbuf_mtod(pkts[i], char*), pkts[i]->pkt_len);
+
+        uint64_t ns = dist.sample_ns(rng);
+        uint64_t deadline = rte_rdtsc() + dist.ns_to_cycles(ns);
+        record(ns);
+        while (rte_rdtsc() < deadline);
+        return nb_pkts;
+    }
+
+    std::string print_stats() override {
+        uint64_t pkts = 0, bytes = 0, overrun = 0, samples = 0, ns_sum = 0, ns_max = 0;
+        uint64_t hist[HIST_BUCKETS] = {0};
+        for (TouchApp* app : instances) {
+            pkts += app->num_pkts;
+            bytes += app->num_bytes_touched;
+            overrun += app->num_overrun;
+            ns_sum += app->drawn_ns_sum;
+            ns_max = std::max(ns_max, app->drawn_ns_max);
+            for (int b = 0; b < HIST_BUCKETS; b++) {
+                hist[b] += app->drawn_ns_hist[b];
+                samples += app->drawn_ns_hist[b];
+            }
+        }
+
+        std::ostringstream out;
+        out << "============ TOUCH APP STATS ============\n"
+            << "Service Time: " << describe() << " -- Lcores: " << instances.size()
+            << " -- Touch: " << (touch_bytes ? std::to_string(touch_bytes) + " B" : std::string("whole packet")) << "\n"
+            << "Packets: " << pkts
+            << " -- Bytes Touched: " << bytes
+            << " -- Overrun: " << overrun << "\n"
+            << "Drawn (ns) -- mean: " << std::fixed << std::setprecision(1) << (samples ? (double)ns_sum / samples : 0.0)
+            << " -- p50 <= " << percentile(hist, samples, 0.5)
+            << " -- p99 <= " << percentile(hist, samples, 0.99)
+            << " -- p99.9 <= " << percentile(hist, samples, 0.999)
+            << " -- max: " << ns_max << "\n";
+        return out.str();
+    }
+
+private:
+
+    inline void touch(const char* pkt_ptr, size_t len) {
+        size_t n = (touch_bytes && touch_bytes < len) ? touch_bytes : len;
+        uint64_t sum = 0;
+        for (size_t k = 0; k < n; k += 64)      // One read per cacheline is enough to bring it into L2
+            sum += pkt_ptr[k];
+        touch_sink = sum;
+        num_bytes_touched += n;
+        num_pkts++;
+    }
+
+    inline void record(uint64_t ns) {
+        drawn_ns_sum += ns;
+        drawn_ns_max = std::max(drawn_ns_max, ns);
+        drawn_ns_hist[ns ? 64 - __builtin_clzll(ns) - 1 : 0]++;
+    }
+
+    // Upper bound of the log2 bucket holding quantile q
+    static uint64_t percentile(const uint64_t* hist, uint64_t samples, double q) {
+        uint64_t target = (uint64_t)(q * samples), cum = 0;
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            cum += hist[b];
+            if (cum > target)
+                return (b == HIST_BUCKETS - 1) ? UINT64_MAX : (2ULL << b) - 1;
+        }
+        return 0;
+    }
+};
+
+} // namespace dpdk_apps
+
+#endif /* TOUCH_APP_H */
@@ -0,0 +1,231 @@
+#ifndef WORKLOAD_GEN_H
+#define WORKLOAD_GEN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <rte_lcore.h>
+
+#include "fast_rand.h"
+
+
+namespace dpdk_apps{
+
+/**
+ * Workload key generators shared by the apps that pick keys on their own (KVS, KNN, ...).
+ *
+ *   uniform                            every key equally likely
+ *   zipf[:<theta>]                     YCSB Zipfian (default theta 0.99), ranks scrambled over the key space
+ *                                      so hot keys don't all sit at the start of the table
+ *   hotspot[:<hot keys>:<hot ops>]     fraction <hot ops> of the draws hit the first <hot keys> fraction
+ *                                      of the key space (default 0.2:0.8), uniform within each part
+ *   payload                            the key is a field of the packet, so the TX side controls the skew
+ *
+ * Every lcore draws from its own stream seeded with (seed + lcore id); the seed is printed at startup,
+ * passing it back with --seed replays the same key sequence.
+ */
+enum KeyDist {
+    KEY_UNIFORM = 0,
+    KEY_ZIPF = 1,
+    KEY_HOTSPOT = 2,
+    KEY_PAYLOAD = 3,
+
+    _KeyDistCount
+};
+
+struct WorkloadConfig {
+    KeyDist dist = KEY_UNIFORM;
+    double zipf_theta = 0.99;
+    double hot_keys = 0.2;
+    double hot_ops = 0.8;
+    uint64_t seed = 0x5eed;
+};
+
+// Set from the command line (-k, -r)
+inline WorkloadConfig workload_config;
+
+inline bool parse_key_dist(const std::string& spec, WorkloadConfig* cfg)
+{
+    if (spec == "uniform") {
+        cfg->dist = KEY_UNIFORM;
+        return true;
+    }
+    if (spec == "payload") {
+        cfg->dist = KEY_PAYLOAD;
+        return true;
+    }
+    if (spec.compare(0, 4, "zipf") == 0) {
+        cfg->dist = KEY_ZIPF;
+        if (spec == "zipf")
+            return true;
+        //YCSB's closed form needs theta < 1
+        return sscanf(spec.c_str(), "zipf:%lf", &cfg->zipf_theta) == 1 && cfg->zipf_theta > 0 && cfg->zipf_theta < 1;
+    }
+    if (spec.compare(0, 7, "hotspot") == 0) {
+        cfg->dist = KEY_HOTSPOT;
+        if (spec == "hotspot")
+            return true;
+        return sscanf(spec.c_str(), "hotspot:%lf:%lf", &cfg->hot_keys, &cfg->hot_ops) == 2 &&
+               cfg->hot_keys > 0 && cfg->hot_keys <= 1 && cfg->hot_ops >= 0 && cfg->hot_ops <= 1;
+    }
+    return false;
+}
+
+inline std::string key_dist_str(const WorkloadConfig& cfg)
+{
+    char buf[64];
+    switch (cfg.dist) {
+        case KEY_UNIFORM:   return "uniform";
+        case KEY_ZIPF:      snprintf(buf, sizeof(buf), "zipf (theta %.2f)", cfg.zipf_theta); return buf;
+        case KEY_HOTSPOT:   snprintf(buf, sizeof(buf), "hotspot (%.2f of keys, %.2f of ops)", cfg.hot_keys, cfg.hot_ops); return buf;
+        case KEY_PAYLOAD:   return "payload";
+        default:            return "unknown";
+    }
+}
+
+/**
+ * One key stream over [0, num_keys).
+ */
+class alignas(64) KeyGen {
+
+private:
+    KeyDist dist = KEY_UNIFORM;
+    uint64_t num_keys = 1;
+    FastRand rand_gen;
+
+    //*** Zipf, see Gray et al., "Quickly Generating Billion-Record Synthetic Databases" */
+    double theta = 0;
+    double zetan = 0;
+    double alpha = 0;
+    double eta = 0;
+    double rank1_bound = 0;         // 1 + 0.5^theta
+
+    //*** Hotspot */
+    uint64_t hot_keys = 0;
+    double hot_ops = 0;
+
+public:
+
+    // zetan is only used by KEY_ZIPF, compute it once with zeta() and share it between lcores
+    void init(const WorkloadConfig& cfg, uint64_t keys, double zeta_n, uint64_t seed)
+    {
+        dist = cfg.dist;
+        num_keys = keys ? keys : 1;
+        rand_gen.reseed(seed);
+
+        theta = cfg.zipf_theta;
+        zetan = zeta_n;
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - pow(2.0 / num_keys, 1.0 - theta)) / (1.0 - zeta(2, theta) / zetan);
+        rank1_bound = 1.0 + pow(0.5, theta);
+
+        hot_keys = std::max<uint64_t>(1, (uint64_t)(cfg.hot_keys * num_keys));
+        hot_ops = cfg.hot_ops;
+    }
+
+    // Next key, payload_key is only read by KEY_PAYLOAD (nullptr falls back to uniform)
+    inline uint64_t next(const void* payload_key = nullptr)
+    {
+        switch (dist) {
+            case KEY_ZIPF:
+                return scramble(next_zipf_rank()) % num_keys;
+            case KEY_HOTSPOT:
+                if (rand_gen.next_double() < hot_ops || hot_keys == num_keys)
+                    return rand_gen.next_below(hot_keys);
+                return hot_keys + rand_gen.next_below(num_keys - hot_keys);
+            case KEY_PAYLOAD:
+                if (payload_key != nullptr) {
+                    uint64_t key;
+                    memcpy(&key, payload_key, sizeof(key));
+                    return key % num_keys;
+                }
+                return rand_gen.next_below(num_keys);
+            case KEY_UNIFORM:
+            default:
+                return rand_gen.next_below(num_keys);
+        }
+    }
+
+    // Raw stream, for the app's own decisions (operation mix, ...)
+    FastRand& rng() { return rand_gen; }
+
+    // sum_{i=1..n} 1 / i^theta, the tail past 10M terms is integrated (error well below 1e-6 relative)
+    static double zeta(uint64_t n, double theta)
+    {
+        constexpr uint64_t EXACT_TERMS = 10000000;
+        double sum = 0;
+        uint64_t m = std::min(n, EXACT_TERMS);
+        for (uint64_t i = 1; i <= m; i++)
+            sum += 1.0 / pow((double)i, theta);
+        if (n > m) {
+            double s = 1.0 - theta;
+            sum += (pow(n + 0.5, s) - pow(m + 0.5, s)) / s;
+        }
+        return sum;
+    }
+
+private:
+
+    inline uint64_t next_zipf_rank()
+    {
+        double u = rand_gen.next_double();
+        double uz = u * zetan;
+        if (uz < 1.0)
+            return 0;
+        if (uz < rank1_bound)
+            return 1;
+        uint64_t rank = (uint64_t)(num_keys * pow(eta * u - eta + 1.0, alpha));
+        return rank < num_keys ? rank : num_keys - 1;
+    }
+
+    // FNV-1a over the 8 bytes of the rank, as YCSB's ScrambledZipfianGenerator
+    static inline uint64_t scramble(uint64_t rank)
+    {
+        uint64_t h = 0xCBF29CE484222325ULL;
+        for (int i = 0; i < 8; i++) {
+            h ^= rank & 0xFF;
+            h *= 0x100000001B3ULL;
+            rank >>= 8;
+        }
+        return h;
+    }
+};
+
+/**
+ * One KeyGen per lcore id, for apps shared by all RX lcores.
+ * Threads outside the EAL share the last slot.
+ */
+class KeyGenSet {
+
+private:
+    std::vector<KeyGen> gens;
+
+public:
+    void init(uint64_t num_keys, const char* who)
+    {
+        const WorkloadConfig& cfg = workload_config;
+        double zeta_n = (cfg.dist == KEY_ZIPF) ? KeyGen::zeta(num_keys, cfg.zipf_theta) : 0;
+
+        gens.resize(RTE_MAX_LCORE + 1);
+        for (uint64_t i = 0; i < gens.size(); i++)
+            gens[i].init(cfg, num_keys, zeta_n, cfg.seed + i);
+        printf("%s keys: %s over %lu keys, seed %lu (lcore i uses seed + i)\n",
+            who, key_dist_str(cfg).c_str(), num_keys, cfg.seed);
+    }
+
+    inline KeyGen& local()
+    {
+        unsigned id = rte_lcore_id();
+        return gens[id < RTE_MAX_LCORE ? id : RTE_MAX_LCORE];
+    }
+};
+
+} // namespace dpdk_apps
+
+#endif /* WORKLOAD_GEN_H */
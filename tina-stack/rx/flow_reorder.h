@@ -0,0 +1,298 @@
+#ifndef _FLOW_REORDER_H_
+#define _FLOW_REORDER_H_
+
+/***********************************************************************/
+/***************************** Flow Reorder ****************************/
+/***********************************************************************/
+/**
+ * Repairs the reordering the tier split causes. When the ingress tier flips, one flow's packets
+ * sit in both the DDR queue and the second-tier queues of its lcore pair, and the poller drains
+ * them one queue at a time. Between rx_burst and the software queue, every packet goes through a
+ * window sorted by its arrival key:
+ *  fpga    the nic_switch ingress timestamp (low 32 bits of fpga_tx_timestamp, 250 MHz), stamped
+ *          before the tier split
+ *  soft    the generator's TX timestamp (soft_timestamp), for NICs without the FPGA, exact only
+ *          while the flows come from one generator lcore
+ * A packet leaves once nothing can overtake it any more: every other queue of the pair was either
+ * empty on its last poll or already gave a later key. A packet held past the hold time leaves
+ * anyway, with every packet before it, so the added latency stays bounded.
+ * With the stage on, the poller reads every queue of its pair each round, so the empty flags are
+ * fresh.
+ *
+ * nic_switch.v adds 2 to the dst port of the tier-1 copy, and a 5-tuple RSS hash would send the two
+ * halves of a flow to different pairs, out of each other's window. With the stage on, the tier rules
+ * hash on the src address and port only (REORDER_RSS_TYPES): one hash for both halves, and with the
+ * second-tier queues listed node by node, entry j of either list belongs to pair j mod <pairs>.
+ *
+ * Stats are per flow (a 5-tuple hash with the dst port tier bits masked out). The reorder depth of a
+ * packet is how many packets of its own flow it was moved ahead of. A residual reorder is a packet
+ * that still leaves behind a later packet of its flow, after a hold expiry or a flow table collision.
+ */
+#include <deque>
+#include <memory>
+#include <sstream>
+#include <iomanip>
+#include <rte_hash_crc.h>
+
+#define REORDER_DEFAULT_HOLD_US 50
+#define REORDER_FLOWS 4096                  // Flow table slots, power of 2
+
+enum ReorderKey {
+    REORDER_OFF = 0,
+    REORDER_FPGA = 1,
+    REORDER_SOFT = 2
+};
+
+#define REORDER_RSS_TYPES (RTE_ETH_RSS_UDP | RTE_ETH_RSS_L3_SRC_ONLY | RTE_ETH_RSS_L4_SRC_ONLY)
+
+static ReorderKey reorder_key = REORDER_OFF;
+static uint64_t reorder_hold_us = REORDER_DEFAULT_HOLD_US;
+
+// fpga|soft[:<hold us>], false if malformed
+static bool parse_reorder(const char* spec)
+{
+    std::string s(spec);
+    size_t colon = s.find(':');
+    std::string key = s.substr(0, colon);
+    if (key == "fpga")
+        reorder_key = REORDER_FPGA;
+    else if (key == "soft")
+        reorder_key = REORDER_SOFT;
+    else
+        return false;
+
+    if (colon != std::string::npos) {
+        char* end;
+        reorder_hold_us = strtoul(s.c_str() + colon + 1, &end, 10);
+        if (*end != '\0' || reorder_hold_us == 0)
+            return false;
+    }
+    return true;
+}
+
+// The tier rules of rules rehashed on the fields the switch doesn't rewrite, when the stage is on
+static std::vector<FlowRule> reorder_rss_rules(std::vector<FlowRule> rules)
+{
+    if (reorder_key == REORDER_OFF)
+        return rules;
+    for (FlowRule& r : rules)
+        if (r.target != FlowRule::QUEUES)
+            r.rss_types = REORDER_RSS_TYPES;
+    return rules;
+}
+
+struct ReorderStats {
+    uint64_t pkts = 0;
+    uint64_t reordered = 0;             // Moved ahead of at least one packet of their flow
+    uint64_t depth_sum = 0;
+    uint64_t depth_max = 0;
+    uint64_t hold_cycles_sum = 0;
+    uint64_t hold_cycles_max = 0;
+    uint64_t expired = 0;               // Left on the hold time, not the watermarks
+    uint64_t residual = 0;              // Left behind a later packet of their flow
+};
+
+class FlowReorder {
+
+private:
+    struct Held {
+        rte_mbuf* m;
+        uint64_t key;
+        uint64_t arrival_tsc;
+        uint32_t flow;
+        uint8_t stream;
+    };
+
+    struct Stream {
+        uint64_t watermark = 0;         // Largest key seen
+        bool polled = false;
+        bool drained = false;           // Empty on its last poll
+    };
+
+    struct Flow {
+        uint64_t last_key = 0;
+        bool seen = false;
+    };
+
+    uint64_t key_shift;                 // The FPGA key wraps at 32 bits
+    uint64_t hold_cycles;
+    std::vector<Stream> streams;
+    std::vector<Flow> flows;
+    std::deque<Held> held;
+
+    bool before(uint64_t a, uint64_t b) const { return (int64_t)((a - b) << key_shift) < 0; }
+
+    uint64_t key_of(rte_mbuf* m) const {
+        const dpdk_exp_pkt* pkt = rte_pktmbuf_mtod(m, const dpdk_exp_pkt*);
+        return reorder_key == REORDER_FPGA ? (uint32_t)pkt->fpga_tx_timestamp : pkt->soft_timestamp;
+    }
+
+    // The second-tier copy of a flow has dst port bits '10' instead of '00'
+    static uint32_t flow_of(rte_mbuf* m) {
+        const dpdk_exp_pkt* pkt = rte_pktmbuf_mtod(m, const dpdk_exp_pkt*);
+        uint32_t ports = (uint32_t)pkt->udp_hdr.src_port << 16 | (pkt->udp_hdr.dst_port & rte_cpu_to_be_16(0xFFFC));
+        uint32_t h = rte_hash_crc_4byte(pkt->ipv4_hdr.src_addr, pkt->ipv4_hdr.next_proto_id);
+        h = rte_hash_crc_4byte(pkt->ipv4_hdr.dst_addr, h);
+        h = rte_hash_crc_4byte(ports, h);
+        return h & (REORDER_FLOWS - 1);
+    }
+
+    // No other stream can still deliver an earlier key
+    bool safe(const Held& h) const {
+        for (uint64_t s = 0; s < streams.size(); s++) {
+            if (s == h.stream)
+                continue;
+            if (!streams[s].polled || (!streams[s].drained && before(streams[s].watermark, h.key)))
+                return false;
+        }
+        return true;
+    }
+
+    void insert(const Held& h) {
+        uint64_t i = held.size(), depth = 0;
+        while (i > 0 && before(h.key, held[i - 1].key)) {
+            i--;
+            if (held[i].flow == h.flow)
+                depth++;
+        }
+        held.insert(held.begin() + i, h);
+        if (depth) {
+            stats.reordered++;
+            stats.depth_sum += depth;
+            stats.depth_max = std::max(stats.depth_max, depth);
+        }
+    }
+
+    void account(const Held& h, uint64_t now) {
+        uint64_t wait = now - h.arrival_tsc;
+        stats.pkts++;
+        stats.hold_cycles_sum += wait;
+        stats.hold_cycles_max = std::max(stats.hold_cycles_max, wait);
+
+        Flow& f = flows[h.flow];
+        if (f.seen && before(h.key, f.last_key)) {
+            stats.residual++;
+        } else {
+            f.last_key = h.key;
+            f.seen = true;
+        }
+    }
+
+public:
+    ReorderStats stats;
+
+    FlowReorder(uint64_t num_streams):
+        key_shift(reorder_key == REORDER_FPGA ? 32 : 0),
+        hold_cycles(rte_get_tsc_hz() / 1000000 * reorder_hold_us),
+        streams(num_streams), flows(REORDER_FLOWS) {}
+
+    // One rx_burst of stream s, nb_rx = 0 marks the stream empty
+    void arrive(rte_mbuf** pkts, uint64_t nb_rx, uint8_t s, uint64_t now)
+    {
+        Stream& st = streams[s];
+        for (uint64_t i = 0; i < nb_rx; i++) {
+            Held h = {pkts[i], key_of(pkts[i]), now, flow_of(pkts[i]), s};
+            if (!st.polled || before(st.watermark, h.key))
+                st.watermark = h.key;
+            st.polled = true;
+            insert(h);
+        }
+        st.polled = true;               // An empty first poll also counts
+        st.drained = (nb_rx == 0);
+    }
+
+    // Up to max packets in key order, the safe ones and those dragged out by an expired hold
+    uint64_t release(rte_mbuf** out, uint64_t max, uint64_t now)
+    {
+        uint64_t forced = 0;
+        for (uint64_t i = 0; i < held.size(); i++)
+            if (now - held[i].arrival_tsc >= hold_cycles)
+                forced = i + 1;
+
+        uint64_t n = 0;
+        while (n < max && !held.empty()) {
+            const Held& h = held.front();
+            bool is_safe = safe(h);
+            if (n >= forced && !is_safe)
+                break;
+            if (!is_safe)
+                stats.expired++;
+            account(h, now);
+            out[n++] = h.m;
+            held.pop_front();
+        }
+        return n;
+    }
+
+    // Frees whatever is still held, at exit
+    void flush()
+    {
+        for (const Held& h : held)
+            rte_pktmbuf_free(h.m);
+        held.clear();
+    }
+};
+
+static std::vector<std::unique_ptr<FlowReorder>> flow_reorders;        // Per RX index
+static ReorderStats flow_reorder_snapshot;                             // Monitor only
+
+static void setup_flow_reorders(uint64_t num_pairs, uint64_t num_streams)
+{
+    for (uint64_t i = 0; i < num_pairs; i++)
+        flow_reorders.emplace_back(new FlowReorder(num_streams));
+}
+
+static ReorderStats flow_reorder_totals()
+{
+    ReorderStats t;
+    for (const std::unique_ptr<FlowReorder>& r : flow_reorders) {
+        t.pkts += r->stats.pkts;
+        t.reordered += r->stats.reordered;
+        t.depth_sum += r->stats.depth_sum;
+        t.depth_max = std::max(t.depth_max, r->stats.depth_max);
+        t.hold_cycles_sum += r->stats.hold_cycles_sum;
+        t.hold_cycles_max = std::max(t.hold_cycles_max, r->stats.hold_cycles_max);
+        t.expired += r->stats.expired;
+        t.residual += r->stats.residual;
+    }
+    return t;
+}
+
+static std::string flow_reorder_interval_stats()
+{
+    ReorderStats t = flow_reorder_totals();
+    uint64_t pkts = t.pkts - flow_reorder_snapshot.pkts;
+    uint64_t reordered = t.reordered - flow_reorder_snapshot.reordered;
+    uint64_t depth = t.depth_sum - flow_reorder_snapshot.depth_sum;
+    uint64_t hold = t.hold_cycles_sum - flow_reorder_snapshot.hold_cycles_sum;
+    double us_per_cycle = 1000000.0 / rte_get_tsc_hz();
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2)
+        << "Reorder: repaired " << reordered << " (avg depth " << (reordered ? (double)depth / reordered : 0.0) << ")"
+        << " -- hold " << (pkts ? hold * us_per_cycle / pkts : 0.0) << " us avg"
+        << " -- expired " << t.expired - flow_reorder_snapshot.expired
+        << " -- residual " << t.residual - flow_reorder_snapshot.residual;
+    flow_reorder_snapshot = t;
+    return out.str();
+}
+
+static std::string flow_reorder_stats()
+{
+    ReorderStats t = flow_reorder_totals();
+    double us_per_cycle = 1000000.0 / rte_get_tsc_hz();
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3)
+        << "============ FLOW REORDER STATS ============\n"
+        << "Key: " << (reorder_key == REORDER_FPGA ? "fpga" : "soft") << " -- Hold: " << reorder_hold_us << " us"
+        << " -- Pkts: " << t.pkts << "\n"
+        << "Repaired: " << t.reordered << " (" << (t.pkts ? t.reordered * 100.0 / t.pkts : 0.0) << "%)"
+        << " -- Depth: " << (t.reordered ? (double)t.depth_sum / t.reordered : 0.0) << " avg, " << t.depth_max << " max\n"
+        << "Hold Delay: " << (t.pkts ? t.hold_cycles_sum * us_per_cycle / t.pkts : 0.0) << " us avg, "
+        << t.hold_cycles_max * us_per_cycle << " us max -- Expired: " << t.expired << "\n"
+        << "Residual Reorders: " << t.residual << " (" << (t.pkts ? t.residual * 100.0 / t.pkts : 0.0) << "%)\n";
+    return out.str();
+}
+
+#endif /* _FLOW_REORDER_H_ */
@@ -0,0 +1,381 @@
+#ifndef _FLOW_RULES_H_
+#define _FLOW_RULES_H_
+
+/***********************************************************************/
+/***************************** Flow Rules ******************************/
+/***********************************************************************/
+/**
+ * rte_flow rules compiled from a spec file, so tier steering can change without a rebuild.
+ * One rule per line, whitespace separated <key>=<value>, '#' starts a comment:
+ *  prio=<n>                                rte_flow priority, 0 is the highest (default 0)
+ *  proto=udp|tcp                           L4 header to match (default udp)
+ *  src=<a.b.c.d>[/<len>] dst=...           IPv4 addresses
+ *  dscp=<0-63>
+ *  len=<v>[/<mask>] | len=<lo>-<hi>        IPv4 total length
+ *  sport=... dport=...                     L4 ports, same forms as len
+ *  tier=ddr|second | queues=<q>[-<q>][,...]    target: a tier's queues or explicit queue ids
+ *  rss=udp|tcp|ip|ipv4|l3-src|l3-dst|l4-src|l4-dst[,...]      RSS types over the target (default udp)
+ * A range is covered with aligned prefix blocks, one rule each (ranges on several fields multiply).
+ * Every rule is checked against the device (RSS types, queue ids) before rte_flow_validate.
+ *
+ * Without a file the two historical rules apply: dst port low bits 00 to the DDR queues (prio 0),
+ * 10 to the secondary queues (prio 1).
+ */
+#include <fstream>
+#include <sstream>
+
+#define MAX_FLOW_RULES_PER_LINE 256
+
+struct PortBlock {
+    uint16_t value;
+    uint16_t mask;
+};
+
+// Cover [lo, hi] with aligned power-of-2 blocks, the prefixes a flow rule can match
+static std::vector<PortBlock> port_blocks(uint32_t lo, uint32_t hi)
+{
+    std::vector<PortBlock> blocks;
+    while (lo <= hi) {
+        uint32_t size = lo ? (lo & -lo) : 0x10000;
+        while (size > hi - lo + 1)
+            size >>= 1;
+        blocks.push_back({(uint16_t)lo, (uint16_t)~(size - 1)});
+        lo += size;
+    }
+    return blocks;
+}
+
+struct FlowRule {
+    enum Target {
+        TIER_DDR = 0,
+        TIER_SECOND = 1,
+        QUEUES = 2
+    };
+
+    std::string origin;                 // "<file>:<line>" or "default", for the messages
+    uint32_t priority = 0;
+    uint8_t l4_proto = IPPROTO_UDP;
+
+    //*** Host order, a zero mask matches anything */
+    uint32_t src_ip = 0, src_mask = 0;
+    uint32_t dst_ip = 0, dst_mask = 0;
+    uint8_t dscp = 0, dscp_mask = 0;
+    uint16_t total_len = 0, total_len_mask = 0;
+    uint16_t sport = 0, sport_mask = 0;
+    uint16_t dport = 0, dport_mask = 0;
+
+    Target target = TIER_DDR;
+    std::vector<uint16_t> queues;       // QUEUES only
+    uint64_t rss_types = RTE_ETH_RSS_UDP;
+};
+
+// The historical pair, restricted to the dst ports matching dport_value under dport_mask (0 = all)
+static std::vector<FlowRule> default_flow_rules(uint16_t dport_value, uint16_t dport_mask)
+{
+    FlowRule ddr;
+    ddr.origin = "default";
+    ddr.priority = 0;
+    ddr.dport = dport_value | 0x0000;   // Last two bits '00'
+    ddr.dport_mask = dport_mask | 0x0003;
+    ddr.target = FlowRule::TIER_DDR;
+
+    FlowRule second = ddr;
+    second.priority = 1;
+    second.dport = dport_value | 0x0002;    // Last two bits '10'
+    second.target = FlowRule::TIER_SECOND;
+    return {ddr, second};
+}
+
+static bool parse_ipv4_prefix(const std::string& s, uint32_t* ip, uint32_t* mask)
+{
+    size_t slash = s.find('/');
+    unsigned long len = 32;
+    in_addr addr;
+    if (inet_pton(AF_INET, s.substr(0, slash).c_str(), &addr) != 1)
+        return false;
+    if (slash != std::string::npos) {
+        char* end;
+        len = strtoul(s.c_str() + slash + 1, &end, 10);
+        if (*end != '\0' || len > 32)
+            return false;
+    }
+    *mask = len ? ~0U << (32 - len) : 0;
+    *ip = ntohl(addr.s_addr) & *mask;
+    return true;
+}
+
+// <v>, <v>/<mask> or <lo>-<hi> (expanded to prefix blocks)
+static bool parse_masked_u16(const std::string& s, std::vector<PortBlock>* options)
+{
+    char* end;
+    unsigned long v = strtoul(s.c_str(), &end, 0);
+    if (end == s.c_str() || v > 0xFFFF)
+        return false;
+    if (*end == '\0') {
+        options->push_back({(uint16_t)v, 0xFFFF});
+        return true;
+    }
+    char sep = *end;
+    const char* rest = end + 1;
+    unsigned long w = strtoul(rest, &end, 0);
+    if (end == rest || *end != '\0' || w > 0xFFFF)
+        return false;
+    if (sep == '/') {
+        options->push_back({(uint16_t)(v & w), (uint16_t)w});
+        return true;
+    }
+    if (sep == '-' && v <= w) {
+        *options = port_blocks(v, w);
+        return true;
+    }
+    return false;
+}
+
+static bool parse_queue_list(const std::string& s, std::vector<uint16_t>* queues)
+{
+    std::istringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        unsigned int lo, hi;
+        int n = sscanf(item.c_str(), "%u-%u", &lo, &hi);
+        if (n == 1)
+            hi = lo;
+        if (n < 1 || lo > hi || hi > UINT16_MAX)
+            return false;
+        for (unsigned int q = lo; q <= hi; q++)
+            queues->push_back(q);
+    }
+    return !queues->empty();
+}
+
+static bool parse_rss_types(const std::string& s, uint64_t* types)
+{
+    static const std::pair<const char*, uint64_t> names[] = {
+        {"udp", RTE_ETH_RSS_UDP}, {"tcp", RTE_ETH_RSS_TCP}, {"ip", RTE_ETH_RSS_IP}, {"ipv4", RTE_ETH_RSS_IPV4},
+        {"l3-src", RTE_ETH_RSS_L3_SRC_ONLY}, {"l3-dst", RTE_ETH_RSS_L3_DST_ONLY},
+        {"l4-src", RTE_ETH_RSS_L4_SRC_ONLY}, {"l4-dst", RTE_ETH_RSS_L4_DST_ONLY},
+    };
+    std::istringstream in(s);
+    std::string item;
+    *types = 0;
+    while (std::getline(in, item, ',')) {
+        bool found = false;
+        for (const auto& n : names) {
+            if (item == n.first) {
+                *types |= n.second;
+                found = true;
+            }
+        }
+        if (!found)
+            return false;
+    }
+    return *types != 0;
+}
+
+// Compile the spec file, -1 on any error
+static int64_t parse_flow_rules(const std::string& path, std::vector<FlowRule>* rules)
+{
+    std::ifstream in(path);
+    if (!in) {
+        printf("Cannot open flow rule file %s\n", path.c_str());
+        return -1;
+    }
+
+    std::string line;
+    uint64_t line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string token;
+        FlowRule r;
+        r.origin = path + ":" + std::to_string(line_no);
+        std::vector<PortBlock> lens = {{0, 0}}, sports = {{0, 0}}, dports = {{0, 0}};
+        bool has_target = false, empty = true;
+
+        while (fields >> token) {
+            empty = false;
+            size_t eq = token.find('=');
+            std::string key = token.substr(0, eq);
+            std::string value = (eq == std::string::npos) ? "" : token.substr(eq + 1);
+            bool ok = true;
+            char* end;
+
+            if (value.empty()) {
+                ok = false;
+            } else if (key == "prio") {
+                r.priority = strtoul(value.c_str(), &end, 10);
+                ok = (*end == '\0');
+            } else if (key == "proto") {
+                ok = (value == "udp" || value == "tcp");
+                r.l4_proto = (value == "tcp") ? IPPROTO_TCP : IPPROTO_UDP;
+            } else if (key == "src") {
+                ok = parse_ipv4_prefix(value, &r.src_ip, &r.src_mask);
+            } else if (key == "dst") {
+                ok = parse_ipv4_prefix(value, &r.dst_ip, &r.dst_mask);
+            } else if (key == "dscp") {
+                unsigned long dscp = strtoul(value.c_str(), &end, 0);
+                ok = (*end == '\0' && dscp < 64);
+                r.dscp = dscp;
+                r.dscp_mask = 0x3F;
+            } else if (key == "len") {
+                lens.clear();
+                ok = parse_masked_u16(value, &lens);
+            } else if (key == "sport") {
+                sports.clear();
+                ok = parse_masked_u16(value, &sports);
+            } else if (key == "dport") {
+                dports.clear();
+                ok = parse_masked_u16(value, &dports);
+            } else if (key == "tier") {
+                ok = (value == "ddr" || value == "second");
+                r.target = (value == "second") ? FlowRule::TIER_SECOND : FlowRule::TIER_DDR;
+                has_target = true;
+            } else if (key == "queues") {
+                ok = parse_queue_list(value, &r.queues);
+                r.target = FlowRule::QUEUES;
+                has_target = true;
+            } else if (key == "rss") {
+                ok = parse_rss_types(value, &r.rss_types);
+            } else {
+                ok = false;
+            }
+            if (!ok) {
+                printf("%s, cannot parse \"%s\"\n", r.origin.c_str(), token.c_str());
+                return -1;
+            }
+        }
+        if (empty)
+            continue;
+        if (!has_target) {
+            printf("%s, no target, add tier=ddr|second or queues=<q>,...\n", r.origin.c_str());
+            return -1;
+        }
+        if (lens.size() * sports.size() * dports.size() > MAX_FLOW_RULES_PER_LINE) {
+            printf("%s, the ranges expand to more than %u rules\n", r.origin.c_str(), MAX_FLOW_RULES_PER_LINE);
+            return -1;
+        }
+
+        for (const PortBlock& l : lens)
+            for (const PortBlock& sp : sports)
+                for (const PortBlock& dp : dports) {
+                    r.total_len = l.value;
+                    r.total_len_mask = l.mask;
+                    r.sport = sp.value;
+                    r.sport_mask = sp.mask;
+                    r.dport = dp.value;
+                    r.dport_mask = dp.mask;
+                    rules->push_back(r);
+                }
+    }
+
+    if (rules->empty()) {
+        printf("No flow rule in %s\n", path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+// Device checks rte_flow_validate doesn't spell out, rte_exit with the rule origin
+static void check_flow_rule(const FlowRule& r, const rte_eth_dev_info& dev_info, const std::vector<uint16_t>& queues)
+{
+    if (r.rss_types & ~dev_info.flow_type_rss_offloads)
+        rte_exit(EXIT_FAILURE, "Flow rule %s: RSS types 0x%lx not supported by the device (supported 0x%lx)\n",
+            r.origin.c_str(), r.rss_types & ~dev_info.flow_type_rss_offloads, dev_info.flow_type_rss_offloads);
+    if (queues.empty())
+        rte_exit(EXIT_FAILURE, "Flow rule %s: no queue to steer to\n", r.origin.c_str());
+    for (uint16_t q : queues)
+        if (q >= dev_info.nb_rx_queues)
+            rte_exit(EXIT_FAILURE, "Flow rule %s: queue %u, the port has %u rx queues\n", r.origin.c_str(), q, dev_info.nb_rx_queues);
+}
+
+// Check and create every rule, the tier targets resolve to the given queues
+static std::vector<rte_flow*> install_flow_rules(uint16_t port, const std::vector<FlowRule>& rules,
+                                                 const std::vector<uint16_t>& ddr_rx_ids, const std::vector<uint16_t>& second_rx_ids,
+                                                 bool verbose = true)
+{
+    std::vector<rte_flow*> flows;
+    rte_eth_dev_info dev_info;
+    int ret = rte_eth_dev_info_get(port, &dev_info);
+    if (ret != 0)
+        rte_exit(EXIT_FAILURE, "Cannot get device (port %u) info: %s\n", port, strerror(-ret));
+
+    for (const FlowRule& r : rules) {
+        const std::vector<uint16_t>& queues = (r.target == FlowRule::QUEUES) ? r.queues
+            : (r.target == FlowRule::TIER_SECOND && !second_rx_ids.empty()) ? second_rx_ids : ddr_rx_ids;
+        check_flow_rule(r, dev_info, queues);
+
+        //*** Attributes */
+        struct rte_flow_attr attr;
+        memset(&attr, 0, sizeof(struct rte_flow_attr));
+        attr.ingress = 1;
+        attr.priority = r.priority;
+
+        //*** Patterns, an all-zero mask leaves the item unconstrained */
+        struct rte_flow_item_ipv4 ip_spec, ip_mask;
+        memset(&ip_spec, 0, sizeof(ip_spec));
+        memset(&ip_mask, 0, sizeof(ip_mask));
+        ip_spec.hdr.src_addr = rte_cpu_to_be_32(r.src_ip);
+        ip_mask.hdr.src_addr = rte_cpu_to_be_32(r.src_mask);
+        ip_spec.hdr.dst_addr = rte_cpu_to_be_32(r.dst_ip);
+        ip_mask.hdr.dst_addr = rte_cpu_to_be_32(r.dst_mask);
+        ip_spec.hdr.type_of_service = r.dscp << 2;
+        ip_mask.hdr.type_of_service = r.dscp_mask << 2;
+        ip_spec.hdr.total_length = rte_cpu_to_be_16(r.total_len);
+        ip_mask.hdr.total_length = rte_cpu_to_be_16(r.total_len_mask);
+        bool match_ip = r.src_mask || r.dst_mask || r.dscp_mask || r.total_len_mask;
+
+        struct rte_flow_item_udp udp_spec, udp_mask;
+        struct rte_flow_item_tcp tcp_spec, tcp_mask;
+        memset(&udp_spec, 0, sizeof(udp_spec));
+        memset(&udp_mask, 0, sizeof(udp_mask));
+        memset(&tcp_spec, 0, sizeof(tcp_spec));
+        memset(&tcp_mask, 0, sizeof(tcp_mask));
+        udp_spec.hdr.src_port = tcp_spec.hdr.src_port = rte_cpu_to_be_16(r.sport);
+        udp_mask.hdr.src_port = tcp_mask.hdr.src_port = rte_cpu_to_be_16(r.sport_mask);
+        udp_spec.hdr.dst_port = tcp_spec.hdr.dst_port = rte_cpu_to_be_16(r.dport);
+        udp_mask.hdr.dst_port = tcp_mask.hdr.dst_port = rte_cpu_to_be_16(r.dport_mask);
+        bool match_l4 = r.sport_mask || r.dport_mask;
+        bool tcp = (r.l4_proto == IPPROTO_TCP);
+
+        struct rte_flow_item pattern[4];
+        memset(pattern, 0, sizeof(pattern));
+        pattern[0].type = RTE_FLOW_ITEM_TYPE_ETH;
+        pattern[1].type = RTE_FLOW_ITEM_TYPE_IPV4;
+        pattern[1].spec = match_ip ? &ip_spec : NULL;
+        pattern[1].mask = match_ip ? &ip_mask : NULL;
+        pattern[2].type = tcp ? RTE_FLOW_ITEM_TYPE_TCP : RTE_FLOW_ITEM_TYPE_UDP;
+        pattern[2].spec = !match_l4 ? NULL : tcp ? (const void*)&tcp_spec : (const void*)&udp_spec;
+        pattern[2].mask = !match_l4 ? NULL : tcp ? (const void*)&tcp_mask : (const void*)&udp_mask;
+        pattern[3].type = RTE_FLOW_ITEM_TYPE_END;
+
+        //*** Action: RSS over the target queues with the default key */
+        struct rte_flow_action_rss rss_action;
+        memset(&rss_action, 0, sizeof(rss_action));
+        rss_action.types = r.rss_types;
+        rss_action.queue_num = queues.size();
+        rss_action.queue = queues.data();
+
+        struct rte_flow_action action[2];
+        memset(action, 0, sizeof(action));
+        action[0].type = RTE_FLOW_ACTION_TYPE_RSS;
+        action[0].conf = &rss_action;
+        action[1].type = RTE_FLOW_ACTION_TYPE_END;
+
+        if (verbose)
+            printf("Flow rule %-16s prio %u -- dport 0x%04x/0x%04x sport 0x%04x/0x%04x len 0x%04x/0x%04x -> %lu queue(s) from %u\n",
+                r.origin.c_str(), r.priority, r.dport, r.dport_mask, r.sport, r.sport_mask, r.total_len, r.total_len_mask,
+                queues.size(), queues[0]);
+
+        struct rte_flow_error error;
+        if (rte_flow_validate(port, &attr, pattern, action, &error))
+            rte_exit(EXIT_FAILURE, "Flow validation failed (%s): %s\n", r.origin.c_str(), error.message ? error.message : "(no stated reason)");
+        rte_flow* flow = rte_flow_create(port, &attr, pattern, action, &error);
+        if (!flow)
+            rte_exit(EXIT_FAILURE, "Flow creation failed (%s): %s\n", r.origin.c_str(), error.message ? error.message : "(no stated reason)");
+        flows.push_back(flow);
+    }
+    return flows;
+}
+
+#endif /* _FLOW_RULES_H_ */
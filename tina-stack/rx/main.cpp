@@ -2,12 +2,19 @@
 
 #include "main.h"
 
+#include "apps/touch_app.h"
 #include "apps/headerTouch_app.h"
 #include "apps/kvs_app.h"
 #include "apps/crypto_app.h"
 #include "apps/bm25_app.h"
 #include "apps/knn_app.h"
 #include "apps/nat_app_hash.h"
+#include "apps/l3fwd_app.h"
+#include "apps/acl_app.h"
+#include "apps/maglev_app.h"
+#include "apps/dpi_app.h"
+#include "apps/telemetry_app.h"
+#include "apps/chain_app.h"
 #include "./dpdk_perf.h"
 
 #include <fstream>
@@ -33,48 +40,50 @@
 /*************************** Regular RX Thread ***************************/
 /*************************************************************************/
 
-static void app_process(rte_mbuf **pkts_burst, uint64_t nb_rx, uint64_t rx_index)
+// Returns how many mbufs are left at the front of pkts_burst for the caller to free
+static uint64_t app_process(rte_mbuf **pkts_burst, uint64_t nb_rx, uint64_t rx_index)
 {
-    switch (application_choice)
-    {
-
-    /*********************************/
-    case Touch:
-    {
-        for (uint64_t i = 0; i < nb_rx; i++)
-        {
-            char *pkt_ptr = rte_pktmbuf_mtod(pkts_burst[i], char *);
-            volatile uint64_t flag;
-            for (uint64_t k = 0; k < pkts_burst[i]->pkt_len; k += 64)
-            { // Make sure we bring every cacheline into L2
-                flag = flag + pkt_ptr[k];
-            }
-        }
-        nsleep_high_precision(waiting_time);
-        break;
-    }
+    //NoApp lcores have no instance, the whole vector is empty when the process runs NoApp alone
+    if (rx_index >= app_p_vec.size() || !app_p_vec[rx_index])
+        return nb_rx;
+    return app_p_vec[rx_index]->run_burst(pkts_burst, nb_rx);
+}
 
-    /*********************************/
-    case HeaderTouch:
-    case KVS:
-    case Crypto:
-    case BM25:
-    case NAT:
-    case KNN:
-    {
-        for (uint64_t i = 0; i < nb_rx; i++)
-        {
-            char *pkt_ptr = rte_pktmbuf_mtod(pkts_burst[i], char *);
-            app_p_vec[rx_index]->run(pkt_ptr, pkts_burst[i]->pkt_len);
-        }
-        break;
+// Size class experiment: the app runs on the small then the large packets of the burst, each part
+// between two reads of the lcore's LLC miss counter
+static uint64_t app_process_by_size_class(rte_mbuf **pkts_burst, uint64_t nb_rx, uint64_t rx_index, const dpdk_apps::LlcMissCounter& llc)
+{
+    SizeClassRecord& record = size_class_record[rx_index];
+    rte_mbuf* large[BURST_SIZE * 4];
+    uint64_t nb_class[NUM_SIZE_CLASSES] = {0, 0};
+    for (uint64_t i = 0; i < nb_rx; i++) {
+        SizeClass c = size_class_of(pkts_burst[i]);
+        record.bytes[c] += rte_pktmbuf_pkt_len(pkts_burst[i]);
+        if (c == LARGE_PKT)
+            large[nb_class[LARGE_PKT]++] = pkts_burst[i];
+        else
+            pkts_burst[nb_class[SMALL_PKT]++] = pkts_burst[i];
     }
+    memcpy(pkts_burst + nb_class[SMALL_PKT], large, nb_class[LARGE_PKT] * sizeof(rte_mbuf*));
 
-    /*********************************/
-    case NoApp:
-    default:
-        break;
+    //Each part leaves its own mbufs at its front, they are packed back to the front of the burst
+    uint64_t nb_left = 0;
+    rte_mbuf** part = pkts_burst;
+    for (int c = 0; c < NUM_SIZE_CLASSES; c++) {
+        if (nb_class[c] == 0)
+            continue;
+        uint64_t misses = llc.read();
+        uint64_t tsc = rte_get_tsc_cycles();
+        uint64_t left = app_process(part, nb_class[c], rx_index);
+        record.cycles[c] += rte_get_tsc_cycles() - tsc;
+        record.llc_misses[c] += llc.read() - misses;
+        record.pkts[c] += nb_class[c];
+
+        memmove(pkts_burst + nb_left, part, left * sizeof(rte_mbuf*));
+        nb_left += left;
+        part += nb_class[c];
     }
+    return nb_left;
 }
 
 static int pipeline_process(void *arg)
@@ -93,6 +102,15 @@ static int pipeline_process(void *arg)
         fprintf(stderr, "WARNING, port %lu is on remote NUMA node to lcore %lu\n", port_id, rx_lcore_id);
     }
 
+    //The counter follows the thread that opens it
+    dpdk_apps::LlcMissCounter llc;
+    if (size_class_llc) {
+        if (llc.open())
+            size_class_llc_lcores++;
+        else
+            printf("lcore %2lu has no user-space LLC miss counter, its size class misses read 0\n", rx_lcore_id);
+    }
+
     while (keep_receiving)
     {
         struct rte_mbuf *pkts_burst[BURST_SIZE * 4]; // To support maximum the (secondary_ring_mode == NUMA) case
@@ -106,15 +124,23 @@ static int pipeline_process(void *arg)
 
         //**** Ring Touching
         uint64_t processing_time_start = rte_get_timer_cycles();
-        app_process(pkts_burst, nb_rx_final, rx_index);
-        
         processed_pkt += nb_rx_final;
-        // SAMPLE AND TX
 
+        //The sample is copied out before the app runs, a forwarding app may have sent pkts_burst[0] already
         auto lat_sample_count = processed_pkt;
-        if (lat_sample_count > latency_sample_frq && latency_sample_frq != -1)
+        bool sample_due = lat_sample_count > latency_sample_frq && latency_sample_frq != -1;
+        struct rte_mbuf* pkt = sample_due ? build_tx_stats_pkt(pkts_burst[0]) : nullptr;
+
+        if (flow_seq_check)
+            for (uint64_t i = 0; i < nb_rx_final; i++)
+                flow_seq_trackers[rx_index].track(rte_pktmbuf_mtod(pkts_burst[i], const dpdk_exp_pkt*));
+
+        uint64_t nb_left = size_class_llc ? app_process_by_size_class(pkts_burst, nb_rx_final, rx_index, llc)
+                                          : app_process(pkts_burst, nb_rx_final, rx_index);
+
+        // SAMPLE AND TX
+        if (sample_due)
         {
-            auto pkt = build_tx_stats_pkt(pkts_burst[0]);
             if (pkt == nullptr) {
                 printf("Failed to clone and send packet\n");
             } else {
@@ -128,7 +154,7 @@ static int pipeline_process(void *arg)
             processed_pkt = 0;
         }
 
-        for (uint64_t i = 0; i < nb_rx_final; i++)
+        for (uint64_t i = 0; i < nb_left; i++)
         {
             rte_pktmbuf_free(pkts_burst[i]);
         }
@@ -146,7 +172,7 @@ static int pipeline_poll(void *arg)
 {
     //**** RX Thread Setups */
     int64_t rx_lcore_id = rte_lcore_id();
-    int64_t rx_index = rte_lcore_index(rx_lcore_id) - 1;
+    int64_t rx_index = (rte_lcore_index(rx_lcore_id) - 1) / 2;     //Same pair index as its pipeline_process
     rte_ring *my_sw_ring = sw_qs[rx_index];
     printf("lcore %2lu (main_core_id %2u, RX index %2lu) starts to PROCESS packets\n", rx_lcore_id, rte_get_main_lcore(), rx_index);
 
@@ -172,13 +198,28 @@ static int pipeline_poll(void *arg)
 
         uint64_t processing_time_start;
 
-        if (curr_ring == TIER0_RING)
+        //*** Reorder stage: every queue of the pair each round, the window releases in arrival order */
+        if (reorder_key != REORDER_OFF)
+        {
+            FlowReorder& reorder = *flow_reorders[rx_index];
+            uint64_t now = rte_get_tsc_cycles();
+            processing_time_start = rte_get_timer_cycles();
+            for (uint64_t k = DDR_IDX; k <= NUMA3_IDX; k++)
+            {
+                uint64_t q = rx_index + rx_lcore_count * k;
+                uint64_t nb_rx = rte_eth_rx_burst(port_id, q, pkts_burst, BURST_SIZE);
+                ring_rx_record[q] += nb_rx;
+                reorder.arrive(pkts_burst, nb_rx, k, now);
+            }
+            nb_rx_final = reorder.release(pkts_burst, BURST_SIZE * 4, now);
+        }
+        else if (curr_ring == TIER0_RING)
         {
             nb_rx_final += rte_eth_rx_burst(port_id, rx_index, pkts_burst, BURST_SIZE);
             processing_time_start = rte_get_timer_cycles();
             ring_rx_record[rx_index] += nb_rx_final;
         }
-        if (curr_ring == TIER1_RING)
+        else if (curr_ring == TIER1_RING)
         {
             if (secondary_ring_mode == CXL)
             {
@@ -214,15 +255,191 @@ static int pipeline_poll(void *arg)
             lcore_polling_time[rx_index] += (rte_get_timer_cycles() - processing_time_start);
         }
 
-        if (nb_rx_final == 0 && (secondary_ring_mode == NUMA))
+        //The reorder stage polls every tier each round
+        if (nb_rx_final == 0 && (secondary_ring_mode == NUMA) && reorder_key == REORDER_OFF)
         {
             curr_ring = (curr_ring == TIER0_RING) ? TIER1_RING : TIER0_RING;
         }
 
     }
+
+    if (reorder_key != REORDER_OFF)
+        flow_reorders[rx_index]->flush();
     return 0;
 }
 
+/*************************************************************************/
+/***************************** App Factory *******************************/
+/*************************************************************************/
+
+static std::vector<std::shared_ptr<dpdk_apps::BaseApp>> create_app(ApplicationChoice app, const std::string& app_arg1_str, const std::string& app_arg2_str,
+                                                                   uint64_t first_rx_index, uint64_t lcore_count);
+
+// Build every stage with create_app, then chain the instances of each lcore
+static std::vector<std::shared_ptr<dpdk_apps::BaseApp>> create_chain(const std::string& spec, uint64_t first_rx_index, uint64_t lcore_count)
+{
+    std::vector<dpdk_apps::ChainApp::StageSpec> specs = dpdk_apps::ChainApp::parse(spec);
+    std::vector<std::string> names;
+    std::vector<std::vector<std::shared_ptr<dpdk_apps::BaseApp>>> stage_apps;
+
+    for (size_t k = 0; k < specs.size(); k++) {
+        const dpdk_apps::ChainApp::StageSpec& s = specs[k];
+        ApplicationChoice choice;
+        if (!parse_app_name(s.name, &choice) || choice == NoApp || choice == CHAIN)
+            RTE_EXIT_PRINT(EXIT_FAILURE, "Chain: stage %lu, \"%s\" is not an app that can be chained\n", k, s.name.c_str());
+        if (choice == L3FWD && k + 1 != specs.size())
+            RTE_EXIT_PRINT(EXIT_FAILURE, "Chain: L3FWD transmits the packets, it can only be the last stage\n");
+        if (choice == Crypto && dpdk_apps::CryptoApp::is_cryptodev(s.arg1) && k + 1 != specs.size())
+            RTE_EXIT_PRINT(EXIT_FAILURE, "Chain: the cryptodev is still encrypting the packets after Crypto, it can only be the last stage\n");
+
+        printf("[Stage %lu] ", k);
+        stage_apps.push_back(create_app(choice, s.arg1, s.arg2, first_rx_index, lcore_count));
+        names.push_back(application_choice_str.at(choice));
+    }
+
+    dpdk_apps::ChainApp::init(names);
+    std::vector<std::shared_ptr<dpdk_apps::BaseApp>> apps;
+    for (uint64_t i = 0; i < lcore_count; i++) {
+        std::vector<std::shared_ptr<dpdk_apps::BaseApp>> lcore_stages;
+        for (const auto& stage : stage_apps)
+            lcore_stages.push_back(stage[i]);
+        apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::ChainApp(lcore_stages)));
+    }
+    printf("Chain, -- %s\n", spec.c_str());
+    return apps;
+}
+
+// Build one instance for each of the lcores [first_rx_index, first_rx_index + lcore_count),
+// or one shared by all for the apps without per-lcore state
+static std::vector<std::shared_ptr<dpdk_apps::BaseApp>> create_app(ApplicationChoice app, const std::string& app_arg1_str, const std::string& app_arg2_str,
+                                                                   uint64_t first_rx_index, uint64_t lcore_count)
+{
+    std::vector<std::shared_ptr<dpdk_apps::BaseApp>> apps;
+    if (app != NoApp && std::find(running_apps.begin(), running_apps.end(), app) != running_apps.end())
+        RTE_EXIT_PRINT(EXIT_FAILURE, "%s runs twice, its state is shared by all its instances\n", application_choice_str.at(app).c_str());
+    running_apps.push_back(app);
+    uint64_t app_arg1 = strtoul(app_arg1_str.c_str(), nullptr, 10);
+    uint64_t app_arg2 = strtoul(app_arg2_str.c_str(), nullptr, 10);
+
+    switch(app){
+        case CHAIN:
+            return create_chain(app_arg1_str, first_rx_index, lcore_count);
+
+        case Touch: 
+            dpdk_apps::TouchApp::init(app_arg1_str, app_arg2, tsc_hz);
+            //One instance per lcore, each draws from its own PRNG stream
+            for (uint64_t i = 0; i < lcore_count; i++)
+                apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::TouchApp(i)));
+            printf("Touch, -- Service Time %s -- Touch %lu B (0 = whole packet)\n", dpdk_apps::TouchApp::describe().c_str(), app_arg2);
+            break;
+
+        case HeaderTouch:
+            //One instance per lcore, the port counters are plain increments
+            for (uint64_t i = 0; i < lcore_count; i++)
+                apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::HeaderTouchApp()));
+            printf("Header Touch\n");
+            break;
+
+        case NoApp:
+            printf("NoApp, No FW\n");
+            break;
+
+        case L3FWD:
+            dpdk_apps::L3fwdApp::init(app_arg1_str, port_id);
+            //One instance per lcore, each sends on the TX queue of its own index
+            for (uint64_t i = 0; i < lcore_count; i++)
+                apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::L3fwdApp(first_rx_index + i)));
+            printf("L3FWD, -- routes %s -- TX ring %lu\n", app_arg1_str.empty() ? "default (reflect)" : app_arg1_str.c_str(), tx_ring_size);
+            break;
+
+        case ACL:
+            dpdk_apps::AclApp::init(app_arg1_str, app_arg2_str, port_id);
+            //The trie is shared, the verdict and rule counters are per lcore
+            for (uint64_t i = 0; i < lcore_count; i++)
+                apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::AclApp()));
+            printf("ACL, -- rules %s -- default %s\n", app_arg1_str.c_str(), app_arg2_str.empty() ? "accept" : app_arg2_str.c_str());
+            break;
+
+        case MAGLEV:
+            dpdk_apps::MaglevApp::init(app_arg1_str, app_arg2);
+            //The lookup table is shared, the connection tables are per lcore
+            for (uint64_t i = 0; i < lcore_count; i++)
+                apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::MaglevApp()));
+            printf("Maglev, -- backends %s -- table size %s\n", app_arg1_str.c_str(), app_arg2_str.empty() ? "default" : app_arg2_str.c_str());
+            break;
+
+        case DPI:
+            dpdk_apps::DpiApp::init(app_arg1_str);
+            //The automaton is shared, the match counters are per lcore
+            for (uint64_t i = 0; i < lcore_count; i++)
+                apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::DpiApp()));
+            printf("DPI, -- patterns %s\n", app_arg1_str.c_str());
+            break;
+
+        case TELEMETRY:
+            dpdk_apps::TelemetryApp::init(app_arg1, app_arg2);
+            //Private sketches per lcore, merged by the monitor
+            for (uint64_t i = 0; i < lcore_count; i++)
+                apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::TelemetryApp()));
+            printf("Telemetry, -- count-min %s KB -- top-k %s\n", app_arg1_str.empty() ? "default" : app_arg1_str.c_str(),
+                app_arg2_str.empty() ? "default" : app_arg2_str.c_str());
+            break;
+
+        case KVS:   
+            dpdk_apps::KVSApp::key_pool_count = app_arg1;
+            dpdk_apps::KVSApp::kvs_state = {0};
+            assert(app_arg1 != 0 && "KVS need to has one argument for key_pool_count");
+            apps = std::vector<std::shared_ptr<dpdk_apps::BaseApp>>
+                (lcore_count, std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::KVSApp()));     
+            printf("KVS, -- key_pool_count %lu\n", app_arg1);
+            break;
+
+        case Crypto:
+
+            dpdk_apps::CryptoApp::init_engine(app_arg1_str, app_arg2_str, lcore_count);
+            //One instance per lcore, each owns its cipher contexts and RSA key
+            for (uint64_t i = 0; i < lcore_count; i++)
+                apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::CryptoApp(i)));
+            printf("Crypto, -- Engine %s -- Algorithm %s\n", app_arg1_str.c_str(), app_arg2_str.c_str());
+            break;
+
+        case BM25:
+        {
+            //The first instance loads the index, the others share it with their own batch scratch
+            dpdk_apps::BM25App* first = new dpdk_apps::BM25App(app_arg1_str, app_arg2_str.empty() ? dpdk_apps::NUMA_NODE_ANY : (int)app_arg2);
+            apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(first));
+            for (uint64_t i = 1; i < lcore_count; i++)
+                apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::BM25App(*first)));
+            printf("BM25, -- index %s -- NUMA node %s\n", app_arg1_str.c_str(), app_arg2_str.empty() ? "any" : app_arg2_str.c_str());
+            break;
+        }
+
+        case KNN:
+        {
+            //The first instance builds the training set and grid, the others share them with their own batch
+            dpdk_apps::KnnApp* first = new dpdk_apps::KnnApp(app_arg1, app_arg2_str);
+            apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(first));
+            for (uint64_t i = 1; i < lcore_count; i++)
+                apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::KnnApp(*first)));
+            printf("KNN, -- data footprint %lu -- index %s\n", app_arg1, app_arg2_str.empty() ? "scan" : app_arg2_str.c_str());
+            break;
+        }
+
+        case NAT:
+            //One flow table and timer wheel per lcore, RSS keeps a flow on one lcore pair,
+            //each lcore maps its flows into its own slice of the external ports
+            for (uint64_t i = 0; i < lcore_count; i++)
+                apps.push_back(std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::NATApp(app_arg1, app_arg2, i, lcore_count)));
+            printf("NAT, -- max flows %lu -- idle timeout %lu ms\n", app_arg1, app_arg2);
+            break;
+
+        default:
+            
+            RTE_EXIT_PRINT(EXIT_FAILURE, "Internal App Error, your -a input(%u) might not be correct\n", app);
+    }
+    return apps;
+}
+
 /*************************************************************************/
 /********************************* Main **********************************/
 /*************************************************************************/
@@ -263,6 +480,14 @@ int main(int argc, char **argv)
     switch (operation_mode)
     {
         case OperationMode::PIPELINE:
+            if (!tenants.empty())
+            {
+                //One poll/process lcore pair per RX queue index, on top of the main lcore
+                rx_lcore_count = tenant_lcore_pairs();
+                if (rte_lcore_count() != 1 + 2 * rx_lcore_count)
+                    RTE_EXIT_PRINT(EXIT_FAILURE, "The tenants need %lu lcores (main + %lu pairs)\n", 1 + 2 * rx_lcore_count, rx_lcore_count);
+                break;
+            }
             if (rte_lcore_count() != 3)
             {
                 RTE_EXIT_PRINT(EXIT_FAILURE, "Pipeline mode only supports 3 lcores\n");
@@ -270,6 +495,8 @@ int main(int argc, char **argv)
             rx_lcore_count = 1;
             break;
         case OperationMode::RTC:
+            if (!tenants.empty())
+                RTE_EXIT_PRINT(EXIT_FAILURE, "Tenants run in pipeline mode only\n");
             rx_lcore_count = rte_lcore_count() - 1;
             break;
         default:
@@ -356,14 +583,14 @@ int main(int argc, char **argv)
                 printf("Created mbuf pool %s, size %u\n", rx_mbuf_pools_array[DDR_IDX]->name, rx_mbuf_pools_array[DDR_IDX]->size);
                 
             //*** Rings Setup */
-            uint16_t nb_txd = LATENCY_REPORT_TX_RING_SIZE;
+            uint16_t nb_txd = tx_ring_size;
             uint16_t nb_rxd = rx_ring_size_ddr;  
             setup_eth_dev(rx_lcore_count, rx_lcore_count, &nb_txd, &nb_rxd, nullptr);
 
             for (uint64_t q = 0; q < rx_lcore_count; q++) {
                 retval = rte_eth_tx_queue_setup(port_id, q, nb_txd, SOCKET_ID_ANY, NULL);
                 retval = (retval != 0) ? retval : 
-                         rte_eth_rx_queue_setup(port_id, q, nb_rxd, 0, NULL, rx_mbuf_pools_array[DDR_IDX]);
+                         rte_eth_rx_queue_setup(port_id, q, ddr_ring_size_of(q, nb_rxd), 0, NULL, rx_mbuf_pools_array[DDR_IDX]);
 
                 ddr_rx_ids.push_back(q);
                 if (retval < 0) {
@@ -413,7 +640,7 @@ int main(int argc, char **argv)
             }
 
             //*** Rings Setup */
-            uint16_t nb_txd = LATENCY_REPORT_TX_RING_SIZE;
+            uint16_t nb_txd = tx_ring_size;
             uint16_t nb_rxd_first = rx_ring_size_ddr;
             uint16_t nb_rxd_second = second_ring_size;
             setup_eth_dev(rx_lcore_count * 2, rx_lcore_count, &nb_txd, &nb_rxd_first, &nb_rxd_second);
@@ -421,8 +648,8 @@ int main(int argc, char **argv)
             for (uint64_t q = 0; q < rx_lcore_count; q++) {
                 retval = rte_eth_tx_queue_setup(port_id, q, nb_txd, SOCKET_ID_ANY, NULL);
 
-                retval = (retval != 0) ? retval : rte_eth_rx_queue_setup(port_id, q, rx_ring_size_ddr, 0, NULL, rx_mbuf_pools_array[DDR_IDX]);
-                retval = (retval != 0) ? retval : rte_eth_rx_queue_setup(port_id, q + rx_lcore_count, second_ring_size, cxl_numa_id, NULL, rx_mbuf_pools_array[CXL_IDX]);
+                retval = (retval != 0) ? retval : rte_eth_rx_queue_setup(port_id, q, ddr_ring_size_of(q, rx_ring_size_ddr), 0, NULL, rx_mbuf_pools_array[DDR_IDX]);
+                retval = (retval != 0) ? retval : rte_eth_rx_queue_setup(port_id, q + rx_lcore_count, second_ring_size_of(q, second_ring_size), cxl_numa_id, NULL, rx_mbuf_pools_array[CXL_IDX]);
                 
                 ddr_rx_ids.push_back(q);
                 second_rx_ids.push_back(q + rx_lcore_count);
@@ -480,7 +707,7 @@ int main(int argc, char **argv)
             }
 
             //*** Rings Setup */
-            uint16_t nb_txd = LATENCY_REPORT_TX_RING_SIZE;
+            uint16_t nb_txd = tx_ring_size;
             uint16_t nb_rxd_first = rx_ring_size_ddr;
             uint16_t nb_rxd_second = second_ring_size;
             setup_eth_dev(rx_lcore_count * 4, rx_lcore_count, &nb_txd, &nb_rxd_first, &nb_rxd_second);
@@ -488,19 +715,21 @@ int main(int argc, char **argv)
             for (uint64_t q = 0; q < rx_lcore_count; q++) {
                 retval  = rte_eth_tx_queue_setup(port_id, q, nb_txd, SOCKET_ID_ANY, NULL);
 
-                retval = (retval != 0) ? retval : rte_eth_rx_queue_setup(port_id, q, rx_ring_size_ddr, 0, NULL, rx_mbuf_pools_array[DDR_IDX]);                          
-                retval = (retval != 0) ? retval : rte_eth_rx_queue_setup(port_id, q + rx_lcore_count, second_ring_size, 1, NULL, rx_mbuf_pools_array[NUMA1_IDX]);         
-                retval = (retval != 0) ? retval : rte_eth_rx_queue_setup(port_id, q + rx_lcore_count * 2, second_ring_size, 2, NULL, rx_mbuf_pools_array[NUMA2_IDX]);          
-                retval = (retval != 0) ? retval : rte_eth_rx_queue_setup(port_id, q + rx_lcore_count * 3, second_ring_size, 3, NULL, rx_mbuf_pools_array[NUMA3_IDX]);
+                retval = (retval != 0) ? retval : rte_eth_rx_queue_setup(port_id, q, ddr_ring_size_of(q, rx_ring_size_ddr), 0, NULL, rx_mbuf_pools_array[DDR_IDX]);                          
+                retval = (retval != 0) ? retval : rte_eth_rx_queue_setup(port_id, q + rx_lcore_count, second_ring_size_of(q, second_ring_size), 1, NULL, rx_mbuf_pools_array[NUMA1_IDX]);         
+                retval = (retval != 0) ? retval : rte_eth_rx_queue_setup(port_id, q + rx_lcore_count * 2, second_ring_size_of(q, second_ring_size), 2, NULL, rx_mbuf_pools_array[NUMA2_IDX]);          
+                retval = (retval != 0) ? retval : rte_eth_rx_queue_setup(port_id, q + rx_lcore_count * 3, second_ring_size_of(q, second_ring_size), 3, NULL, rx_mbuf_pools_array[NUMA3_IDX]);
 
                 ddr_rx_ids.push_back(q);
-                second_rx_ids.push_back(q + rx_lcore_count);
-                second_rx_ids.push_back(q + rx_lcore_count * 2);
-                second_rx_ids.push_back(q + rx_lcore_count * 3);
 
                 if (retval < 0) 
                     RTE_EXIT_PRINT(EXIT_FAILURE, "Error during rx/tx for queue %lu, Errno: %lu\n", q, retval);
             }
+            //Node by node, entry j of the 3n second queues belongs to pair j mod n like entry j of the DDR ones.
+            //The two halves of a split flow only share a hash with -R (REORDER_RSS_TYPES, flow_reorder.h)
+            for (uint64_t k = NUMA1_IDX; k <= NUMA3_IDX; k++)
+                for (uint64_t q = 0; q < rx_lcore_count; q++)
+                    second_rx_ids.push_back(q + rx_lcore_count * k);
             printf("Set up %hu @ %lu tx rings, %lu @ %lu DDR0 rx rings, %lu @ %lu DDR123 rx rings\n", 
                 nb_txd, rx_lcore_count, rx_ring_size_ddr, rx_lcore_count, second_ring_size, rx_lcore_count);   
             std::cout << "------------------------------------------------------" << std::endl;
@@ -521,72 +750,34 @@ int main(int argc, char **argv)
     setup_flows(ddr_rx_ids, second_rx_ids);
     setup_ring_monitors(ddr_rx_ids, second_rx_ids, rx_lcore_count);
     setup_sw_qs((rte_lcore_count() - 1) / 2);
+    if (reorder_key != REORDER_OFF)
+        setup_flow_reorders(rx_lcore_count, NUMA3_IDX + 1);
+    if (flow_seq_check)
+        flow_seq_trackers.resize(rx_lcore_count);
 
     /***********************************************************************************/
     /******************************* Application Init **********************************/
     /***********************************************************************************/
     std::cout << "\n================= Application =================" << std::endl;
-    switch(application_choice){
-        case Touch: 
-            waiting_time = app_arg1;
-            printf("Wait for  %lu ns every 32 packets\n", waiting_time);
-            break;
-
-        case HeaderTouch:
-            app_p_vec = std::vector<std::shared_ptr<dpdk_apps::BaseApp>>
-                (rx_lcore_count, std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::HeaderTouchApp()));   
-            printf("Header Touch\n");
-            break;
-
-        case NoApp:
-            printf("NoApp, No FW\n");
-            break;
-
-        case KVS:   
-            dpdk_apps::KVSApp::key_pool_count = app_arg1;
-            dpdk_apps::KVSApp::kvs_state = {0};
-            assert(app_arg1 != 0 && "KVS need to has one argument for key_pool_count");
-            app_p_vec = std::vector<std::shared_ptr<dpdk_apps::BaseApp>>
-                (rx_lcore_count, std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::KVSApp()));     
-            printf("KVS, -- key_pool_count %lu\n", app_arg1);
-            break;
-
-        case Crypto:
-
-            dpdk_apps::CryptoApp::init_engine(app_arg1_str, app_arg2_str, rx_lcore_count);
-            app_p_vec = std::vector<std::shared_ptr<dpdk_apps::BaseApp>>
-                (rx_lcore_count, std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::CryptoApp(app_arg1)));     
-            printf("Crypto, -- Engine %s -- Algorithm %s\n", app_arg1_str.c_str(), app_arg2_str.c_str());
-            break;
-
-        case BM25:
-            app_p_vec = std::vector<std::shared_ptr<dpdk_apps::BaseApp>>
-                (rx_lcore_count, std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::BM25App(app_arg1)));
-            printf("BM25, -- data footprint %lu\n", app_arg1);
-            break;
-
-        case KNN:
-            app_p_vec = std::vector<std::shared_ptr<dpdk_apps::BaseApp>>
-                (rx_lcore_count, std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::KnnApp(app_arg1)));
-            printf("KNN, -- data footprint %lu\n", app_arg1);
-            break;
-
-        case NAT:
-            app_p_vec = std::vector<std::shared_ptr<dpdk_apps::BaseApp>>
-                (rx_lcore_count, std::shared_ptr<dpdk_apps::BaseApp>(new dpdk_apps::NATApp(app_arg1)));
-            printf("NAT, -- data pool size %lu\n", app_arg1);
-            break;
-
-        default:
-            
-            printf("Internal App Error, your -a input(%u) might not be correct\n", application_choice);
-            return -1;
+    if (tenants.empty())
+        app_p_vec = create_app(application_choice, app_arg1_str, app_arg2_str, 0, rx_lcore_count);
+
+    //*** Tenants fill their own slice of app_p_vec, NoApp tenants leave it empty */
+    for (const Tenant& t : tenants) {
+        printf("[Tenant %s] ", t.name.c_str());
+        std::vector<std::shared_ptr<dpdk_apps::BaseApp>> apps = create_app(t.app, t.app_arg1_str, t.app_arg2_str, t.first_rx_index, t.lcore_pairs);
+        apps.resize(t.lcore_pairs);
+        app_p_vec.insert(app_p_vec.end(), apps.begin(), apps.end());
     }
     
     /***********************************************************************************/
     /******************************** Main Workload ************************************/
     /***********************************************************************************/
 
+    //*** Apps have registered their regions by now */
+    if (dpdk_apps::page_migrator.enabled() && !dpdk_apps::page_migrator.start())
+        printf("Page migrator not started\n");
+
     signal(SIGINT, stop_rx);
     signal(SIGTERM, stop_rx);
     signal(SIGKILL, [](int signal){printf("Receiving SIGKILL, skil cleaniing part & exiting...\n"); exit(1);});
@@ -630,6 +821,10 @@ int main(int argc, char **argv)
     uint64_t monitor_loop_id = 0;
     while (likely(keep_receiving)) {
 
+        //The tiering period is far below the monitor interval, it samples on its own clock
+        if (sw_tiering.enabled())
+            sw_tiering.poll(rte_get_tsc_cycles());
+
         uint64_t current_timestamp = rte_get_timer_cycles();
         if (current_timestamp - previous_monitor_timestamp < interval_cycles)
             continue;
@@ -677,6 +872,56 @@ int main(int argc, char **argv)
         } else {
             printf("RX average packet processing time N/A");
         }
+
+        if (sw_tiering.enabled())
+            printf("%s\n", sw_tiering.print_interval_stats().c_str());
+        if (size_class_llc)
+            printf("%s\n", size_class_interval_stats().c_str());
+        if (reorder_key != REORDER_OFF)
+            printf("%s\n", flow_reorder_interval_stats().c_str());
+        if (flow_seq_check) {
+            FlowSeqStats t = flow_seq_totals(flow_seq_trackers);
+            printf("%s\n", flow_seq_interval_stats(t, flow_seq_snapshot).c_str());
+            flow_seq_snapshot = t;
+        }
+
+        //Backend changes are picked up here, off the data path
+        if (std::find(running_apps.begin(), running_apps.end(), MAGLEV) != running_apps.end())
+            dpdk_apps::MaglevApp::reload_if_changed();
+
+        if (tenants.empty() && !app_p_vec.empty()) {
+            std::string app_interval_stats = app_p_vec[0]->print_interval_stats();
+            if (!app_interval_stats.empty())
+                printf("%s\n", app_interval_stats.c_str());
+        }
+
+        //*** Per tenant: its queues on both tiers, its lcores and its app */
+        for (Tenant& t : tenants) {
+            uint64_t ddr_rx = 0, second_rx = 0, processing = 0;
+            for (uint64_t q = t.first_rx_index; q < t.first_rx_index + t.lcore_pairs; q++) {
+                ddr_rx += ring_rx_record[q];
+                for (uint64_t sq = q + rx_lcore_count; sq < ring_rx_record.size(); sq += rx_lcore_count)
+                    second_rx += ring_rx_record[sq];
+                processing += lcore_processing_time[q];
+            }
+            uint64_t tenant_ddr = ddr_rx - t.ddr_rx_snapshot;
+            uint64_t tenant_second = second_rx - t.second_rx_snapshot;
+            uint64_t tenant_cycles = processing - t.processing_time_snapshot;
+            t.ddr_rx_snapshot = ddr_rx;
+            t.second_rx_snapshot = second_rx;
+            t.processing_time_snapshot = processing;
+
+            uint64_t tenant_rx = tenant_ddr + tenant_second;
+            printf("Tenant %-12s RX %0.4f M (DDR %0.4f M, second tier %0.2f%%) -- processing %s cycles/pkt\n",
+                t.name.c_str(), tenant_rx/1000000.0, tenant_ddr/1000000.0, tenant_rx ? tenant_second * 100.0 / tenant_rx : 0.0,
+                tenant_rx ? std::to_string(tenant_cycles / tenant_rx).c_str() : "N/A");
+
+            if (app_p_vec[t.first_rx_index]) {
+                std::string app_interval_stats = app_p_vec[t.first_rx_index]->print_interval_stats();
+                if (!app_interval_stats.empty())
+                    printf("%s\n", app_interval_stats.c_str());
+            }
+        }
     }
 
     /***********************************************************************************/
@@ -702,6 +947,10 @@ int main(int argc, char **argv)
             "-----------------------------------------------------------------------\n"
             "\033[0m"
     );
+    rte_eal_mp_wait_lcore();
+    for (const std::shared_ptr<dpdk_apps::BaseApp>& app : app_p_vec)
+        if (app)
+            app->stop();
 
     //*** Global Statistics */
     uint64_t total_rx_global = std::accumulate(ring_rx_record.begin(), ring_rx_record.end(), 0);
@@ -729,8 +978,32 @@ int main(int argc, char **argv)
     std::cout << "==============================================" << std::endl;
 
     /******************* App Stats *******************/
-    if (application_choice != Touch && 
-        application_choice != NoApp) {
+    dpdk_apps::page_migrator.stop();
+    if (dpdk_apps::page_migrator.enabled())
+        std::cout << dpdk_apps::page_migrator.print_stats();
+    if (sw_tiering.enabled())
+        std::cout << sw_tiering.print_stats();
+    if (size_class_llc)
+        std::cout << size_class_stats();
+    if (reorder_key != REORDER_OFF)
+        std::cout << flow_reorder_stats();
+    if (flow_seq_check)
+        std::cout << flow_seq_stats(flow_seq_totals(flow_seq_trackers));
+    if (!tenants.empty()) {
+        assert(app_p_vec.size() == rx_lcore_count);
+        for (const Tenant& t : tenants) {
+            uint64_t ddr_rx = 0, second_rx = 0;
+            for (uint64_t q = t.first_rx_index; q < t.first_rx_index + t.lcore_pairs; q++) {
+                ddr_rx += ring_rx_record[q];
+                for (uint64_t sq = q + rx_lcore_count; sq < ring_rx_record.size(); sq += rx_lcore_count)
+                    second_rx += ring_rx_record[sq];
+            }
+            printf("============ Tenant %s (%s) ============\n", t.name.c_str(), application_choice_str.at(t.app).c_str());
+            printf("RX Pkts: %lu -- DDR: %lu -- Second Tier: %lu\n", ddr_rx + second_rx, ddr_rx, second_rx);
+            if (app_p_vec[t.first_rx_index])
+                std::cout << app_p_vec[t.first_rx_index]->print_stats() << std::endl;
+        }
+    } else if (application_choice != NoApp) {
         assert(!app_p_vec.empty() && app_p_vec.size() == rx_lcore_count && app_p_vec.size() >= 1);
         std::cout << app_p_vec[0]->print_stats() << std::endl;
     } else {
@@ -766,3 +1039,64 @@ uint64_t dpdk_apps::KVSApp::key_pool_count = 0;
 ENGINE* dpdk_apps::CryptoApp::engine = nullptr;
 std::vector<RSA*> dpdk_apps::CryptoApp::rsa = {};
 dpdk_apps::CryptoApp::ALGO dpdk_apps::CryptoApp::algo = dpdk_apps::CryptoApp::NONE;
+unsigned char dpdk_apps::CryptoApp::key[32] = {0};
+std::vector<dpdk_apps::CryptoApp*> dpdk_apps::CryptoApp::instances = {};
+dpdk_apps::CryptoApp::_cdev_state dpdk_apps::CryptoApp::cdev = {-1};
+
+dpdk_apps::ServiceTimeDist dpdk_apps::TouchApp::dist_config;
+uint64_t dpdk_apps::TouchApp::touch_bytes = 0;
+std::vector<dpdk_apps::TouchApp*> dpdk_apps::TouchApp::instances = {};
+
+std::vector<dpdk_apps::BM25App*> dpdk_apps::BM25App::instances = {};
+
+std::vector<dpdk_apps::KnnApp*> dpdk_apps::KnnApp::instances = {};
+
+std::vector<dpdk_apps::HeaderTouchApp*> dpdk_apps::HeaderTouchApp::instances = {};
+
+std::vector<dpdk_apps::NATApp*> dpdk_apps::NATApp::instances = {};
+uint64_t dpdk_apps::NATApp::num_created_snapshot = 0;
+uint64_t dpdk_apps::NATApp::num_evicted_snapshot = 0;
+uint64_t dpdk_apps::NATApp::snapshot_tsc = 0;
+
+rte_lpm* dpdk_apps::L3fwdApp::lpm = nullptr;
+std::vector<rte_ether_addr> dpdk_apps::L3fwdApp::next_hops = {};
+rte_ether_addr dpdk_apps::L3fwdApp::port_mac = {};
+uint16_t dpdk_apps::L3fwdApp::port = 0;
+std::vector<dpdk_apps::L3fwdApp*> dpdk_apps::L3fwdApp::instances = {};
+
+rte_acl_ctx* dpdk_apps::AclApp::ctx = nullptr;
+std::vector<dpdk_apps::AclApp::_rule_meta> dpdk_apps::AclApp::rules = {};
+dpdk_apps::AclApp::Action dpdk_apps::AclApp::default_action = dpdk_apps::AclApp::ACCEPT;
+std::string dpdk_apps::AclApp::alg_name = "";
+std::vector<dpdk_apps::AclApp*> dpdk_apps::AclApp::instances = {};
+
+dpdk_apps::MaglevApp::_backend dpdk_apps::MaglevApp::backends[dpdk_apps::MaglevApp::MAX_BACKENDS];
+uint32_t dpdk_apps::MaglevApp::num_registered = 0;
+dpdk_apps::MaglevApp::_lookup_table dpdk_apps::MaglevApp::tables[2];
+std::atomic<uint32_t> dpdk_apps::MaglevApp::active{0};
+uint64_t dpdk_apps::MaglevApp::table_size = 0;
+std::string dpdk_apps::MaglevApp::backend_spec = "";
+time_t dpdk_apps::MaglevApp::backend_mtime = 0;
+uint64_t dpdk_apps::MaglevApp::num_rebuilds = 0;
+std::vector<dpdk_apps::MaglevApp*> dpdk_apps::MaglevApp::instances = {};
+
+std::vector<std::string> dpdk_apps::DpiApp::patterns = {};
+dpdk_apps::TeddyMasks dpdk_apps::DpiApp::teddy;
+dpdk_apps::AhoCorasick dpdk_apps::DpiApp::matcher;
+dpdk_apps::SimdLevel dpdk_apps::DpiApp::simd_level = dpdk_apps::SIMD_SCALAR;
+dpdk_apps::teddy_scan_fn dpdk_apps::DpiApp::prefilter = dpdk_apps::teddy_scan_scalar;
+std::vector<dpdk_apps::DpiApp*> dpdk_apps::DpiApp::instances = {};
+
+uint32_t dpdk_apps::TelemetryApp::cm_width = 0;
+uint32_t dpdk_apps::TelemetryApp::top_k = 0;
+dpdk_apps::SimdLevel dpdk_apps::TelemetryApp::simd_level = dpdk_apps::SIMD_SCALAR;
+dpdk_apps::flow_hash_fn dpdk_apps::TelemetryApp::hash_kernel = dpdk_apps::flow_hash_scalar;
+std::vector<dpdk_apps::TelemetryApp*> dpdk_apps::TelemetryApp::instances = {};
+dpdk_apps::CountMinSketch dpdk_apps::TelemetryApp::merged_cm;
+dpdk_apps::HyperLogLog dpdk_apps::TelemetryApp::merged_hll;
+uint64_t dpdk_apps::TelemetryApp::merged_pkts_snapshot = 0;
+uint64_t dpdk_apps::TelemetryApp::merged_tsc_snapshot = 0;
+
+std::vector<std::string> dpdk_apps::ChainApp::stage_names = {};
+std::vector<dpdk_apps::ChainApp*> dpdk_apps::ChainApp::instances = {};
+std::vector<dpdk_apps::ChainApp::_stage_stats> dpdk_apps::ChainApp::interval_snapshot = {};
@@ -2,7 +2,12 @@
 #define _MAIN_H_
 
 #include "../tx/dpdk_exp_pkt.h"
+#include "../tx/flow_seq.h"
 #include "apps/base_app.h"
+#include "apps/simd_dispatch.h"
+#include "apps/workload_gen.h"
+#include "apps/numa_mem.h"
+#include "apps/page_migrator.h"
 
 #include <getopt.h>
 #include <signal.h>
@@ -22,11 +27,14 @@
 /************************** Connection Setup ***************************/
 /***********************************************************************/
 #define LATENCY_REPORT_TX_RING_SIZE 64      //Can't be larger than RX_RING_SIZE
+#define FORWARDING_TX_RING_SIZE 1024        //Apps that transmit every packet (L3FWD)
 #define MBUF_CACHE_SIZE 0UL
 #define BURST_SIZE 32
 #define MAX_RX_CORES 16
 #define NUM_OF_NUMA 4
 
+static_assert(BURST_SIZE * 4 <= dpdk_apps::BaseApp::MAX_BURST, "The apps size their run_burst() scratch for MAX_BURST");
+
 // #define ENABLE_CLDEMOTE_AT_FREE
 // #define ENABLE_CLDEMOTE_AT_GAP
 
@@ -40,6 +48,7 @@ static const struct rte_eth_conf port_conf_default = {
 
 static uint64_t port_id = 0;
 static uint64_t rx_ring_size_ddr = 4096;
+static uint64_t tx_ring_size = LATENCY_REPORT_TX_RING_SIZE;     //Raised for the forwarding apps once the app is known
 static uint64_t mbuf_size = 2048 + 128;
 static uint64_t bytes_us = 0;
 static std::string if_name = "NONE";
@@ -80,6 +89,12 @@ enum ApplicationChoice {
   BM25 = 5,             //Don't Touch Pkt
   KNN = 6,              
   NAT = 7,
+  L3FWD = 8,            //Forwards the packets, doesn't drop them
+  ACL = 9,
+  MAGLEV = 10,
+  DPI = 11,             //Reads every payload byte
+  TELEMETRY = 12,
+  CHAIN = 13,           //Runs several of the above per burst, Args1 is the chain
 
 
   _ApplicationChoiceCount
@@ -94,7 +109,13 @@ static const std::unordered_map<ApplicationChoice, std::string> application_choi
     {Crypto, "Crypto"},
     {BM25, "BM25"},
     {KNN, "KNN"},
-    {NAT, "NAT"}
+    {NAT, "NAT"},
+    {L3FWD, "L3FWD"},
+    {ACL, "ACL"},
+    {MAGLEV, "MAGLEV"},
+    {DPI, "DPI"},
+    {TELEMETRY, "TELEMETRY"},
+    {CHAIN, "CHAIN"}
 };
 
 enum SecondaryRingMode {
@@ -133,8 +154,21 @@ static std::string app_arg1_str = "";
 static uint64_t app_arg2 = 0;
 static std::string app_arg2_str = "";
 
-static uint64_t waiting_time = 0;
 static std::vector<std::shared_ptr<dpdk_apps::BaseApp>> app_p_vec;
+static std::vector<ApplicationChoice> running_apps;        //Every app built, the app state is static so each runs once
+
+#include "flow_rules.h"
+#include "tenants.h"
+#include "size_class.h"
+#include "sw_tiering.h"
+#include "flow_reorder.h"
+
+static std::string flow_rule_file = "";
+static std::vector<FlowRule> flow_rules;                   //From flow_rule_file, the default pair when empty
+
+static bool flow_seq_check = false;
+static std::vector<FlowSeqTracker> flow_seq_trackers;      //Per RX index, on the order the app sees
+static FlowSeqStats flow_seq_snapshot;                     //Monitor only
 
 /***********************************************************************/
 /*************************** General Setup *****************************/
@@ -218,7 +252,7 @@ static int pipeline_poll(void *arg);
 
 static int rtc_rx(void *arg);
 
-static void app_process(rte_mbuf** pkts_burst, uint64_t nb_rx, uint64_t rx_index);
+static uint64_t app_process(rte_mbuf** pkts_burst, uint64_t nb_rx, uint64_t rx_index);
 
 
 
@@ -237,15 +271,34 @@ static void print_usage(const char *prgname)
            "    -s, --second_rings_mode         enable second ring mode, Default to NotUsingSecondaryRing\n" 
            "    -d, --second_rings_size         secondary ring size, default to 128\n"
            "    -o, --operation_mode            operation mode, default to pipeline\n"
+           "    -v, --simd_isa                  highest ISA for app kernels (scalar, avx2, avx512), default to avx512\n"
+           "    -k, --key_dist                  app key distribution (uniform, zipf[:<theta>], hotspot[:<hot keys>:<hot ops>], payload), default to uniform\n"
+           "    -r, --seed                      seed of the per-lcore workload generators, default to %lu\n"
+           "    -m, --app_mem                   app state placement (default, local, bind:<node>, interleave[:<node>,...], far)[+2m|+1g], default to default\n"
+           "    -w, --migrate_mbps              migrate hot app pages to the local node and cold ones to the far node, at most this many MB/s, default to 0 (off)\n"
+           "    -T, --tenants                   tenant file, one app per UDP dst-port range and lcore pair group (<name> <app> <lo>-<hi> <lcore pairs> <DDR ring> <second ring> [<arg1> [<arg2>]]), replaces -a/-b/-c, pipeline mode only\n"
+           "    -f, --flow_rules                flow rule file (prio=, proto=, src=, dst=, dscp=, len=, sport=, dport=, tier=ddr|second or queues=, rss=), default to dst port bits 00 -> DDR, 10 -> second tier\n"
+           "    -t, --sw_tiering                <th1>:<th2>:<th3>[:<period us>], host-driven ingress tiering with the nic_switch thresholds, in rx descriptors, default to off\n"
+           "    -z, --size_class                <len>[:<th1>], packets from this IPv4 total length go to the second tier, or with -t leave tier 0 at <th1> descriptors, default to off\n"
+           "    -Z, --size_class_llc            split every burst by size class and report the app's cycles and LLC misses per packet of each, needs -z\n"
+           "    -R, --reorder                   fpga|soft[:<hold us>], per-flow reorder stage between the tiers and the software queue, keyed by the FPGA or generator timestamp, hold default to %d us, default to off\n"
+           "    -Q, --flow_seq                  check the generator's per-flow sequence numbers (tx -F) as the app gets the packets, for loss, duplicates and reorder distance, pipeline mode only\n"
 
            "\n\n"
            "Application Choices:\n"
-           "[Touch]     --  [Args1 -----> waiting time (ns)                                              ]\n"
+           "[Touch]     --  [Args1 -----> service time (<ns> per burst, const:<ns>, exp:<mean>, bimodal:<ns1>:<ns2>:<p2>, lognormal:<mean>:<sigma>, cdf:<file>), Args2 -----> bytes touched per packet (0 = all) ]\n"
            "[KVS]       --  [Args1 -----> key_pool_count                                            ]\n"
-           "[Crypto]    --  [Args1 -----> engineIDString(rdrand or pka),  Args2 -----> Algorithm ID ]\n"
-           "[BM25]      --  [Args1 -----> data footprint                                            ]\n"
-           "[KNN]       --  [Args1 -----> data footprint                                            ]\n",
-           prgname, port_id, monitor_interval_ms);
+           "[Crypto]    --  [Args1 -----> engineIDString(rdrand, pka or cryptodev:<device>),  Args2 -----> Algorithm (SHA256, SHA256_MB, AES, AES_DEC, AES_GCM, CHACHA20_POLY1305, RSA_ENC, RSA_DEC) ]\n"
+           "[BM25]      --  [Args1 -----> index file or synthetic postings, Args2 -----> index NUMA node ]\n"
+           "[KNN]       --  [Args1 -----> data footprint,  Args2 -----> scan or grid[:<index node>[:<data node>]] ]\n"
+           "[NAT]       --  [Args1 -----> max tracked flows,         Args2 -----> idle timeout (ms) ]\n"
+           "[L3FWD]     --  [Args1 -----> route file (<a.b.c.d>/<len> <MAC|reflect> per line), none = 0.0.0.0/0 reflect ]\n"
+           "[ACL]       --  [Args1 -----> rule file (<src>/<len> <dst>/<len> <sport lo>:<hi> <dport lo>:<hi> <proto> <accept|drop|count>) or random:<n>, Args2 -----> default action (accept) ]\n"
+           "[MAGLEV]    --  [Args1 -----> backend file (one IPv4 per line, reloaded on change) or synthetic:<n>, Args2 -----> lookup table size (65537) ]\n"
+           "[DPI]       --  [Args1 -----> pattern file (one per line, \\xHH escapes) or random:<n>[:<len>] ]\n"
+           "[TELEMETRY] --  [Args1 -----> count-min footprint per lcore (KB, 1024),    Args2 -----> heavy hitters kept (32) ]\n"
+           "[CHAIN]     --  [Args1 -----> stages run in order on the same lcore, e.g. \"NAT(100000,30000) -> ACL(random:1000) -> Crypto(rdrand,SHA256)\", args as above, L3FWD last ]\n",
+           prgname, port_id, monitor_interval_ms, dpdk_apps::workload_config.seed, REORDER_DEFAULT_HOLD_US);
 }
 
 static struct option long_options[] = {
@@ -260,6 +313,18 @@ static struct option long_options[] = {
     {"second_ring_mode",    required_argument,  0,      's' },
     {"second_ring_size",    required_argument,  0,      'd' },
     {"operation_mode",      required_argument,  0,      'o' },
+    {"simd_isa",            required_argument,  0,      'v' },
+    {"key_dist",            required_argument,  0,      'k' },
+    {"seed",                required_argument,  0,      'r' },
+    {"app_mem",             required_argument,  0,      'm' },
+    {"migrate_mbps",        required_argument,  0,      'w' },
+    {"tenants",             required_argument,  0,      'T' },
+    {"flow_rules",          required_argument,  0,      'f' },
+    {"sw_tiering",          required_argument,  0,      't' },
+    {"size_class",          required_argument,  0,      'z' },
+    {"size_class_llc",      no_argument,        0,      'Z' },
+    {"reorder",             required_argument,  0,      'R' },
+    {"flow_seq",            no_argument,        0,      'Q' },
     {NULL,                  0,                  NULL,   0   }
 };
 
@@ -267,7 +332,7 @@ static struct option long_options[] = {
 static int64_t parse_args(const int64_t argc, char **argv)
 {
     const char *prgname = argv[0];
-    const char short_options[] = "p:y:i:l:a:b:c:s:d:h:o:";        //!Need to end with ":", o/w it will SEGFAULT
+    const char short_options[] = "p:y:i:l:a:b:c:s:d:h:o:v:k:r:m:w:T:f:t:Zz:QR:";        //!Need to end with ":", o/w it will SEGFAULT
     int64_t c;
     int64_t ret;
     char *endptr;
@@ -303,6 +368,8 @@ static int64_t parse_args(const int64_t argc, char **argv)
                     return -1;
                 }
                 application_choice = static_cast<ApplicationChoice>(val);
+                if (application_choice == L3FWD)
+                    tx_ring_size = FORWARDING_TX_RING_SIZE;
                 break;
             }
             case 'b':
@@ -344,6 +411,72 @@ static int64_t parse_args(const int64_t argc, char **argv)
                 }
                 break;
             }
+            case 'v':
+                if (!dpdk_apps::parse_simd_level(optarg, &dpdk_apps::simd_level_cap)) {
+                    printf("Invalid SIMD ISA, should be scalar, avx2 or avx512\n");
+                    return -1;
+                }
+                break;
+
+            case 'k':
+                if (!dpdk_apps::parse_key_dist(optarg, &dpdk_apps::workload_config)) {
+                    printf("Invalid key distribution, should be uniform, zipf[:<theta>], hotspot[:<hot keys>:<hot ops>] or payload\n");
+                    return -1;
+                }
+                break;
+
+            case 'r':
+                dpdk_apps::workload_config.seed = strtoull(optarg, &endptr, 0);
+                break;
+
+            case 'w':
+                dpdk_apps::page_migrator.set_budget_mbps(strtoul(optarg, &endptr, 10));
+                break;
+
+            case 'm':
+                if (!dpdk_apps::parse_mem_placement(optarg, &dpdk_apps::app_mem_placement)) {
+                    printf("Invalid app memory placement, should be default, local, bind:<node>, interleave[:<node>,...] or far, optionally +2m/+1g\n");
+                    return -1;
+                }
+                break;
+
+            case 'T':
+                tenant_file = optarg;
+                break;
+
+            case 'f':
+                flow_rule_file = optarg;
+                break;
+
+            case 't':
+                if (!sw_tiering.parse(optarg)) {
+                    printf("Invalid SW tiering, expected <th1>:<th2>:<th3>[:<period us>] with th3 <= th1\n");
+                    return -1;
+                }
+                break;
+
+            case 'z':
+                if (!parse_size_class(optarg)) {
+                    printf("Invalid size class, expected <IPv4 total length 1-65535>[:<th1 of the large packets>]\n");
+                    return -1;
+                }
+                break;
+
+            case 'Z':
+                size_class_llc = true;
+                break;
+
+            case 'R':
+                if (!parse_reorder(optarg)) {
+                    printf("Invalid reorder, expected fpga|soft[:<hold us>]\n");
+                    return -1;
+                }
+                break;
+
+            case 'Q':
+                flow_seq_check = true;
+                break;
+
             case 'h':
             default:
                 print_usage(prgname);
@@ -351,7 +484,60 @@ static int64_t parse_args(const int64_t argc, char **argv)
         }
     }
 
-	return 0;
+    //A chain that ends in L3FWD forwards like L3FWD alone
+    if (application_choice == CHAIN && strcasestr(app_arg1_str.c_str(), "L3FWD") != nullptr)
+        tx_ring_size = FORWARDING_TX_RING_SIZE;
+
+    //Tenants replace -a/-b/-c
+    if (!tenant_file.empty() && parse_tenants(tenant_file) < 0)
+        return -1;
+
+    if (!flow_rule_file.empty()) {
+        if (!tenant_file.empty()) {
+            printf("Tenants install their own flow rules, -f and -T don't mix\n");
+            return -1;
+        }
+        if (parse_flow_rules(flow_rule_file, &flow_rules) < 0)
+            return -1;
+    }
+
+    if (sw_tiering.enabled() && (!tenant_file.empty() || !flow_rule_file.empty() || secondary_ring_mode == None)) {
+        printf("SW tiering steers all the traffic itself, it needs a secondary ring mode and no -T/-f\n");
+        return -1;
+    }
+
+    if (size_class_len != 0) {
+        if (!tenant_file.empty() || !flow_rule_file.empty()) {
+            printf("Size class steering replaces the default rules, use len= in the flow rule file instead of -z with -T/-f\n");
+            return -1;
+        }
+        if (sw_tiering.enabled() != (size_class_th1 != 0)) {
+            printf("The th1 of the large packets (-z <len>:<th1>) goes with -t, and -t needs it\n");
+            return -1;
+        }
+        if (sw_tiering.enabled() && !sw_tiering.set_size_class(size_class_th1)) {
+            printf("The th1 of the large packets should be within [th3, th1] of -t\n");
+            return -1;
+        }
+        if (!sw_tiering.enabled() && secondary_ring_mode == None) {
+            printf("Size class steering needs a secondary ring mode\n");
+            return -1;
+        }
+    }
+    if (size_class_llc && (size_class_len == 0 || operation_mode != PIPELINE)) {
+        printf("The size class LLC experiment (-Z) needs -z and the pipeline mode\n");
+        return -1;
+    }
+    if (reorder_key != REORDER_OFF && (secondary_ring_mode != NUMA || operation_mode != PIPELINE)) {
+        printf("Flow reordering repairs the tier split, it needs the NUMA secondary ring mode and the pipeline mode\n");
+        return -1;
+    }
+    if (flow_seq_check && operation_mode != PIPELINE) {
+        printf("The flow sequence check (-Q) runs on the process lcores, it needs the pipeline mode\n");
+        return -1;
+    }
+
+    return 0;
 }
 
 
@@ -360,16 +546,35 @@ static void print_config()
 {
     printf("=============== Configuration ===============\n");
     printf("DDR RX Ring Size/Core:  %lu\n", rx_ring_size_ddr);
+    printf("TX Ring Size/Core:      %lu\n", tx_ring_size);
     printf("Mbuf Size:              %lu\n", mbuf_size);
     printf("Port:                   %lu\n", port_id);
     printf("Monitor Interval:       %lu msec\n", monitor_interval_ms);
     printf("Latency Sampling_Frq:   %s\n", latency_sample_frq == -1 ? "Disabled" : std::to_string(latency_sample_frq).c_str());
-    printf("APP:                    %s\n", application_choice_str.at(application_choice).c_str());
-    printf("APP Arg1:               %lu\n", app_arg1);
-    printf("APP Arg2:               %lu\n", app_arg2);
+    if (tenants.empty()) {
+        printf("APP:                    %s\n", application_choice_str.at(application_choice).c_str());
+        printf("APP Arg1:               %lu\n", app_arg1);
+        printf("APP Arg2:               %lu\n", app_arg2);
+    }
+    for (const Tenant& t : tenants)
+        printf("Tenant %-16s %s(%s,%s) -- dst port %u-%u -- %lu lcore pair(s) -- rings DDR %lu, second %s\n",
+            t.name.c_str(), application_choice_str.at(t.app).c_str(), t.app_arg1_str.c_str(), t.app_arg2_str.c_str(),
+            t.dport_lo, t.dport_hi, t.lcore_pairs, t.rx_ring_size_ddr, t.second_ring_size ? std::to_string(t.second_ring_size).c_str() : "no spill");
     printf("Second Ring Mode        %s\n", secondary_ring_mode == None ? "None" : (secondary_ring_mode == CXL ? "CXL" : "NUMA"));
     printf("Second Ring Size        %s\n", secondary_ring_mode == None ? "N/A" : std::to_string(second_ring_size).c_str());
     printf("Operation Mode          %s\n", operation_mode == PIPELINE ? "Pipeline" : "RTC");
+    printf("SW Tiering              %s\n", sw_tiering.enabled() ? "Enabled" : "Disabled");
+    printf("Size Class              %s\n", size_class_len == 0 ? "Disabled" : ("large from " + std::to_string(size_class_len) + " B"
+        + (size_class_th1 ? ", th1 " + std::to_string(size_class_th1) : ", second tier") + (size_class_llc ? ", LLC experiment" : "")).c_str());
+    printf("Flow Reorder            %s\n", reorder_key == REORDER_OFF ? "Disabled" : ((reorder_key == REORDER_FPGA ? "fpga" : "soft")
+        + std::string(" key, hold ") + std::to_string(reorder_hold_us) + " us").c_str());
+    printf("Flow Seq Check          %s\n", flow_seq_check ? "Enabled" : "Disabled");
+    printf("Flow Rules              %s\n", flow_rule_file.empty() ? "default" : (flow_rule_file + " (" + std::to_string(flow_rules.size()) + " rules)").c_str());
+    printf("SIMD ISA                %s\n", dpdk_apps::simd_level_str(dpdk_apps::detect_simd_level()));
+    printf("Key Distribution        %s\n", dpdk_apps::key_dist_str(dpdk_apps::workload_config).c_str());
+    printf("Workload Seed           %lu\n", dpdk_apps::workload_config.seed);
+    printf("App Memory              %s\n", dpdk_apps::mem_placement_str(dpdk_apps::app_mem_placement).c_str());
+    printf("Page Migration          %s\n", dpdk_apps::page_migrator.enabled() ? "Enabled" : "Disabled");
     #if defined(ENABLE_CLDEMOTE_AT_FREE)
         printf("CLDEMOTE At Free        Enabled\n");
     #endif
@@ -383,113 +588,51 @@ static void print_config()
 
 int setup_flows(const std::vector<uint16_t>& ddr_rx_ids, const std::vector<uint16_t>& second_rx_ids)
 {
-    uint16_t port_id = 0;
-    
-    //*** Attributes */
-    struct rte_flow_attr attr;
-    memset(&attr, 0, sizeof(struct rte_flow_attr));
-    attr.ingress = 1;
-
-    //*** Patterns */
-    struct rte_flow_item pattern[4];
-    memset(pattern, 0, sizeof(pattern));
-    pattern[0].type = RTE_FLOW_ITEM_TYPE_ETH;
-    pattern[0].spec = NULL;
-    pattern[0].mask = NULL;
-
-    pattern[1].type = RTE_FLOW_ITEM_TYPE_IPV4;
-    pattern[1].spec = NULL;
-    pattern[1].mask = NULL;
-
-    pattern[2].type = RTE_FLOW_ITEM_TYPE_UDP;
-    pattern[3].type = RTE_FLOW_ITEM_TYPE_END;
-
-    //*** UDP spec and mask */
-    struct rte_flow_item_udp udp_spec;
-    struct rte_flow_item_udp udp_mask;
-    memset(&udp_spec, 0, sizeof(struct rte_flow_item_udp));
-    memset(&udp_mask, 0, sizeof(struct rte_flow_item_udp));
-
-    //*** Action */
-    struct rte_flow_action action[2];
-    memset(action, 0, sizeof(action));
-
-    //***************************************************************** */
-    //***** Rule 1: Last two bits of UDP dest port are '00' (binary) ****/
-    //***************************************************************** */
-
-    std::cout << "Setting up Rule 1 for flow control" << std::endl;
-    assert(ddr_rx_ids.size() != 0 && "DDR RX IDs should not be empty");
-    attr.priority = 0;      /* Set the priority for this rule (higher priority) */
-
-    /* Match when last two bits of dst_port are '00' */
-    udp_spec.hdr.dst_port = rte_cpu_to_be_16(0x0000); /* Value with last two bits '00' */
-    udp_mask.hdr.dst_port = rte_cpu_to_be_16(0x0003); /* Mask to consider last two bits */
-
-    /* Assign spec and mask to UDP pattern */
-    pattern[2].spec = &udp_spec;
-    pattern[2].mask = &udp_mask;
-
-    struct rte_flow_action_rss ddr_rss_action;
-    memset(&ddr_rss_action, 0, sizeof(ddr_rss_action));
-    ddr_rss_action.queue_num = ddr_rx_ids.size();   /* Number of queues */
-    ddr_rss_action.queue = ddr_rx_ids.data();       /* Queue IDs */
-    ddr_rss_action.types = RTE_ETH_RSS_UDP;         /* Hash on IP and UDP fields */
-
-    action[0].type = RTE_FLOW_ACTION_TYPE_RSS;
-    action[0].conf = &ddr_rss_action;
-    action[1].type = RTE_FLOW_ACTION_TYPE_END;
-
-    /* Validate and create the flow rule */
-    struct rte_flow_error error;
-    if (rte_flow_validate(port_id, &attr, pattern, action, &error))
-        rte_exit(EXIT_FAILURE, "Flow validation failed (Rule 1): %s\n", error.message ? error.message : "(no stated reason)");
-
-    if (!rte_flow_create(port_id, &attr, pattern, action, &error))
-        rte_exit(EXIT_FAILURE, "Flow creation failed (Rule 1): %s\n", error.message ? error.message : "(no stated reason)");
-
-    //************************************************************** */
-    //***** Rule 2: Last two bits of UDP dest port are '10' (binary) */
-    //************************************************************** */
-
-
-    /* Set the priority for this rule (lower priority than Rule 1) */
-    attr.priority = 1;
-
-    /* Match when last two bits of dst_port are '10' */
-    udp_spec.hdr.dst_port = rte_cpu_to_be_16(0x0002); /* Value with last two bits '10' */
-    udp_mask.hdr.dst_port = rte_cpu_to_be_16(0x0003); /* Mask to consider last two bits */
-
-    /* Assign spec and mask to UDP pattern */
-    pattern[2].spec = &udp_spec;
-    pattern[2].mask = &udp_mask;
-
-    /* Configure the RSS action */
-    struct rte_flow_action_rss second_rss_action;
-    memset(&second_rss_action, 0, sizeof(second_rss_action));
-    second_rss_action.types = RTE_ETH_RSS_UDP;                  /* Hash on UDP fields */
-    second_rss_action.key_len = 0;                              /* Use default RSS key */   
-    second_rss_action.key = NULL;                               /* Use default key */
-
-    if (second_rx_ids.size() != 0){
-        second_rss_action.queue_num = second_rx_ids.size();   /* Number of queues */
-        second_rss_action.queue = second_rx_ids.data();       /* Queue IDs */
-    } else {
-        second_rss_action.queue_num = ddr_rx_ids.size();   /* Number of queues */
-        second_rss_action.queue = ddr_rx_ids.data();       /* Queue IDs */
+    //*** The controller owns the steering, everything starts on tier 0 */
+    if (sw_tiering.enabled()) {
+        sw_tiering.start(port_id, ddr_rx_ids, second_rx_ids, &ring_rx_record);
+        return 0;
     }
 
-    action[0].type = RTE_FLOW_ACTION_TYPE_RSS;
-    action[0].conf = &second_rss_action;
-    action[1].type = RTE_FLOW_ACTION_TYPE_END;
-
-    /* Validate and create the flow rule */
-    if (rte_flow_validate(port_id, &attr, pattern, action, &error))
-        rte_exit(EXIT_FAILURE, "Flow validation failed (Rule 2): %s\n", error.message ? error.message : "(no stated reason)");
+    //*** Large packets of the DDR half to the second tier, above the default pair */
+    if (size_class_len != 0) {
+        FlowRule large;
+        large.origin = "size-class";
+        large.dport_mask = 0x0003;          // Last two bits '00'
+        large.target = FlowRule::TIER_SECOND;
+        std::vector<FlowRule> rules = size_class_rules(large);
+        for (FlowRule& r : default_flow_rules(0x0000, 0x0000)) {
+            r.priority++;
+            rules.push_back(r);
+        }
+        install_flow_rules(port_id, reorder_rss_rules(rules), ddr_rx_ids, second_rx_ids);
+        return 0;
+    }
 
-    if (!rte_flow_create(port_id, &attr, pattern, action, &error))
-        rte_exit(EXIT_FAILURE, "Flow creation failed (Rule 2): %s\n", error.message ? error.message : "(no stated reason)");
+    if (tenants.empty()) {
+        install_flow_rules(port_id, reorder_rss_rules(flow_rules.empty() ? default_flow_rules(0x0000, 0x0000) : flow_rules), ddr_rx_ids, second_rx_ids);
+        return 0;
+    }
 
+    //*** Every tenant gets the default pair over its own port range and queues */
+    for (const Tenant& t : tenants) {
+        std::vector<uint16_t> tenant_ddr_ids, tenant_second_ids;
+        for (uint16_t q : ddr_rx_ids)
+            if (tenant_of(q) == &t)
+                tenant_ddr_ids.push_back(q);
+        for (uint16_t q : second_rx_ids)
+            if (t.second_ring_size != 0 && tenant_of(q % rx_lcore_count) == &t)
+                tenant_second_ids.push_back(q);
+
+        std::vector<FlowRule> rules;
+        for (const PortBlock& b : port_blocks(t.dport_lo, t.dport_hi)) {
+            for (FlowRule& r : default_flow_rules(b.value, b.mask)) {
+                r.origin = t.name;
+                rules.push_back(r);
+            }
+        }
+        install_flow_rules(port_id, reorder_rss_rules(rules), tenant_ddr_ids, tenant_second_ids);
+    }
     return 0;
 }
 
@@ -559,6 +702,8 @@ void setup_ring_monitors(const std::vector<uint16_t>& ddr_rx_ids, const std::vec
     lcore_processing_time.resize(total_lcores, 0);
     lcore_processing_time_snapshot.resize(total_lcores, 0);
 
+    size_class_record.resize(size_class_llc ? total_lcores : 0);
+
     lcore_polling_time.resize(total_lcores, 0);
     lcore_polling_time_snapshot.resize(total_lcores, 0);
 
@@ -580,15 +725,6 @@ static void stop_rx(int sig)
 }
 
 
-static void nsleep_high_precision(uint64_t ns){
-    if (ns == 0) return;
-    // convert ns to tsc cycles
-    uint64_t tsc_cycles = (tsc_hz * ns) / 1000000000;
-    double start = rte_rdtsc();
-    double end = start + tsc_cycles;
-    while(rte_rdtsc() < end);
-}
-
 struct numa_allocation_thread_args {
     const char* name;
     uint8_t numa_idx;
@@ -686,6 +822,7 @@ inline struct rte_mbuf* build_tx_stats_pkt(struct rte_mbuf* rx_pkt){
     pkt_data->fpga_tx_timestamp = rx_pkt_data->fpga_tx_timestamp;
     pkt_data->fpga_rx_timestamp = rx_pkt_data->fpga_rx_timestamp;
     pkt_data->bytes_us = bytes_us;
+    pkt_data->flow_id = FLOW_SEQ_INVALID;      //A copy, not part of its flow's sequence
     pkt->data_len = sizeof(dpdk_exp_pkt);
     pkt->pkt_len = pkt->data_len;
 
@@ -0,0 +1,127 @@
+#ifndef _SIZE_CLASS_H_
+#define _SIZE_CLASS_H_
+
+/***********************************************************************/
+/***************************** Size Classes ****************************/
+/***********************************************************************/
+/**
+ * Packets split in two classes at an IPv4 total length: a large packet fills more DDIO ways per
+ * descriptor than a small one, so it is the one to push to the far tier first.
+ *  -z <len>            large packets always go to the second tier, one rule per length block above
+ *                      the default pair
+ *  -z <len>:<th1>      with -t, the large packets leave tier 0 at <th1> descriptors, the small ones
+ *                      at the -t th1 (see sw_tiering.h)
+ * The FPGA counterpart is the unused2 config of nic_switch.v (length in [15:0]).
+ *
+ * The LLC experiment (-Z) splits every burst by class and runs the app on each part between two
+ * reads of the lcore's LLC miss counter, for the misses and cycles per packet of each class.
+ */
+#include <atomic>
+#include <sstream>
+#include <iomanip>
+#include "apps/llc_miss_counter.h"
+
+enum SizeClass {
+    SMALL_PKT = 0,
+    LARGE_PKT = 1,
+    NUM_SIZE_CLASSES = 2
+};
+
+static const char* size_class_str[NUM_SIZE_CLASSES] = {"small", "large"};
+
+static uint64_t size_class_len = 0;                     // Smallest large IPv4 total length, 0 = off
+static uint64_t size_class_th1 = 0;                     // Tier 0 -> 1 threshold of the large packets under -t
+static bool size_class_llc = false;
+
+struct SizeClassRecord {
+    uint64_t pkts[NUM_SIZE_CLASSES] = {};
+    uint64_t bytes[NUM_SIZE_CLASSES] = {};
+    uint64_t cycles[NUM_SIZE_CLASSES] = {};
+    uint64_t llc_misses[NUM_SIZE_CLASSES] = {};
+};
+
+static std::vector<SizeClassRecord> size_class_record;          // Per RX index
+static SizeClassRecord size_class_record_snapshot;              // Monitor only
+static std::atomic<uint64_t> size_class_llc_lcores{0};          // Lcores with a working LLC miss counter
+
+// <len>[:<th1>], false if malformed
+static bool parse_size_class(const char* spec)
+{
+    unsigned long len, th1 = 0;
+    int n = sscanf(spec, "%lu:%lu", &len, &th1);
+    if (n < 1 || len == 0 || len > 0xFFFF || (n == 2 && th1 == 0))
+        return false;
+    size_class_len = len;
+    size_class_th1 = th1;
+    return true;
+}
+
+static inline SizeClass size_class_of(rte_mbuf* m)
+{
+    const dpdk_exp_pkt* pkt = rte_pktmbuf_mtod(m, const dpdk_exp_pkt*);
+    return rte_be_to_cpu_16(pkt->ipv4_hdr.total_length) >= size_class_len ? LARGE_PKT : SMALL_PKT;
+}
+
+// Copies of base restricted to the large packets, one per length block
+static std::vector<FlowRule> size_class_rules(const FlowRule& base)
+{
+    std::vector<FlowRule> rules;
+    for (const PortBlock& b : port_blocks(size_class_len, 0xFFFF)) {
+        FlowRule r = base;
+        r.total_len = b.value;
+        r.total_len_mask = b.mask;
+        rules.push_back(r);
+    }
+    return rules;
+}
+
+static SizeClassRecord size_class_totals()
+{
+    SizeClassRecord t;
+    for (const SizeClassRecord& r : size_class_record) {
+        for (int c = 0; c < NUM_SIZE_CLASSES; c++) {
+            t.pkts[c] += r.pkts[c];
+            t.bytes[c] += r.bytes[c];
+            t.cycles[c] += r.cycles[c];
+            t.llc_misses[c] += r.llc_misses[c];
+        }
+    }
+    return t;
+}
+
+static std::string size_class_interval_stats()
+{
+    SizeClassRecord t = size_class_totals();
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << "Size class cycles/pkt (LLC misses/pkt):";
+    for (int c = 0; c < NUM_SIZE_CLASSES; c++) {
+        uint64_t pkts = t.pkts[c] - size_class_record_snapshot.pkts[c];
+        uint64_t cycles = t.cycles[c] - size_class_record_snapshot.cycles[c];
+        uint64_t misses = t.llc_misses[c] - size_class_record_snapshot.llc_misses[c];
+        out << (c ? " -- " : " ") << size_class_str[c] << " " << (pkts ? (double)cycles / pkts : 0.0)
+            << " (" << (pkts ? (double)misses / pkts : 0.0) << ")";
+    }
+    size_class_record_snapshot = t;
+    return out.str();
+}
+
+static std::string size_class_stats()
+{
+    SizeClassRecord t = size_class_totals();
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2)
+        << "============ SIZE CLASS STATS ============\n"
+        << "Large From: " << size_class_len << " B -- LLC Miss Counter: " << size_class_llc_lcores.load()
+        << "/" << size_class_record.size() << " lcores\n";
+    for (int c = 0; c < NUM_SIZE_CLASSES; c++) {
+        out << "  " << std::left << std::setw(6) << size_class_str[c] << std::right
+            << " Pkts: " << t.pkts[c]
+            << " -- Avg Size: " << (t.pkts[c] ? (double)t.bytes[c] / t.pkts[c] : 0.0) << " B"
+            << " -- Cycles/Pkt: " << (t.pkts[c] ? (double)t.cycles[c] / t.pkts[c] : 0.0)
+            << " -- LLC Misses/Pkt: " << (t.pkts[c] ? (double)t.llc_misses[c] / t.pkts[c] : 0.0)
+            << " -- LLC Misses/KB: " << (t.bytes[c] ? t.llc_misses[c] * 1024.0 / t.bytes[c] : 0.0) << "\n";
+    }
+    return out.str();
+}
+
+#endif /* _SIZE_CLASS_H_ */
@@ -0,0 +1,249 @@
+#ifndef _SW_TIERING_H_
+#define _SW_TIERING_H_
+
+/***********************************************************************/
+/*************************** Software Tiering **************************/
+/***********************************************************************/
+/**
+ * Ingress tier decision of nic_switch.v, taken on the host for NICs without the FPGA.
+ * The main lcore samples the RX queue occupancy (rte_eth_rx_queue_count, in descriptors) every
+ * period and runs the same hysteresis as the hardware, t0/t1 being the fullest DDR/second queue:
+ *  ingress tier 0 -> 1 when t0 >= th1
+ *  ingress tier 1 -> 0 when t1 >= th2 or t0 < th3
+ * One catch-all UDP rule steers the new arrivals to the ingress tier's queues. A switch is
+ * make-before-break: the new rule goes in at priority 0 over the steady one at priority 1, the old
+ * one is destroyed, then the new one is moved down to priority 1 the same way, so a packet always
+ * matches exactly one tier. The queues already filled keep draining where they are.
+ * The consumption rate of each tier (packets dequeued per second) is measured over the same
+ * periods and reported next to the occupancy.
+ *
+ * With a size class (-z <len>:<th1>, size_class.h), the large packets get a lane of their own: the
+ * same hysteresis with their th1, on length rules at priorities 0/1 above the catch-all lane (2/3).
+ */
+#include <sstream>
+#include <iomanip>
+
+#define SW_TIERING_DEFAULT_PERIOD_US 20
+
+class SwTieringController {
+
+private:
+    enum Tier {
+        TIER0 = 0,
+        TIER1 = 1
+    };
+
+    bool on = false;
+    uint64_t th1 = 0, th2 = 0, th3 = 0;
+    uint64_t period_us = SW_TIERING_DEFAULT_PERIOD_US;
+    uint64_t period_cycles = 0;
+
+    uint16_t port = 0;
+    std::vector<uint16_t> ddr_rx_ids;
+    std::vector<uint16_t> second_rx_ids;
+    const std::vector<uint64_t>* rx_record = nullptr;      // Packets dequeued per queue, by the RX lcores
+
+    //*** One set of rules with its own ingress tier */
+    struct Lane {
+        const char* name = "all";
+        bool large = false;                 // Matches the large size class only
+        uint32_t priority = 0;              // Of the bridge rule, the steady rules sit one below
+        uint64_t th1 = 0;
+        Tier ingress = TIER0;
+        std::vector<rte_flow*> steady;      // Rules of the current ingress tier
+        uint64_t since_tsc = 0;
+        uint64_t tier1_cycles = 0;
+        uint64_t num_switches = 0;
+        uint64_t interval_switches = 0;
+    };
+
+    Lane all;
+    Lane large;
+    bool size_aware = false;
+    uint64_t start_tsc = 0;
+    uint64_t last_tsc = 0;
+
+    //*** Stats, main lcore only */
+    uint64_t num_samples = 0;
+    uint64_t switch_cycles = 0;
+    uint64_t t0_occupancy = 0, t1_occupancy = 0;
+    uint64_t t0_occupancy_max = 0, t1_occupancy_max = 0;
+    uint64_t t0_dequeued = 0, t1_dequeued = 0;
+    double t0_rate = 0, t1_rate = 0;                    // pkts/s, EWMA over the periods
+
+    std::vector<rte_flow*> install(const Lane& lane, Tier tier, uint32_t priority) {
+        FlowRule r;
+        r.origin = "sw-tiering";
+        r.priority = priority;
+        r.target = (tier == TIER1) ? FlowRule::TIER_SECOND : FlowRule::TIER_DDR;
+        return install_flow_rules(port, lane.large ? size_class_rules(r) : std::vector<FlowRule>{r}, ddr_rx_ids, second_rx_ids, false);
+    }
+
+    void destroy(const std::vector<rte_flow*>& flows) {
+        struct rte_flow_error error;
+        for (rte_flow* flow : flows)
+            if (rte_flow_destroy(port, flow, &error))
+                rte_exit(EXIT_FAILURE, "SW tiering: flow destroy failed: %s\n", error.message ? error.message : "(no stated reason)");
+    }
+
+    static uint64_t max_occupancy(uint16_t port, const std::vector<uint16_t>& ids) {
+        uint64_t occupancy = 0;
+        for (uint16_t q : ids)
+            occupancy = std::max(occupancy, (uint64_t)std::max(rte_eth_rx_queue_count(port, q), 0));
+        return occupancy;
+    }
+
+    uint64_t dequeued(const std::vector<uint16_t>& ids) const {
+        uint64_t n = 0;
+        for (uint16_t q : ids)
+            n += (*rx_record)[q];
+        return n;
+    }
+
+    void switch_to(Lane& lane, Tier tier, uint64_t now) {
+        uint64_t start = rte_get_tsc_cycles();
+        std::vector<rte_flow*> bridge = install(lane, tier, lane.priority);
+        destroy(lane.steady);
+        lane.steady = install(lane, tier, lane.priority + 1);
+        destroy(bridge);
+        switch_cycles += rte_get_tsc_cycles() - start;
+
+        if (lane.ingress == TIER1)
+            lane.tier1_cycles += now - lane.since_tsc;
+        lane.since_tsc = now;
+        lane.ingress = tier;
+        lane.num_switches++;
+        lane.interval_switches++;
+    }
+
+    void step(Lane& lane, uint64_t now) {
+        if (lane.ingress == TIER0 && t0_occupancy >= lane.th1)
+            switch_to(lane, TIER1, now);
+        else if (lane.ingress == TIER1 && (t1_occupancy >= th2 || t0_occupancy < th3))
+            switch_to(lane, TIER0, now);
+    }
+
+    double tier1_share(const Lane& lane, uint64_t now) const {
+        uint64_t in_tier1 = lane.tier1_cycles + (lane.ingress == TIER1 ? now - lane.since_tsc : 0);
+        return now > start_tsc ? in_tier1 * 100.0 / (now - start_tsc) : 0.0;
+    }
+
+public:
+
+    // th1:th2:th3[:period_us], false if malformed
+    bool parse(const char* spec) {
+        unsigned long a, b, c, p = SW_TIERING_DEFAULT_PERIOD_US;
+        int n = sscanf(spec, "%lu:%lu:%lu:%lu", &a, &b, &c, &p);
+        if (n < 3 || p == 0 || c > a)
+            return false;
+        th1 = a;
+        th2 = b;
+        th3 = c;
+        period_us = p;
+        on = true;
+        return true;
+    }
+
+    // Large packets leave tier 0 at large_th1 instead of th1, false unless th3 <= large_th1 <= th1
+    bool set_size_class(uint64_t large_th1) {
+        if (large_th1 < th3 || large_th1 > th1)
+            return false;
+        large.th1 = large_th1;
+        size_aware = true;
+        return true;
+    }
+
+    bool enabled() const { return on; }
+
+    // Installs the tier 0 rule, rte_exit if the PMD can't report the queue occupancy
+    void start(uint16_t port_id, const std::vector<uint16_t>& ddr_ids, const std::vector<uint16_t>& second_ids,
+               const std::vector<uint64_t>* ring_rx_record)
+    {
+        port = port_id;
+        ddr_rx_ids = ddr_ids;
+        second_rx_ids = second_ids;
+        rx_record = ring_rx_record;
+        if (second_rx_ids.empty())
+            rte_exit(EXIT_FAILURE, "SW tiering needs a secondary ring mode (-s)\n");
+        if (rte_eth_rx_queue_count(port, ddr_rx_ids[0]) < 0)
+            rte_exit(EXIT_FAILURE, "SW tiering: the port can't report its rx queue occupancy\n");
+
+        period_cycles = rte_get_tsc_hz() / 1000000 * period_us;
+        all.th1 = th1;
+        if (size_aware) {
+            large.name = "large";
+            large.large = true;
+            large.priority = 0;
+            all.priority = 2;
+            large.steady = install(large, TIER0, large.priority + 1);
+        }
+        all.steady = install(all, TIER0, all.priority + 1);
+        start_tsc = last_tsc = all.since_tsc = large.since_tsc = rte_get_tsc_cycles();
+        printf("SW tiering: th1 %lu, th2 %lu, th3 %lu descriptors, every %lu us, %lu tier-0 and %lu tier-1 queues\n",
+            th1, th2, th3, period_us, ddr_rx_ids.size(), second_rx_ids.size());
+        if (size_aware)
+            printf("SW tiering: packets from %lu B leave tier 0 at %lu descriptors\n", size_class_len, large.th1);
+    }
+
+    // Called from the monitor loop, samples once per period
+    void poll(uint64_t now)
+    {
+        if (now - last_tsc < period_cycles)
+            return;
+        double seconds = (double)(now - last_tsc) / rte_get_tsc_hz();
+        last_tsc = now;
+
+        t0_occupancy = max_occupancy(port, ddr_rx_ids);
+        t1_occupancy = max_occupancy(port, second_rx_ids);
+        t0_occupancy_max = std::max(t0_occupancy_max, t0_occupancy);
+        t1_occupancy_max = std::max(t1_occupancy_max, t1_occupancy);
+
+        uint64_t t0 = dequeued(ddr_rx_ids), t1 = dequeued(second_rx_ids);
+        t0_rate = 0.875 * t0_rate + 0.125 * ((t0 - t0_dequeued) / seconds);
+        t1_rate = 0.875 * t1_rate + 0.125 * ((t1 - t1_dequeued) / seconds);
+        t0_dequeued = t0;
+        t1_dequeued = t1;
+        num_samples++;
+
+        if (size_aware)
+            step(large, now);
+        step(all, now);
+    }
+
+    std::string print_interval_stats() {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3)
+            << "SW tiering: ingress tier " << all.ingress;
+        if (size_aware)
+            out << " (large " << large.ingress << ")";
+        out << " -- switches " << all.interval_switches;
+        if (size_aware)
+            out << " (large " << large.interval_switches << ")";
+        out << " -- occupancy t0 " << t0_occupancy << " t1 " << t1_occupancy
+            << " -- consumption t0 " << t0_rate / 1000000.0 << " Mpps t1 " << t1_rate / 1000000.0 << " Mpps";
+        all.interval_switches = large.interval_switches = 0;
+        return out.str();
+    }
+
+    std::string print_stats() {
+        uint64_t now = rte_get_tsc_cycles();
+        uint64_t num_switches = all.num_switches + large.num_switches;
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << "============ SW TIERING STATS ============\n"
+            << "Thresholds: th1 " << th1 << " th2 " << th2 << " th3 " << th3 << " -- Period: " << period_us << " us"
+            << " -- Samples: " << num_samples << "\n"
+            << "Switches: " << num_switches
+            << " -- Switch Time: " << (num_switches ? switch_cycles * 1000000.0 / rte_get_tsc_hz() / num_switches : 0.0) << " us avg"
+            << " -- Ingress On Tier 1: " << tier1_share(all, now) << "% of the time\n";
+        if (size_aware)
+            out << "Large Packets (from " << size_class_len << " B): th1 " << large.th1 << " -- Switches: " << large.num_switches
+                << " -- Ingress On Tier 1: " << tier1_share(large, now) << "% of the time\n";
+        out << "Max Occupancy: t0 " << t0_occupancy_max << " t1 " << t1_occupancy_max << "\n";
+        return out.str();
+    }
+};
+
+static SwTieringController sw_tiering;
+
+#endif /* _SW_TIERING_H_ */
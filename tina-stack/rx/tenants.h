@@ -0,0 +1,156 @@
+#ifndef _TENANTS_H_
+#define _TENANTS_H_
+
+/***********************************************************************/
+/***************************** Multi-Tenant ****************************/
+/***********************************************************************/
+/**
+ * Several apps in one process, each on its own group of lcore pairs (= RX queue indexes) and fed
+ * by its own UDP dst-port range. Every range becomes the usual pair of tier rules restricted to the
+ * range: dst port & 0x3 == 00 goes to the tenant's DDR queues, == 10 to its secondary queues.
+ *
+ * Tenant file, one tenant per line, '#' starts a comment:
+ *  <name> <app> <dport lo>-<dport hi> <lcore pairs> <DDR ring size> <second ring size> [<arg1> [<arg2>]]
+ * The tenants take the RX indexes in file order. The range bounds are multiples of 4 (lo) and
+ * 4k - 1 (hi), so the two low bits stay free for the tier rules. An argument with spaces (a CHAIN
+ * spec) goes in double quotes, anything after arg2 is an error. A second ring size of 0 keeps the
+ * tenant off the secondary tier, its '10' packets stay on its DDR queues.
+ * The secondary ring mode (-s) is process wide: the mbuf pools behind the second tier are shared.
+ */
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <strings.h>
+
+#define TENANT_IDLE_RING_SIZE 64            //Second rings of the tenants that don't spill, never fed
+
+struct Tenant {
+    std::string name;
+    ApplicationChoice app;
+    std::string app_arg1_str;
+    std::string app_arg2_str;
+    uint32_t dport_lo;
+    uint32_t dport_hi;
+    uint64_t first_rx_index;
+    uint64_t lcore_pairs;
+    uint64_t rx_ring_size_ddr;
+    uint64_t second_ring_size;
+
+    //*** Monitor snapshots */
+    uint64_t ddr_rx_snapshot = 0;
+    uint64_t second_rx_snapshot = 0;
+    uint64_t processing_time_snapshot = 0;
+};
+
+static std::vector<Tenant> tenants;
+static std::string tenant_file = "";
+
+static bool parse_app_name(const std::string& name, ApplicationChoice* app)
+{
+    for (const auto& entry : application_choice_str) {
+        if (strcasecmp(entry.second.c_str(), name.c_str()) == 0) {
+            *app = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Load the tenant file, -1 on any error
+static int64_t parse_tenants(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        printf("Cannot open tenant file %s\n", path.c_str());
+        return -1;
+    }
+
+    std::string line;
+    uint64_t line_no = 0;
+    uint64_t next_rx_index = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string name, app, range;
+        Tenant t;
+        if (!(fields >> name))
+            continue;
+        if (!(fields >> app >> range >> t.lcore_pairs >> t.rx_ring_size_ddr >> t.second_ring_size)) {
+            printf("%s:%lu, expected <name> <app> <lo>-<hi> <lcore pairs> <DDR ring> <second ring> [<arg1> [<arg2>]]\n", path.c_str(), line_no);
+            return -1;
+        }
+        fields >> std::quoted(t.app_arg1_str) >> std::quoted(t.app_arg2_str) >> std::ws;
+        if (!fields.eof()) {
+            printf("%s:%lu, unexpected text after the app arguments, quote an argument with spaces\n", path.c_str(), line_no);
+            return -1;
+        }
+        t.name = name;
+
+        if (!parse_app_name(app, &t.app)) {
+            printf("%s:%lu, unknown app %s\n", path.c_str(), line_no, app.c_str());
+            return -1;
+        }
+        if (sscanf(range.c_str(), "%u-%u", &t.dport_lo, &t.dport_hi) != 2 || t.dport_lo > t.dport_hi || t.dport_hi > 0xFFFF
+            || t.dport_lo % 4 != 0 || t.dport_hi % 4 != 3) {
+            printf("%s:%lu, dst port range %s should be <4k>-<4m+3> within 0-65535\n", path.c_str(), line_no, range.c_str());
+            return -1;
+        }
+        if (t.lcore_pairs == 0 || t.rx_ring_size_ddr == 0) {
+            printf("%s:%lu, a tenant needs at least one lcore pair and a DDR ring\n", path.c_str(), line_no);
+            return -1;
+        }
+        for (const Tenant& other : tenants) {
+            if (other.name == t.name || !(t.dport_hi < other.dport_lo || t.dport_lo > other.dport_hi)) {
+                printf("%s:%lu, tenant %s clashes with %s (same name or overlapping ports)\n",
+                    path.c_str(), line_no, t.name.c_str(), other.name.c_str());
+                return -1;
+            }
+        }
+
+        t.first_rx_index = next_rx_index;
+        next_rx_index += t.lcore_pairs;
+        if (t.app == L3FWD || (t.app == CHAIN && strcasestr(t.app_arg1_str.c_str(), "L3FWD") != nullptr))
+            tx_ring_size = FORWARDING_TX_RING_SIZE;
+        tenants.push_back(t);
+    }
+
+    if (tenants.empty()) {
+        printf("No tenant in %s\n", path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+static uint64_t tenant_lcore_pairs()
+{
+    uint64_t pairs = 0;
+    for (const Tenant& t : tenants)
+        pairs += t.lcore_pairs;
+    return pairs;
+}
+
+static const Tenant* tenant_of(uint64_t rx_index)
+{
+    for (const Tenant& t : tenants)
+        if (rx_index >= t.first_rx_index && rx_index < t.first_rx_index + t.lcore_pairs)
+            return &t;
+    return nullptr;
+}
+
+// Ring sizes of RX queue index q, the process wide ones without tenants
+static uint64_t ddr_ring_size_of(uint64_t q, uint64_t ring_size)
+{
+    const Tenant* t = tenant_of(q);
+    return t ? t->rx_ring_size_ddr : ring_size;
+}
+
+static uint64_t second_ring_size_of(uint64_t q, uint64_t ring_size)
+{
+    const Tenant* t = tenant_of(q);
+    if (!t)
+        return ring_size;
+    return t->second_ring_size ? t->second_ring_size : TENANT_IDLE_RING_SIZE;
+}
+
+#endif /* _TENANTS_H_ */
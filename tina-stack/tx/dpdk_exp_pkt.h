@@ -25,6 +25,9 @@ struct dpdk_exp_pkt
     uint16_t sec_processed_pkt_count;
     uint64_t bytes_us;
 
+    uint32_t flow_id;                       //!flow_seq.h, all ones when the generator doesn't number its flows
+    uint32_t flow_seq;
+
     #if defined(ENABLE_REMOTE_PERF)
         uint64_t perf_event_values[numEvents];
     #endif
@@ -0,0 +1,166 @@
+#ifndef FLOW_SEQ_H
+#define FLOW_SEQ_H
+
+/***********************************************************************/
+/************************* Per-Flow Sequencing *************************/
+/***********************************************************************/
+/**
+ * The generator numbers every packet of a flow (dpdk_exp_pkt flow_id/flow_seq), a flow being one
+ * fixed 5-tuple of one TX lcore: flow_id = <TX lcore index> << 16 | <flow index>. Without numbered
+ * flows, create_udp_pkt leaves flow_id at FLOW_SEQ_INVALID and the packet isn't tracked.
+ * A tracker sits wherever the packets land (the RX host's process lcores, the generator's RX lcores)
+ * and keeps, per flow, the highest number seen and a window of the FLOW_SEQ_WINDOW numbers below it:
+ *  - a jump past missing numbers counts them as gaps, a late packet filling a gap takes one back
+ *  - a number already in the window is a duplicate
+ *  - any other number below the highest is reordered, its distance (highest - seq) goes to a log2
+ *    histogram
+ * A late packet older than the window is counted as reordered but can't be told from a duplicate,
+ * so it doesn't fill its gap: lost = gaps - fills is an upper bound.
+ */
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include "./dpdk_exp_pkt.h"
+
+#define FLOW_SEQ_INVALID 0xFFFFFFFF
+#define FLOW_SEQ_MAX_LCORES 16                  // TX lcores, MAX_TX_CORES of the generator
+#define FLOW_SEQ_MAX_FLOWS 256                  // Per TX lcore
+#define FLOW_SEQ_WINDOW 64
+#define FLOW_SEQ_HIST_BUCKETS 32                // Distance 1, 2-3, 4-7, ..., 2^31 and up
+
+struct FlowSeqStats {
+    uint64_t pkts = 0;
+    uint64_t gaps = 0;                          // Numbers skipped over
+    uint64_t fills = 0;                         // Late packets inside a counted gap
+    uint64_t dups = 0;
+    uint64_t reordered = 0;
+    uint64_t distance_max = 0;
+    uint64_t distance_hist[FLOW_SEQ_HIST_BUCKETS] = {};
+
+    uint64_t lost() const { return gaps - fills; }
+
+    void add(const FlowSeqStats& s) {
+        pkts += s.pkts;
+        gaps += s.gaps;
+        fills += s.fills;
+        dups += s.dups;
+        reordered += s.reordered;
+        distance_max = std::max(distance_max, s.distance_max);
+        for (int b = 0; b < FLOW_SEQ_HIST_BUCKETS; b++)
+            distance_hist[b] += s.distance_hist[b];
+    }
+};
+
+static inline uint32_t flow_seq_id(uint32_t tx_index, uint32_t flow)
+{
+    return tx_index << 16 | flow;
+}
+
+class FlowSeqTracker {
+
+private:
+    struct Flow {
+        uint32_t first_seq = 0;
+        uint32_t max_seq = 0;
+        uint64_t window = 0;                    // Bit d: max_seq - d was received
+        bool seen = false;
+    };
+
+    std::vector<Flow> flows;
+
+    static int bucket_of(uint32_t distance) {
+        return std::min(31 - __builtin_clz(distance), FLOW_SEQ_HIST_BUCKETS - 1);
+    }
+
+public:
+    FlowSeqStats stats;
+
+    FlowSeqTracker(): flows(FLOW_SEQ_MAX_LCORES * FLOW_SEQ_MAX_FLOWS) {}
+
+    // false if the packet carries no usable sequence number
+    inline bool track(const dpdk_exp_pkt* pkt)
+    {
+        uint32_t id = pkt->flow_id;
+        uint32_t tx_index = id >> 16, flow = id & 0xFFFF;
+        if (id == FLOW_SEQ_INVALID || tx_index >= FLOW_SEQ_MAX_LCORES || flow >= FLOW_SEQ_MAX_FLOWS)
+            return false;
+
+        Flow& f = flows[tx_index * FLOW_SEQ_MAX_FLOWS + flow];
+        uint32_t seq = pkt->flow_seq;
+        stats.pkts++;
+        if (!f.seen) {
+            f.first_seq = f.max_seq = seq;
+            f.window = 1;
+            f.seen = true;
+            return true;
+        }
+
+        int32_t ahead = (int32_t)(seq - f.max_seq);            // Wraps with the 32-bit numbers
+        if (ahead > 0) {
+            stats.gaps += ahead - 1;
+            f.window = (ahead >= FLOW_SEQ_WINDOW) ? 1 : (f.window << ahead) | 1;
+            f.max_seq = seq;
+            return true;
+        }
+
+        uint32_t distance = f.max_seq - seq;
+        if (distance < FLOW_SEQ_WINDOW) {
+            uint64_t bit = 1ULL << distance;
+            if (f.window & bit) {
+                stats.dups++;
+                return true;
+            }
+            f.window |= bit;
+            if ((int32_t)(seq - f.first_seq) > 0)                // Sent before the first one seen, never a gap
+                stats.fills++;
+        }
+        stats.reordered++;
+        stats.distance_max = std::max(stats.distance_max, (uint64_t)distance);
+        stats.distance_hist[bucket_of(distance)]++;
+        return true;
+    }
+};
+
+static FlowSeqStats flow_seq_totals(const std::vector<FlowSeqTracker>& trackers)
+{
+    FlowSeqStats t;
+    for (const FlowSeqTracker& tracker : trackers)
+        t.add(tracker.stats);
+    return t;
+}
+
+static std::string flow_seq_interval_stats(const FlowSeqStats& t, const FlowSeqStats& snapshot)
+{
+    std::ostringstream out;
+    out << "Flow seq: pkts " << t.pkts - snapshot.pkts
+        << " -- lost " << (int64_t)(t.lost() - snapshot.lost())
+        << " -- dup " << t.dups - snapshot.dups
+        << " -- reordered " << t.reordered - snapshot.reordered;
+    return out.str();
+}
+
+// Summary and the reorder distance histogram, printed by the RX host and written by the generator
+static std::string flow_seq_stats(const FlowSeqStats& t)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(4)
+        << "============ FLOW SEQUENCE STATS ============\n"
+        << "Pkts: " << t.pkts
+        << " -- Lost: " << t.lost() << " (" << (t.pkts + t.lost() ? t.lost() * 100.0 / (t.pkts + t.lost()) : 0.0) << "%)"
+        << " -- Duplicated: " << t.dups
+        << " -- Reordered: " << t.reordered << " (" << (t.pkts ? t.reordered * 100.0 / t.pkts : 0.0) << "%)"
+        << " -- Max Distance: " << t.distance_max << "\n"
+        << "Reorder Distance Histogram:\n";
+    for (int b = 0; b < FLOW_SEQ_HIST_BUCKETS; b++) {
+        if (!t.distance_hist[b])
+            continue;
+        uint64_t lo = 1ULL << b, hi = (b == FLOW_SEQ_HIST_BUCKETS - 1) ? UINT32_MAX : (lo << 1) - 1;
+        out << "  [" << lo << ", " << hi << "]: " << t.distance_hist[b] << "\n";
+    }
+    return out.str();
+}
+
+#endif /* FLOW_SEQ_H */
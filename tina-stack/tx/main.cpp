@@ -27,6 +27,12 @@ static int lcore_rx_burst(void *arg)
         {
             for (int i = 0; i < nb_rx_pkts; ++i)
             {
+                // The RX host's samples are copies with an invalid flow id, skipped here
+                if (seq_flows)
+                {
+                    rx_seq_trackers[rx_index].track(rte_pktmbuf_mtod(bufs[i], const dpdk_exp_pkt *));
+                }
+
                 if (latency_data.size() < SAMPLE_COUNT)
                 {
                     latency_data[rx_index].push_back(get_latency(bufs[i]));
@@ -88,6 +94,32 @@ static void usleep_high_precision(uint64_t us)
         ;
 }
 
+// Numbers and sends up to BURST_SIZE slots of the ring from *pos, all of them go out in ring order
+static uint64_t tx_seq_burst(unsigned int tx_index, std::vector<struct rte_mbuf *> &ring, std::vector<uint32_t> &next_seq, uint64_t *pos, uint64_t max)
+{
+    uint64_t n = std::min({(uint64_t)BURST_SIZE, max, ring.size() - *pos});
+    struct rte_mbuf **chunk = &ring[*pos];
+    for (uint64_t i = 0; i < n; i++)
+    {
+        dpdk_exp_pkt *pkt = rte_pktmbuf_mtod(chunk[i], dpdk_exp_pkt *);
+        pkt->flow_seq = next_seq[(*pos + i) % seq_flows]++;
+        if (software_timestamp)
+        {
+            timestamp_packet(chunk[i], 0);
+        }
+        // The driver frees what it sent, the extra reference keeps the slot out of the pool
+        rte_pktmbuf_refcnt_update(chunk[i], 1);
+    }
+
+    uint64_t sent = 0;
+    while (sent < n)
+    {
+        sent += rte_eth_tx_burst(port_id, tx_index, chunk + sent, n - sent);
+    }
+    *pos = (*pos + n) % ring.size();
+    return n;
+}
+
 // Generate TX packets in a logical core
 static int lcore_tx_burst(void *arg)
 {
@@ -120,6 +152,28 @@ static int lcore_tx_burst(void *arg)
         create_udp_pkt(mbufs[i], pkt_size, src_mac, dst_mac, src_ip, dst_ip, i + 1, src_port, dst_port);
     }
 
+    //******************************************
+    //********* Numbered flows: slot i of the ring carries flow i % seq_flows, one src port per flow
+    //******************************************
+    std::vector<struct rte_mbuf *> seq_ring;
+    std::vector<uint32_t> next_seq(seq_flows, 0);
+    uint64_t seq_pos = 0;
+    if (seq_flows)
+    {
+        seq_ring.resize((SEQ_RING_MIN_SIZE + seq_flows - 1) / seq_flows * seq_flows);
+        if (rte_pktmbuf_alloc_bulk(mbuf_pool, seq_ring.data(), seq_ring.size()) != 0)
+            rte_exit(EXIT_FAILURE, "Fail to allocate %lu sequence mbufs on lcore %2u\n", seq_ring.size(), lcore_id);
+
+        for (size_t i = 0; i < seq_ring.size(); i++)
+        {
+            uint32_t flow = i % seq_flows;
+            create_udp_pkt(seq_ring[i], pkt_size, src_mac, dst_mac, src_ip, dst_ip, i + 1,
+                           SEQ_SRC_PORT_BASE + tx_index * FLOW_SEQ_MAX_FLOWS + flow, FPGA_SWITCH_ID_PORT);
+            dpdk_exp_pkt *pkt = rte_pktmbuf_mtod(seq_ring[i], dpdk_exp_pkt *);
+            pkt->flow_id = flow_seq_id(tx_index, flow);
+        }
+    }
+
     //******************************************
     //***************** To support rate limiting
     //******************************************
@@ -131,7 +185,7 @@ static int lcore_tx_burst(void *arg)
     {
         pkts_in_curr_burst = pkt_per_burst_limited_percore_vec[curr_burst_idx];
 
-        if (software_timestamp)
+        if (software_timestamp && !seq_flows)
         {
             for (int64_t i = 0; i < BURST_SIZE; i++)
             {
@@ -142,6 +196,10 @@ static int lcore_tx_burst(void *arg)
         uint64_t start_time = rte_get_tsc_cycles();
         //**** Send Pkts from Mbufs ****/
         size_t nb_tx_pkts = 0;
+        while (seq_flows && nb_tx_pkts < pkts_in_curr_burst)
+        {
+            nb_tx_pkts += tx_seq_burst(tx_index, seq_ring, next_seq, &seq_pos, pkts_in_curr_burst - nb_tx_pkts);
+        }
         while (nb_tx_pkts < pkts_in_curr_burst)
         {
             int left_pkts = pkts_in_curr_burst - nb_tx_pkts;
@@ -156,8 +214,8 @@ static int lcore_tx_burst(void *arg)
             usleep_high_precision(int(delta));
         }
 
-        //**** Refrash Src_Port Random Value */
-        for (auto i = 0; i < BURST_SIZE; i++)
+        //**** Refrash Src_Port Random Value, numbered flows keep theirs */
+        for (auto i = 0; i < BURST_SIZE && !seq_flows; i++)
         {
             dpdk_exp_pkt *pkt = rte_pktmbuf_mtod(mbufs[i], dpdk_exp_pkt *);
             pkt->udp_hdr.src_port = rte_rand_max(SRC_PORT_RAND_MAX);
@@ -174,6 +232,8 @@ static int lcore_tx_burst(void *arg)
         bursts_sent++;
     }
     printf("lcore %2u sent %lu bursts\n", lcore_id, bursts_sent);
+    if (seq_flows)
+        rte_pktmbuf_free_bulk(seq_ring.data(), seq_ring.size());
     return 0;
 }
 
@@ -278,6 +338,8 @@ int main(int argc, char **argv)
         latency_data.push_back(std::vector<uint64_t>());
         latency_data[i].reserve(SAMPLE_COUNT);
     }
+    rx_seq_trackers.resize(seq_flows ? num_rx_core : 0);
+    FlowSeqStats rx_seq_snapshot;
 
     //*******************************
     //******************* Pkts Setup
@@ -371,6 +433,12 @@ int main(int argc, char **argv)
         float line_tput = pkt_rate * pkt_size_on_cable * 8;
 
         printf("TX: %8.4f M/%.3fs, link-tput: %8.1f Mbps, line-tput %8.1f Mbps\n", total_tx_pkts/1000000.0, monitor_interval_ms/1000.0, link_tput, line_tput);
+        if (seq_flows)
+        {
+            FlowSeqStats t = flow_seq_totals(rx_seq_trackers);
+            printf("RX %s\n", flow_seq_interval_stats(t, rx_seq_snapshot).c_str());
+            rx_seq_snapshot = t;
+        }
    }
 
 
@@ -421,6 +489,18 @@ int main(int argc, char **argv)
         latency_file.close();
     }
 
+    if (seq_flows){
+        FlowSeqStats t = flow_seq_totals(rx_seq_trackers);
+        std::cout << flow_seq_stats(t);
+        if (!seq_outfile.empty()){
+            std::cout << "Flow sequence data is saving to " << seq_outfile << std::endl;
+            std::ofstream seq_file(seq_outfile);
+            seq_file << "Sent " << total_tx_pkts << " packets on " << seq_flows << " flows per TX lcore" << std::endl;
+            seq_file << flow_seq_stats(t);
+            seq_file.close();
+        }
+    }
+
     if (!rx_occ_outfile.empty()){
         std::ofstream rx_occ_file(rx_occ_outfile);
         for (auto& [key, value]: rx_occ_samples)
@@ -23,6 +23,7 @@
 #include "pcim.hpp"
 
 #include "./dpdk_exp_pkt.h"
+#include "./flow_seq.h"
 #include "../dpdk-rx/dpdk_perf.h"
 /*****************************************************************************************************/
 /***************************************** Connection Setup ******************************************/
@@ -38,6 +39,7 @@
 #define BURST_SIZE 32
 #define MAX_TX_CORES 16
 #define INVALID_RX_SAMPLE_ID 255
+#define MIN_PKT_SIZE RTE_MAX((size_t)(RTE_ETHER_MIN_LEN - RTE_ETHER_CRC_LEN), sizeof(dpdk_exp_pkt))   //!create_udp_pkt fills a whole dpdk_exp_pkt
 
 static const struct rte_eth_conf port_conf_default = {
     .rxmode = {
@@ -118,7 +120,7 @@ static struct rte_ether_addr dst_mac;
 static rte_be32_t src_ip;
 static rte_be32_t dst_ip;
 
-static uint16_t pkt_size = RTE_ETHER_MIN_LEN - RTE_ETHER_CRC_LEN;
+static uint16_t pkt_size = MIN_PKT_SIZE;
 
 /*****************************************************************************************************/
 /******************************************* Monitor Setup *******************************************/
@@ -151,6 +153,16 @@ typedef struct rx_sample_point{
 
 std::unordered_map<uint32_t, std::vector<rx_sample_point_t>> rx_occ_samples;
 
+/*****************************************************************************************************/
+/************************************* Per-Flow Sequence Setup ***************************************/
+/*****************************************************************************************************/
+#define SEQ_SRC_PORT_BASE 1024
+#define SEQ_RING_MIN_SIZE (TX_RING_SIZE + 2 * BURST_SIZE)   //!A slot is only rewritten once the NIC is done with it
+
+static uint32_t seq_flows = 0;                  // Numbered flows per TX lcore, 0 = random src ports, no numbers
+static std::string seq_outfile = "";
+std::vector<FlowSeqTracker> rx_seq_trackers;    // Per RX index, the packets that come back
+
 /*****************************************************************************************************/
 /******************************************* General Setup *******************************************/
 /*****************************************************************************************************/
@@ -198,9 +210,11 @@ static void print_usage(const char *prgname)
            "    -O, --latency_outfile=<file>    file to write latency data to \n"
            "    -R  --rx_sample_outfile=<file>  file to write rx sample data to \n"
            "    -S, --software-timestamp        use software timestamping\n"
+           "    -F, --seq_flows=<n>             number the packets of <n> fixed flows per TX lcore (max %u), checked on return\n"
+           "    -Q, --seq_outfile=<file>        file to write the loss/dup/reorder stats of -F to (default <latency_outfile>.seq)\n"
            "   -c, --enable_c_rate              enable c rate (default no)\n"
            "    -h, --help                      print usage of the program\n",
-           prgname, port_id, monitor_interval_ms);
+           prgname, port_id, monitor_interval_ms, FLOW_SEQ_MAX_FLOWS);
 }
 
 static int parse_args(int argc, char **argv)
@@ -221,10 +235,12 @@ static int parse_args(int argc, char **argv)
         {"latency-outfile", required_argument, 0, 'O'},
         {"rx_sample_outfile", required_argument, 0, 'R'},
         {"software-timestamp", no_argument, 0, 'S'},
+        {"seq_flows", required_argument, 0, 'F'},
+        {"seq_outfile", required_argument, 0, 'Q'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}};
 
-    char short_options[] = "p:i:s:r:R:B:E:j:J:d:g:f:O:S:c:h";
+    char short_options[] = "p:i:s:r:R:B:E:j:J:d:g:f:O:S:c:F:Q:h";
     char *prgname = argv[0];
 
     int nb_required_args = 0;
@@ -260,7 +276,7 @@ static int parse_args(int argc, char **argv)
                 return -1;
             }
 
-            uint16_t min_pkt_size = RTE_ETHER_MIN_LEN - RTE_ETHER_CRC_LEN;
+            uint16_t min_pkt_size = MIN_PKT_SIZE;
             uint16_t max_pkt_size = RTE_ETHER_MAX_JUMBO_FRAME_LEN - RTE_ETHER_CRC_LEN;
             if (pkt_size < min_pkt_size || pkt_size > max_pkt_size)
             {
@@ -378,6 +394,24 @@ static int parse_args(int argc, char **argv)
             software_timestamp = 1;
             break;
 
+        case 'F':
+            seq_flows = (uint32_t)strtoul(optarg, endptr, 10);
+            if (seq_flows == 0 || seq_flows > FLOW_SEQ_MAX_FLOWS)
+            {
+                fprintf(stderr, "SEQ_FLOWS should be in [1, %u]\n", FLOW_SEQ_MAX_FLOWS);
+                return -1;
+            }
+            break;
+
+        case 'Q':
+            seq_outfile = std::string(optarg);
+            if (seq_outfile.empty() || seq_outfile == "0")
+            {
+                fprintf(stderr, "SEQ_OUTFILE %s is empty\n", optarg);
+                return -1;
+            }
+            break;
+
         case 'c':
             enable_c_rate = true;
             break;
@@ -396,6 +430,17 @@ static int parse_args(int argc, char **argv)
         return -1;
     }
 
+    if (pkt_size < sizeof(dpdk_exp_pkt))
+    {
+        fprintf(stderr, "PKT_SIZE should be >= %lu, every packet carries a whole dpdk_exp_pkt\n", sizeof(dpdk_exp_pkt));
+        return -1;
+    }
+
+    if (seq_flows && seq_outfile.empty() && !latency_outfile.empty())
+    {
+        seq_outfile = latency_outfile + ".seq";
+    }
+
     if (optind >= 0)
     {
         argv[optind - 1] = prgname;
@@ -499,6 +544,7 @@ static void print_config()
     print_ip(src_ip);
     printf("Dst IP:         ");
     print_ip(dst_ip);
+    printf("Numbered Flows:         %u per TX lcore\n", seq_flows);
 
 }
 